@@ -0,0 +1,292 @@
+#include "BinaryDiff.h"
+#include "ManifestFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+    const char MAGIC[4] = { 'T', 'D', 'W', 'D' };
+
+    // 旧文件每隔这么多字节取一个 MIN_MATCH 长的窗口建立索引
+    const std::size_t SOURCE_STEP = 16;
+    const std::uint64_t ROLL_BASE = 0x100000001B3ULL;
+
+    void PutVarint(std::string& out, std::uint64_t value) {
+        while (value >= 0x80) {
+            out += static_cast<char>((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
+    }
+
+    void PutUint64(std::string& out, std::uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            out += static_cast<char>((value >> (8 * i)) & 0xFF);
+        }
+    }
+
+    bool GetVarint(const unsigned char*& p, const unsigned char* end, std::uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && p < end; shift += 7) {
+            unsigned char byte = *p++;
+            value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool GetUint64(const unsigned char*& p, const unsigned char* end, std::uint64_t& value) {
+        if (end - p < 8) {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < 8; ++i) {
+            value |= static_cast<std::uint64_t>(p[i]) << (8 * i);
+        }
+        p += 8;
+        return true;
+    }
+
+    std::uint64_t WindowHash(const unsigned char* data) {
+        std::uint64_t hash = 0;
+        for (std::size_t i = 0; i < BinaryDiff::MIN_MATCH; ++i) {
+            hash = hash * ROLL_BASE + data[i];
+        }
+        return hash;
+    }
+}
+
+// 旧文件一段范围的窗口索引：开放寻址，每个槽只记第一个落进来的位置（加 1，0 表示空）
+class BinaryDiffEncoder::SourceIndex {
+public:
+    SourceIndex(std::string_view source, std::size_t begin, std::size_t end)
+        : source_(reinterpret_cast<const unsigned char*>(source.data()))
+        , shift_(64)
+    {
+        std::size_t size = end - begin;
+        std::size_t windows = size >= BinaryDiff::MIN_MATCH ? (size - BinaryDiff::MIN_MATCH) / SOURCE_STEP + 1 : 0;
+        std::size_t slots = 1024;
+        while (slots < windows * 2) {
+            slots *= 2;
+        }
+        for (std::size_t bits = slots; bits > 1; bits >>= 1) {
+            --shift_;
+        }
+        slots_.assign(slots, 0);
+        for (std::size_t i = 0; i < windows; ++i) {
+            std::size_t position = begin + i * SOURCE_STEP;
+            std::uint32_t& slot = slots_[Slot(WindowHash(source_ + position))];
+            if (slot == 0) {
+                slot = static_cast<std::uint32_t>(position + 1);
+            }
+        }
+    }
+
+    // 和 target 处的窗口内容相同的旧文件位置，没有时返回 false
+    bool Find(std::uint64_t hash, const unsigned char* target, std::size_t& position) const {
+        std::uint32_t slot = slots_[Slot(hash)];
+        if (slot == 0 || std::memcmp(source_ + slot - 1, target, BinaryDiff::MIN_MATCH) != 0) {
+            return false;
+        }
+        position = slot - 1;
+        return true;
+    }
+
+private:
+    std::size_t Slot(std::uint64_t hash) const {
+        return static_cast<std::size_t>((hash * 0x9E3779B97F4A7C15ULL) >> shift_);
+    }
+
+    const unsigned char* source_;
+    unsigned shift_;
+    std::vector<std::uint32_t> slots_;
+};
+
+// BinaryDiffEncoder 实现
+BinaryDiffEncoder::BinaryDiffEncoder(std::string_view source, std::string_view target, std::string& out)
+    : source_(source)
+    , target_(target)
+    , out_(out)
+    , literal_(0)
+    , copyEnd_(0)
+    , copyLength_(0)
+    , copySource_(0)
+{
+    out_.clear();
+    out_.append(MAGIC, sizeof(MAGIC));
+    out_ += static_cast<char>(BinaryDiff::VERSION);
+    PutVarint(out_, source.size());
+    PutUint64(out_, HashDataContent(source));
+    PutVarint(out_, target.size());
+    PutUint64(out_, HashDataContent(target));
+}
+
+BinaryDiffEncoder::~BinaryDiffEncoder() = default;
+
+void BinaryDiffEncoder::FlushLiteral(std::size_t end) {
+    if (end > literal_) {
+        FlushCopy();
+        PutVarint(out_, static_cast<std::uint64_t>(end - literal_) << 1);
+        out_.append(target_.data() + literal_, end - literal_);
+    }
+    literal_ = end;
+}
+
+void BinaryDiffEncoder::FlushCopy() {
+    if (copyLength_ == 0) {
+        return;
+    }
+    std::int64_t delta = static_cast<std::int64_t>(copySource_) - static_cast<std::int64_t>(copyEnd_);
+    PutVarint(out_, (static_cast<std::uint64_t>(copyLength_) << 1) | 1);
+    PutVarint(out_, (static_cast<std::uint64_t>(delta) << 1) ^ static_cast<std::uint64_t>(delta >> 63));
+    copyEnd_ = copySource_ + copyLength_;
+    copyLength_ = 0;
+}
+
+void BinaryDiffEncoder::EmitCopy(std::size_t length, std::size_t sourceOffset) {
+    if (copyLength_ != 0 && copySource_ + copyLength_ == sourceOffset) {
+        copyLength_ += length;
+        return;
+    }
+    FlushCopy();
+    copySource_ = sourceOffset;
+    copyLength_ = length;
+}
+
+void BinaryDiffEncoder::Copy(std::size_t begin, std::size_t length, std::size_t sourceOffset) {
+    if (length == 0) {
+        return;
+    }
+    FlushLiteral(begin);
+    EmitCopy(length, sourceOffset);
+    literal_ = begin + length;
+}
+
+void BinaryDiffEncoder::Match(std::size_t begin, std::size_t end, std::size_t sourceBegin, std::size_t sourceEnd) {
+    if (end - begin < BinaryDiff::MIN_MATCH || sourceEnd - sourceBegin < BinaryDiff::MIN_MATCH) {
+        return;
+    }
+    Match(begin, end, SourceIndex(source_, sourceBegin, sourceEnd));
+}
+
+void BinaryDiffEncoder::Match(std::size_t begin, std::size_t end) {
+    if (end - begin < BinaryDiff::MIN_MATCH) {
+        return;
+    }
+    if (!fullIndex_) {
+        fullIndex_.reset(new SourceIndex(source_, 0, source_.size()));
+    }
+    Match(begin, end, *fullIndex_);
+}
+
+void BinaryDiffEncoder::Match(std::size_t begin, std::size_t end, const SourceIndex& index) {
+    const unsigned char* src = reinterpret_cast<const unsigned char*>(source_.data());
+    const unsigned char* tgt = reinterpret_cast<const unsigned char*>(target_.data());
+    const std::size_t window = BinaryDiff::MIN_MATCH;
+    std::uint64_t dropFactor = 1;
+    for (std::size_t i = 1; i < window; ++i) {
+        dropFactor *= ROLL_BASE;
+    }
+
+    std::size_t t = begin;
+    std::uint64_t hash = WindowHash(tgt + t);
+    while (t + window <= end) {
+        std::size_t s = 0;
+        if (index.Find(hash, tgt + t, s)) {
+            // 向后延长到这一段结束，再向前吃掉还没输出的插入内容
+            std::size_t length = window;
+            while (s + length < source_.size() && t + length < end && src[s + length] == tgt[t + length]) {
+                ++length;
+            }
+            while (t > literal_ && s > 0 && src[s - 1] == tgt[t - 1]) {
+                --s;
+                --t;
+                ++length;
+            }
+            FlushLiteral(t);
+            EmitCopy(length, s);
+            t += length;
+            literal_ = t;
+            if (t + window <= end) {
+                hash = WindowHash(tgt + t);
+            }
+            continue;
+        }
+        if (t + window < end) {
+            hash = (hash - tgt[t] * dropFactor) * ROLL_BASE + tgt[t + window];
+        }
+        ++t;
+    }
+}
+
+void BinaryDiffEncoder::Finish() {
+    FlushLiteral(target_.size());
+    FlushCopy();
+}
+
+void MakeBinaryDiff(std::string_view source, std::string_view target, std::string& out) {
+    BinaryDiffEncoder encoder(source, target, out);
+    encoder.Match(0, target.size());
+    encoder.Finish();
+}
+
+bool ApplyBinaryDiff(std::string_view source, std::string_view diff, std::string& target) {
+    target.clear();
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(diff.data());
+    const unsigned char* end = p + diff.size();
+    if (diff.size() < sizeof(MAGIC) + 1 || !std::equal(MAGIC, MAGIC + sizeof(MAGIC), diff.data())
+        || p[sizeof(MAGIC)] != BinaryDiff::VERSION) {
+        return false;
+    }
+    p += sizeof(MAGIC) + 1;
+
+    std::uint64_t sourceSize = 0;
+    std::uint64_t sourceHash = 0;
+    std::uint64_t targetSize = 0;
+    std::uint64_t targetHash = 0;
+    if (!GetVarint(p, end, sourceSize) || !GetUint64(p, end, sourceHash)
+        || !GetVarint(p, end, targetSize) || !GetUint64(p, end, targetHash)) {
+        return false;
+    }
+    if (sourceSize != source.size() || sourceHash != HashDataContent(source)) {
+        return false;
+    }
+
+    // 每条指令至少产生 1 字节，大小先按补丁长度粗略限制，挡住伪造的超大值
+    target.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(targetSize, source.size() + diff.size() * 64)));
+    std::uint64_t copyEnd = 0;
+    while (target.size() < targetSize) {
+        std::uint64_t header = 0;
+        if (!GetVarint(p, end, header)) {
+            return false;
+        }
+        std::uint64_t length = header >> 1;
+        if (length == 0 || length > targetSize - target.size()) {
+            return false;
+        }
+        if (header & 1) {
+            std::uint64_t zigzag = 0;
+            if (!GetVarint(p, end, zigzag)) {
+                return false;
+            }
+            std::int64_t delta = static_cast<std::int64_t>(zigzag >> 1) ^ -static_cast<std::int64_t>(zigzag & 1);
+            std::uint64_t offset = copyEnd + static_cast<std::uint64_t>(delta);
+            if (offset > source.size() || length > source.size() - offset) {
+                return false;
+            }
+            target.append(source.data() + offset, static_cast<std::size_t>(length));
+            copyEnd = offset + length;
+        }
+        else {
+            if (length > static_cast<std::uint64_t>(end - p)) {
+                return false;
+            }
+            target.append(reinterpret_cast<const char*>(p), static_cast<std::size_t>(length));
+            p += length;
+        }
+    }
+    return p == end && HashDataContent(target) == targetHash;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// 标准库
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// 两个文件版本之间的二进制补丁，格式接近 VCDIFF 的复制/插入指令（多字节整数都是小端）：
+//   "TDWD"  版本(1 字节)  旧文件大小(varint)  旧文件哈希(8 字节)  新文件大小(varint)  新文件哈希(8 字节)
+//   指令序列，直到拼出完整的新文件：
+//     varint (长度 << 1 | 1)  varint 源偏移差   从旧文件复制，偏移差是相对上一次复制结束位置的 zigzag 编码
+//     varint (长度 << 1)      长度个字节       直接插入
+// 哈希和清单使用同一种内容哈希，客户端打补丁前先确认本地文件就是旧版本，打完后再校验结果。
+// 旧文件按固定步长取样建立索引，新文件逐字节滚动查找，命中后向两边尽量延长，
+// 所以整段搬移、插入和删除都只产生很短的指令
+namespace BinaryDiff {
+    const std::uint8_t VERSION = 1;
+    // 短于这个长度的相同内容不会被当成复制
+    const std::size_t MIN_MATCH = 32;
+}
+
+// 按新文件的顺序逐段写出补丁，每一段可以指定到旧文件的哪个范围里找相同内容。
+// 知道文件内部结构的编码（见 MpqDiff.h）先按结构对齐，再把每一段交给它
+class BinaryDiffEncoder {
+public:
+    // 写出补丁头，out 原有的内容被清空
+    BinaryDiffEncoder(std::string_view source, std::string_view target, std::string& out);
+    ~BinaryDiffEncoder();
+
+    // 下面的调用必须按 target 中的位置依次进行，跳过的部分作为插入内容
+    // target 中 [begin, begin + length) 和 source 中从 sourceOffset 开始的内容相同
+    void Copy(std::size_t begin, std::size_t length, std::size_t sourceOffset);
+    // 在 source 的 [sourceBegin, sourceEnd) 里查找 target 中 [begin, end) 的相同内容
+    void Match(std::size_t begin, std::size_t end, std::size_t sourceBegin, std::size_t sourceEnd);
+    // 在整个 source 里查找，索引第一次用到时建立
+    void Match(std::size_t begin, std::size_t end);
+    // 剩下的部分作为插入内容，补丁完整
+    void Finish();
+
+private:
+    class SourceIndex;
+
+    void FlushLiteral(std::size_t end);
+    void FlushCopy();
+    void EmitCopy(std::size_t length, std::size_t sourceOffset);
+    void Match(std::size_t begin, std::size_t end, const SourceIndex& index);
+
+    std::string_view source_;
+    std::string_view target_;
+    std::string& out_;
+    std::unique_ptr<SourceIndex> fullIndex_;
+    std::size_t literal_;         // 还没输出的插入内容从这里开始
+    std::uint64_t copyEnd_;       // 上一次复制结束的位置
+    std::size_t copyLength_;      // 还没输出的复制，和下一次复制在两边都相连时合成一条
+    std::size_t copySource_;
+};
+
+// 计算把 source 变成 target 的补丁，写入 out
+void MakeBinaryDiff(std::string_view source, std::string_view target, std::string& out);
+
+// 用补丁从 source 还原出新文件；旧文件不对、补丁损坏或结果校验失败时返回 false
+bool ApplyBinaryDiff(std::string_view source, std::string_view diff, std::string& target);
@@ -0,0 +1,186 @@
+#include "BinaryManifest.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+    const char MAGIC[4] = { 'T', 'D', 'W', 'B' };
+
+    void PutVarint(std::string& out, std::uint64_t value) {
+        while (value >= 0x80) {
+            out += static_cast<char>((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
+    }
+
+    void PutUint64(std::string& out, std::uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            out += static_cast<char>((value >> (8 * i)) & 0xFF);
+        }
+    }
+
+    bool GetVarint(const unsigned char*& p, const unsigned char* end, std::uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && p < end; shift += 7) {
+            unsigned char byte = *p++;
+            value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 逐字节拼成小端整数，编译器会合并成一次不对齐读取
+    std::uint64_t GetUint64(const unsigned char* p) {
+        std::uint64_t value = 0;
+        for (int i = 0; i < 8; ++i) {
+            value |= static_cast<std::uint64_t>(p[i]) << (8 * i);
+        }
+        return value;
+    }
+}
+
+// BinaryManifestWriter 实现
+BinaryManifestWriter::BinaryManifestWriter(std::string& out, std::size_t count, bool wideHashes)
+    : out_(out)
+    , wideHashes_(wideHashes)
+{
+    out_.clear();
+    out_.append(MAGIC, sizeof(MAGIC));
+    out_ += static_cast<char>(BinaryManifest::VERSION);
+    out_ += static_cast<char>(wideHashes ? BinaryManifest::FLAG_WIDE_HASHES : 0);
+    PutVarint(out_, count);
+    hashes_.reserve(count * (wideHashes ? 16 : 8));
+}
+
+void BinaryManifestWriter::Add(std::string_view name, std::uint64_t hash, std::uint64_t hashHigh) {
+    std::size_t shared = 0;
+    std::size_t limit = std::min(name.size(), previous_.size());
+    while (shared < limit && name[shared] == previous_[shared]) {
+        ++shared;
+    }
+    PutVarint(out_, shared);
+    PutVarint(out_, name.size() - shared);
+    out_.append(name.data() + shared, name.size() - shared);
+    previous_ = name;
+
+    PutUint64(hashes_, hash);
+    if (wideHashes_) {
+        PutUint64(hashes_, hashHigh);
+    }
+}
+
+void BinaryManifestWriter::Finish() {
+    out_.append(hashes_);
+    hashes_.clear();
+}
+
+// BinaryManifestReader 实现
+BinaryManifestReader::BinaryManifestReader()
+    : hashes_(nullptr)
+    , hashBytes_(8)
+    , count_(0)
+{
+}
+
+bool BinaryManifestReader::Parse(std::string_view data) {
+    count_ = 0;
+    names_.clear();
+    offsets_.clear();
+
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data());
+    const unsigned char* end = p + data.size();
+    if (data.size() < sizeof(MAGIC) + 2 || !std::equal(MAGIC, MAGIC + sizeof(MAGIC), data.data())) {
+        return false;
+    }
+    p += sizeof(MAGIC);
+    std::uint8_t version = *p++;
+    std::uint8_t flags = *p++;
+    if (version != BinaryManifest::VERSION || (flags & ~BinaryManifest::FLAG_WIDE_HASHES) != 0) {
+        return false;
+    }
+    std::size_t hashBytes = (flags & BinaryManifest::FLAG_WIDE_HASHES) ? 16 : 8;
+
+    // 每个文件至少占两个长度字节和一个哈希，先挡住伪造的超大数量
+    std::uint64_t count = 0;
+    if (!GetVarint(p, end, count) || count > static_cast<std::uint64_t>(end - p) / (hashBytes + 2)) {
+        return false;
+    }
+
+    // 展开后的名字总长受清单大小限制，偏移量也不会超出 uint32
+    std::uint64_t maxNamesBytes = std::min<std::uint64_t>(
+        static_cast<std::uint64_t>(data.size()) * BinaryManifest::MAX_NAME_EXPANSION,
+        std::numeric_limits<std::uint32_t>::max());
+
+    offsets_.reserve(static_cast<std::size_t>(count) + 1);
+    offsets_.push_back(0);
+    std::size_t previousOffset = 0;
+    for (std::uint64_t i = 0; i < count; ++i) {
+        std::uint64_t shared = 0;
+        std::uint64_t rest = 0;
+        if (!GetVarint(p, end, shared) || !GetVarint(p, end, rest)) {
+            return false;
+        }
+        std::size_t previousLength = names_.size() - previousOffset;
+        if (shared > previousLength || rest > static_cast<std::uint64_t>(end - p)
+            || shared + rest > BinaryManifest::MAX_NAME_LENGTH || (i > 0 && rest == 0)
+            || names_.size() + shared + rest > maxNamesBytes) {
+            return false;
+        }
+        // 前缀从上一个名字复制，剩余部分接在后面
+        std::size_t offset = names_.size();
+        names_.append(names_, previousOffset, static_cast<std::size_t>(shared));
+        names_.append(reinterpret_cast<const char*>(p), static_cast<std::size_t>(rest));
+        p += rest;
+
+        // 共享前缀之后第一个不同的字节必须更大，整体才是严格升序
+        if (i > 0 && shared < previousLength
+            && static_cast<unsigned char>(names_[offset + shared])
+               <= static_cast<unsigned char>(names_[previousOffset + shared])) {
+            return false;
+        }
+        previousOffset = offset;
+        offsets_.push_back(static_cast<std::uint32_t>(names_.size()));
+    }
+
+    if (static_cast<std::uint64_t>(end - p) != count * hashBytes) {
+        return false;
+    }
+    hashes_ = p;
+    hashBytes_ = hashBytes;
+    count_ = static_cast<std::size_t>(count);
+    return true;
+}
+
+std::string_view BinaryManifestReader::Name(std::size_t index) const {
+    return std::string_view(names_.data() + offsets_[index], offsets_[index + 1] - offsets_[index]);
+}
+
+std::uint64_t BinaryManifestReader::Hash(std::size_t index) const {
+    return GetUint64(hashes_ + index * hashBytes_);
+}
+
+std::uint64_t BinaryManifestReader::HashHigh(std::size_t index) const {
+    return hashBytes_ == 16 ? GetUint64(hashes_ + index * hashBytes_ + 8) : 0;
+}
+
+bool BinaryManifestReader::Contains(std::string_view name) const {
+    std::size_t low = 0;
+    std::size_t high = count_;
+    while (low < high) {
+        std::size_t middle = low + (high - low) / 2;
+        int order = Name(middle).compare(name);
+        if (order == 0) {
+            return true;
+        }
+        if (order < 0) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+// 标准库
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 二进制文件清单，用于 CHECK_PATCHES_BIN 请求和 MANIFEST 推送（见 Protocol.h）。
+// 格式（多字节整数都是小端）：
+//   "TDWB"  版本(1 字节)  标志(1 字节)  文件数(varint)
+//   每个文件：与上一个名字相同的前缀长度(varint)  剩余长度(varint)  剩余部分
+//   哈希列：每个文件 8 字节，带 FLAG_WIDE_HASHES 时 16 字节（低 8 字节在前）
+// 名字必须严格升序，相邻名字共享的前缀只写一次；哈希单独成列，定长，解析时按下标直接读取。
+// FLAG_COMPRESSED 预留给整体压缩，当前版本不产生也不接受
+namespace BinaryManifest {
+    const std::uint8_t VERSION = 1;
+    const std::uint8_t FLAG_WIDE_HASHES = 1;
+    const std::uint8_t FLAG_COMPRESSED = 2;
+    // 名字是 Data 下的相对路径，比这更长的清单直接拒绝
+    const std::size_t MAX_NAME_LENGTH = 1024;
+    // 共享前缀让名字展开后比清单本身大，真实的目录结构到不了这个倍数；
+    // 伪造的清单每个名字只写两个长度字节就能复制出整段前缀，不设上限时几十 KB 能展开到上百 MB
+    const std::size_t MAX_NAME_EXPANSION = 32;
+}
+
+// 按名字升序逐个加入文件，Finish 后 out 里就是完整的清单。
+// 加入的名字在 Finish 之前必须一直有效
+class BinaryManifestWriter {
+public:
+    BinaryManifestWriter(std::string& out, std::size_t count, bool wideHashes = false);
+
+    void Add(std::string_view name, std::uint64_t hash, std::uint64_t hashHigh = 0);
+    void Finish();
+
+private:
+    std::string& out_;
+    std::string hashes_;
+    std::string_view previous_;
+    bool wideHashes_;
+};
+
+// 一次解析整个清单：名字展开到连续的缓冲区，哈希列原地读取，不拷贝。
+// 容器随对象复用，反复解析时不再分配内存；结果在下一次 Parse 之前以及 data 有效期间可用
+class BinaryManifestReader {
+public:
+    BinaryManifestReader();
+
+    // 格式不对、名字没有严格升序或数据被截断时返回 false
+    bool Parse(std::string_view data);
+
+    std::size_t Count() const { return count_; }
+    bool WideHashes() const { return hashBytes_ == 16; }
+    std::string_view Name(std::size_t index) const;
+    std::uint64_t Hash(std::size_t index) const;
+    // 16 字节哈希的高 8 字节，8 字节哈希时为 0
+    std::uint64_t HashHigh(std::size_t index) const;
+    // 二分查找名字，用来判断客户端是否有某个文件
+    bool Contains(std::string_view name) const;
+    // 复用的容器占用的字节数
+    std::size_t MemoryUsage() const { return names_.capacity() + offsets_.capacity() * sizeof(std::uint32_t); }
+
+private:
+    std::string names_;
+    std::vector<std::uint32_t> offsets_;   // 第 i 个名字在 names_ 中是 [offsets_[i], offsets_[i + 1])
+    const unsigned char* hashes_;
+    std::size_t hashBytes_;
+    std::size_t count_;
+};
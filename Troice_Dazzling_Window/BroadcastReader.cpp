@@ -0,0 +1,61 @@
+#include "BroadcastReader.h"
+
+std::string BroadcastReader::MakeKey(const std::string& path, std::size_t contentHash, std::uint64_t chunkIndex) {
+    std::string key;
+    key.reserve(path.size() + 48);
+    key.append(path);
+    key.push_back('|');
+    key.append(std::to_string(contentHash));
+    key.push_back('|');
+    key.append(std::to_string(chunkIndex));
+    return key;
+}
+
+bool BroadcastReader::Join(const std::string& path, std::size_t contentHash, std::uint64_t chunkIndex,
+                           Callback callback) {
+    std::string key = MakeKey(path, contentHash, chunkIndex);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = flights_.find(key);
+    if (it == flights_.end()) {
+        return false;
+    }
+    it->second.subscribers.push_back(std::move(callback));
+    fanOut_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool BroadcastReader::JoinOrLead(const std::string& path, std::size_t contentHash, std::uint64_t chunkIndex,
+                                 Callback callback) {
+    std::string key = MakeKey(path, contentHash, chunkIndex);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto result = flights_.try_emplace(std::move(key));
+    if (!result.second) {
+        result.first->second.subscribers.push_back(std::move(callback));
+        fanOut_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    flightCount_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+std::vector<BroadcastReader::Callback> BroadcastReader::Finish(const std::string& path, std::size_t contentHash,
+                                                               std::uint64_t chunkIndex) {
+    std::string key = MakeKey(path, contentHash, chunkIndex);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = flights_.find(key);
+    if (it == flights_.end()) {
+        return {};
+    }
+    std::vector<Callback> subscribers = std::move(it->second.subscribers);
+    flights_.erase(it);
+    return subscribers;
+}
+
+BroadcastReaderStats BroadcastReader::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    BroadcastReaderStats stats;
+    stats.flights = flightCount_.load(std::memory_order_relaxed);
+    stats.fanOut = fanOut_.load(std::memory_order_relaxed);
+    stats.inFlight = flights_.size();
+    return stats;
+}
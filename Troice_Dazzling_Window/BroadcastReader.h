@@ -0,0 +1,59 @@
+#pragma once
+
+// ASIO 相关定义
+#define ASIO_STANDALONE
+#define ASIO_NO_WIN32_LEAN_AND_MEAN
+#include <asio.hpp>
+#include "FileCache.h"
+
+// 标准库
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 单飞读取的运行统计
+struct BroadcastReaderStats {
+    std::uint64_t flights;        // 实际发起的读盘次数
+    std::uint64_t fanOut;         // 搭便车、省掉读盘的次数
+    std::size_t inFlight;         // 正在读的块数
+};
+
+// 同一文件同一块的读盘合并。
+// 第一个需要某块的会话负责读盘（领读者），读完前到达的会话只登记回调，
+// 领读者把结果转成引用计数的共享块后分发给所有订阅者，各自的 socket 从同一份内存发送。
+// 合并按块进行：发送跟不上的会话队列满时不会再请求下一块，
+// 等它回来时这一块已经读完，就由它自己读（或命中缓存），不会拖住其他会话。
+class BroadcastReader {
+public:
+    using Callback = std::function<void(const asio::error_code&, std::shared_ptr<const FileChunk>)>;
+
+    // 同一块已经在读时登记回调并返回 true；否则返回 false，不做任何登记
+    bool Join(const std::string& path, std::size_t contentHash, std::uint64_t chunkIndex, Callback callback);
+
+    // 同一块已经在读时登记回调并返回 true；否则把调用方登记为领读者并返回 false，
+    // 之后必须调用 Finish
+    bool JoinOrLead(const std::string& path, std::size_t contentHash, std::uint64_t chunkIndex, Callback callback);
+
+    // 领读者读完后调用，取出全部订阅者；此后同一块的新请求会重新发起读取
+    std::vector<Callback> Finish(const std::string& path, std::size_t contentHash, std::uint64_t chunkIndex);
+
+    BroadcastReaderStats GetStats() const;
+
+private:
+    struct Flight {
+        std::vector<Callback> subscribers;
+    };
+
+    static std::string MakeKey(const std::string& path, std::size_t contentHash, std::uint64_t chunkIndex);
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Flight> flights_;
+    std::atomic<std::uint64_t> flightCount_{ 0 };
+    std::atomic<std::uint64_t> fanOut_{ 0 };
+};
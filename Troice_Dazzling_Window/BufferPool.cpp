@@ -0,0 +1,252 @@
+#include "BufferPool.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+// windows.h 的 min/max 宏会吃掉 std::min 和 std::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace {
+    // 向系统申请内存的粒度，与常见的 2MB 大页对齐
+    const std::size_t ARENA_SIZE = 2 * 1024 * 1024;
+    // 每个线程最多缓存的空闲块数
+    const std::size_t THREAD_CACHE_SLABS = 4;
+
+    void* AllocatePages(std::size_t size, HugePageMode mode, bool& hugePages) {
+        hugePages = false;
+#ifdef _WIN32
+        void* pointer = nullptr;
+        if (mode == HugePageMode::Explicit) {
+            // 需要 SeLockMemoryPrivilege 权限，没有时 VirtualAlloc 会失败并退回普通页
+            SIZE_T largePage = GetLargePageMinimum();
+            if (largePage != 0 && size % largePage == 0) {
+                pointer = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+                hugePages = pointer != nullptr;
+            }
+        }
+        if (pointer == nullptr) {
+            pointer = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        }
+        return pointer;
+#else
+        void* pointer = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        if (mode == HugePageMode::Explicit) {
+            pointer = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            hugePages = pointer != MAP_FAILED;
+        }
+#endif
+        if (pointer == MAP_FAILED) {
+            pointer = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (pointer == MAP_FAILED) {
+                return nullptr;
+            }
+#ifdef MADV_HUGEPAGE
+            if (mode != HugePageMode::None) {
+                hugePages = madvise(pointer, size, MADV_HUGEPAGE) == 0;
+            }
+#endif
+        }
+        return pointer;
+#endif
+    }
+
+    void FreePages(void* pointer, std::size_t size) {
+#ifdef _WIN32
+        (void)size;
+        VirtualFree(pointer, 0, MEM_RELEASE);
+#else
+        munmap(pointer, size);
+#endif
+    }
+
+    // 线程退出时把缓存的空闲块还给全局列表
+    struct ThreadCache {
+        std::vector<char*> slabs;
+        ~ThreadCache();
+    };
+
+    thread_local ThreadCache t_cache;
+}
+
+// PooledBuffer 实现
+std::size_t PooledBuffer::Capacity() const {
+    return pool_ ? pool_->SlabSize() : 0;
+}
+
+void PooledBuffer::Reset() {
+    if (pool_ && data_) {
+        pool_->Release(data_);
+    }
+    pool_ = nullptr;
+    data_ = nullptr;
+    size_ = 0;
+}
+
+// BufferPool 实现
+BufferPool& BufferPool::Instance() {
+    static BufferPool instance;
+    return instance;
+}
+
+BufferPool::BufferPool()
+    : slabSize_(DEFAULT_SLAB_SIZE)
+    , maxOutstandingBytes_(DEFAULT_MAX_OUTSTANDING_BYTES)
+    , outstandingBytes_(0)
+    , reservedBytes_(0)
+    , waiterCount_(0)
+    , hugePageMode_(HugePageMode::Transparent)
+    , usingHugePages_(false)
+    , nextTicket_(0)
+{
+}
+
+BufferPool::~BufferPool() {
+    for (const auto& arena : arenas_) {
+        FreePages(arena.base, arena.size);
+    }
+}
+
+void BufferPool::Configure(std::size_t slabSize, std::size_t maxOutstandingBytes, HugePageMode hugePages) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!arenas_.empty()) {
+        // 已经有块借出，块大小不能再变，只更新上限
+        maxOutstandingBytes_ = maxOutstandingBytes;
+        return;
+    }
+
+    // 块大小按 4KB 对齐，且不超过一个区块
+    slabSize = std::max<std::size_t>(slabSize, 4096);
+    slabSize = (slabSize + 4095) & ~static_cast<std::size_t>(4095);
+    slabSize_ = std::min(slabSize, ARENA_SIZE);
+    maxOutstandingBytes_ = maxOutstandingBytes;
+    hugePageMode_ = hugePages;
+}
+
+void BufferPool::SetMaxOutstandingBytes(std::size_t maxOutstandingBytes) {
+    maxOutstandingBytes_ = maxOutstandingBytes;
+    ServeWaiters();
+}
+
+PooledBuffer BufferPool::TryAcquire() {
+    // 先占额度，超过上限时回退
+    std::size_t outstanding = outstandingBytes_.fetch_add(slabSize_) + slabSize_;
+    if (outstanding > maxOutstandingBytes_.load(std::memory_order_relaxed)) {
+        outstandingBytes_.fetch_sub(slabSize_);
+        return PooledBuffer();
+    }
+
+    if (!t_cache.slabs.empty()) {
+        char* slab = t_cache.slabs.back();
+        t_cache.slabs.pop_back();
+        return PooledBuffer(this, slab);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    char* slab = PopFreeSlab();
+    if (slab == nullptr) {
+        outstandingBytes_.fetch_sub(slabSize_);
+        return PooledBuffer();
+    }
+    return PooledBuffer(this, slab);
+}
+
+void BufferPool::AcquireAsync(std::function<void(PooledBuffer)> callback, std::size_t skew) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::uint64_t ticket = nextTicket_++;
+        waiters_.push_back(Waiter{ ticket + skew, ticket, std::move(callback) });
+        std::push_heap(waiters_.begin(), waiters_.end(), LaterWaiter());
+        waiterCount_.fetch_add(1);
+    }
+
+    // 登记期间可能刚好有块归还，补一次分配，避免等待者永远等不到
+    ServeWaiters();
+}
+
+char* BufferPool::PopFreeSlab() {
+    if (freeSlabs_.empty()) {
+        AllocateArena();
+        if (freeSlabs_.empty()) {
+            return nullptr;
+        }
+    }
+    char* slab = freeSlabs_.back();
+    freeSlabs_.pop_back();
+    return slab;
+}
+
+void BufferPool::AllocateArena() {
+    bool hugePages = false;
+    char* base = static_cast<char*>(AllocatePages(ARENA_SIZE, hugePageMode_, hugePages));
+    if (base == nullptr) {
+        return;
+    }
+
+    arenas_.push_back({ base, ARENA_SIZE, hugePages });
+    if (hugePages) {
+        usingHugePages_ = true;
+    }
+    reservedBytes_.fetch_add(ARENA_SIZE);
+
+    for (std::size_t offset = 0; offset + slabSize_ <= ARENA_SIZE; offset += slabSize_) {
+        freeSlabs_.push_back(base + offset);
+    }
+}
+
+void BufferPool::Release(char* slab) {
+    // 有人在等待时直接转交，借出额度不变
+    if (waiterCount_.load() != 0) {
+        std::function<void(PooledBuffer)> callback;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!waiters_.empty()) {
+                std::pop_heap(waiters_.begin(), waiters_.end(), LaterWaiter());
+                callback = std::move(waiters_.back().callback);
+                waiters_.pop_back();
+                waiterCount_.fetch_sub(1);
+            }
+        }
+        if (callback) {
+            callback(PooledBuffer(this, slab));
+            return;
+        }
+    }
+
+    if (t_cache.slabs.size() < THREAD_CACHE_SLABS) {
+        t_cache.slabs.push_back(slab);
+    }
+    else {
+        std::lock_guard<std::mutex> lock(mutex_);
+        freeSlabs_.push_back(slab);
+    }
+    outstandingBytes_.fetch_sub(slabSize_);
+}
+
+void BufferPool::ReleaseToGlobal(char* slab) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    freeSlabs_.push_back(slab);
+}
+
+void BufferPool::ServeWaiters() {
+    while (waiterCount_.load() != 0) {
+        PooledBuffer buffer = TryAcquire();
+        if (!buffer) {
+            return;
+        }
+        // 交给 Release 转交给排在最前的等待者；等待者已被别人服务时会正常归还
+        buffer.Reset();
+    }
+}
+
+ThreadCache::~ThreadCache() {
+    for (char* slab : slabs) {
+        BufferPool::Instance().ReleaseToGlobal(slab);
+    }
+}
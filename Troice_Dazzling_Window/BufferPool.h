@@ -0,0 +1,137 @@
+#pragma once
+
+// 标准库
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class BufferPool;
+
+// 从 BufferPool 借出的一块定长内存，析构时自动归还
+class PooledBuffer {
+public:
+    PooledBuffer() : pool_(nullptr), data_(nullptr), size_(0) {}
+    PooledBuffer(BufferPool* pool, char* data) : pool_(pool), data_(data), size_(0) {}
+    ~PooledBuffer() { Reset(); }
+
+    PooledBuffer(PooledBuffer&& other) noexcept
+        : pool_(other.pool_), data_(other.data_), size_(other.size_)
+    {
+        other.pool_ = nullptr;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept {
+        if (this != &other) {
+            Reset();
+            pool_ = other.pool_;
+            data_ = other.data_;
+            size_ = other.size_;
+            other.pool_ = nullptr;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+        return *this;
+    }
+
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    explicit operator bool() const { return data_ != nullptr; }
+
+    char* Data() const { return data_; }
+    std::size_t Size() const { return size_; }
+    void SetSize(std::size_t size) { size_ = size; }
+    std::size_t Capacity() const;
+
+    void Reset();
+
+private:
+    BufferPool* pool_;
+    char* data_;
+    std::size_t size_;
+};
+
+// 大页内存的使用方式
+enum class HugePageMode {
+    None,          // 普通页
+    Transparent,   // 透明大页（Linux madvise），Windows 上等同于 None
+    Explicit       // 显式大页（MAP_HUGETLB / MEM_LARGE_PAGES），失败时退回普通页
+};
+
+// 文件传输和收发使用的定长缓冲池。
+// 内存按 2MB 的区块向系统申请，再切成对齐的定长块；每个线程缓存少量空闲块，
+// 全局限制借出的总字节数，达到上限时 TryAcquire 返回空缓冲区，
+// 调用方通过 AcquireAsync 排队，有块归还时直接转交给排在最前的等待者（背压）。
+// 等待者按到达顺序加上各自的让步量排队：让步量小的（如快要传完的会话）可以插到
+// 后来者前面，但最多只被之后到达的 skew 个等待者超过，不会饿死。
+class BufferPool {
+public:
+    static const std::size_t DEFAULT_SLAB_SIZE = 256 * 1024;
+    static const std::size_t DEFAULT_MAX_OUTSTANDING_BYTES = 256 * 1024 * 1024;
+
+    // 进程内唯一的缓冲池，线程缓存里的指针因此在整个进程生命周期内有效
+    static BufferPool& Instance();
+
+    // 只能在第一次借出之前调用
+    void Configure(std::size_t slabSize, std::size_t maxOutstandingBytes, HugePageMode hugePages);
+    void SetMaxOutstandingBytes(std::size_t maxOutstandingBytes);
+
+    PooledBuffer TryAcquire();
+    // 在 TryAcquire 失败后调用。回调可能在任意线程上执行，调用方负责投递回自己的执行器；
+    // 不再需要时直接丢弃拿到的缓冲区即可，它会转交给下一个等待者。
+    // skew 为允许之后到达的等待者排到前面的个数，0 即先来先服务
+    void AcquireAsync(std::function<void(PooledBuffer)> callback, std::size_t skew = 0);
+
+    std::size_t SlabSize() const { return slabSize_; }
+    std::size_t OutstandingBytes() const { return outstandingBytes_.load(std::memory_order_relaxed); }
+    std::size_t ReservedBytes() const { return reservedBytes_.load(std::memory_order_relaxed); }
+    std::size_t MaxOutstandingBytes() const { return maxOutstandingBytes_.load(std::memory_order_relaxed); }
+    bool UsingHugePages() const { return usingHugePages_.load(std::memory_order_relaxed); }
+
+    // 线程退出时由线程缓存调用
+    void ReleaseToGlobal(char* slab);
+
+private:
+    friend class PooledBuffer;
+
+    BufferPool();
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    char* PopFreeSlab();       // 调用方需持有 mutex_
+    void AllocateArena();      // 调用方需持有 mutex_
+    void Release(char* slab);
+    void ServeWaiters();
+
+    std::size_t slabSize_;
+    std::atomic<std::size_t> maxOutstandingBytes_;
+    std::atomic<std::size_t> outstandingBytes_;
+    std::atomic<std::size_t> reservedBytes_;
+    std::atomic<std::size_t> waiterCount_;
+    HugePageMode hugePageMode_;
+    std::atomic<bool> usingHugePages_;
+
+    std::mutex mutex_;
+    std::vector<char*> freeSlabs_;
+    struct Arena { char* base; std::size_t size; bool hugePages; };
+    std::vector<Arena> arenas_;
+    // 等待者组成的最小堆，按 (order, ticket) 排序
+    struct Waiter {
+        std::uint64_t order;       // 到达序号加让步量
+        std::uint64_t ticket;      // 到达序号
+        std::function<void(PooledBuffer)> callback;
+    };
+    struct LaterWaiter {
+        bool operator()(const Waiter& a, const Waiter& b) const {
+            return a.order != b.order ? a.order > b.order : a.ticket > b.ticket;
+        }
+    };
+    std::vector<Waiter> waiters_;
+    std::uint64_t nextTicket_;
+};
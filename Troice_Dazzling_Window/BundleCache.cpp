@@ -0,0 +1,145 @@
+#include "BundleCache.h"
+
+#include <filesystem>
+#include <fstream>
+
+namespace {
+    // 记录“打过一次”的包数上限，超过后清空重新统计
+    const std::size_t MAX_SEEN_BUNDLES = 16 * 1024;
+}
+
+BundleCache::BundleCache(std::size_t budgetBytes)
+    : budgetBytes_(budgetBytes)
+    , residentBytes_(0)
+{
+}
+
+std::string BundleCache::MakeKey(const std::vector<BundleMember>& members) {
+    std::string key;
+    for (const auto& member : members) {
+        key.append(member.name).append(1, '\0').append(member.path).append(1, '\0')
+           .append(std::to_string(member.contentHash)).append(1, '\0');
+    }
+    return key;
+}
+
+void BundleCache::AsyncGet(DiskIoPool& pool, std::vector<BundleMember>&& members, Callback callback) {
+    std::string key = MakeKey(members);
+    std::shared_ptr<const FileBundle> cached;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it == entries_.end()) {
+            entries_[key].waiters.push_back(std::move(callback));
+        }
+        else if (!it->second.bundle) {
+            // 别的会话正在打同一个包
+            it->second.waiters.push_back(std::move(callback));
+            shared_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else {
+            lru_.splice(lru_.begin(), lru_, it->second.lru);
+            cached = it->second.bundle;
+        }
+    }
+    if (cached) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        callback(std::move(cached));
+        return;
+    }
+
+    builds_.fetch_add(1, std::memory_order_relaxed);
+    // 磁盘队列满时按一个文件都读不出来处理，等着的会话跳过这个包
+    if (!pool.Post([this, key, members = std::move(members)]() { Finish(key, Build(members)); })) {
+        Finish(key, nullptr);
+    }
+}
+
+std::shared_ptr<const FileBundle> BundleCache::Build(const std::vector<BundleMember>& members) {
+    // 先取大小一次分配好，再把各个文件直接读到各自的位置
+    std::vector<std::uint64_t> sizes(members.size(), 0);
+    std::uint64_t total = 0;
+    for (std::size_t i = 0; i < members.size(); ++i) {
+        std::error_code error;
+        std::uintmax_t size = std::filesystem::file_size(members[i].path, error);
+        if (!error) {
+            sizes[i] = size;
+            total += size;
+        }
+    }
+
+    auto content = std::make_shared<FileChunk>();
+    content->data.reset(new char[total == 0 ? 1 : static_cast<std::size_t>(total)]);
+    std::string entries;
+    std::size_t count = 0;
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < members.size(); ++i) {
+        std::ifstream file(members[i].path, std::ios::binary);
+        if (!file.is_open()) {
+            continue;
+        }
+        // 取大小之后文件变短时按实际读到的长度记入目录
+        file.read(content->data.get() + offset, static_cast<std::streamsize>(sizes[i]));
+        std::size_t length = static_cast<std::size_t>(file.gcount());
+        offset += length;
+        ++count;
+        entries.append(members[i].name).append("|").append(std::to_string(length)).append("|");
+    }
+    if (count == 0) {
+        return nullptr;
+    }
+    content->size = offset;
+
+    auto bundle = std::make_shared<FileBundle>();
+    bundle->toc = std::to_string(count) + "|" + std::to_string(offset) + "|" + entries;
+    bundle->content = std::move(content);
+    return bundle;
+}
+
+void BundleCache::Finish(const std::string& key, std::shared_ptr<const FileBundle> bundle) {
+    std::vector<Callback> waiters;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        waiters.swap(it->second.waiters);
+
+        // 第二次打同一个包或者打包时就有人在等才缓存，一次性的更新不占缓存
+        std::size_t keyHash = std::hash<std::string>()(key);
+        bool hot = waiters.size() > 1 || seen_.erase(keyHash) != 0;
+        if (bundle && hot && bundle->content->size <= budgetBytes_) {
+            lru_.push_front(key);
+            it->second.bundle = bundle;
+            it->second.lru = lru_.begin();
+            residentBytes_ += bundle->content->size;
+            EvictToBudget();
+        }
+        else {
+            entries_.erase(it);
+            if (bundle && !hot) {
+                if (seen_.size() >= MAX_SEEN_BUNDLES) {
+                    seen_.clear();
+                }
+                seen_.insert(keyHash);
+            }
+        }
+    }
+    for (auto& waiter : waiters) {
+        waiter(bundle);
+    }
+}
+
+void BundleCache::EvictToBudget() {
+    while (residentBytes_ > budgetBytes_ && !lru_.empty()) {
+        auto it = entries_.find(lru_.back());
+        residentBytes_ -= it->second.bundle->content->size;
+        entries_.erase(it);
+        lru_.pop_back();
+    }
+}
+
+BundleCacheStats BundleCache::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return { hits_.load(std::memory_order_relaxed), builds_.load(std::memory_order_relaxed),
+             shared_.load(std::memory_order_relaxed), residentBytes_, lru_.size() };
+}
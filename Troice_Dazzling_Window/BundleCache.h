@@ -0,0 +1,78 @@
+#pragma once
+
+#include "DiskIoPool.h"
+#include "FileCache.h"
+
+// 标准库
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// 打包发送的一个小文件
+struct BundleMember {
+    std::string name;           // 协议里的文件名
+    std::string path;           // 读取的文件
+    std::size_t contentHash;
+};
+
+// 打好的包：目录和按目录顺序拼在一起的文件内容
+struct FileBundle {
+    std::string toc;            // <文件数>|<总字节数>|<文件名>|<大小>|...|，读不出来的文件不在其中
+    std::shared_ptr<const FileChunk> content;
+};
+
+// 小文件包缓存的运行统计
+struct BundleCacheStats {
+    std::uint64_t hits;
+    std::uint64_t builds;         // 实际读盘打包的次数
+    std::uint64_t shared;         // 等别人打同一个包、省掉打包的次数
+    std::size_t residentBytes;
+    std::size_t bundleCount;
+};
+
+// 小文件的包。几千个小文件逐个打开、读取、发送，每个都要一次文件打开和一轮写完成，
+// 打成一个包后只读一次目录、发一条消息。从同一个旧版本升级的客户端要的包完全相同：
+// 同一个包同时只打一次，再次被要到或者打包时就有人在等的包按 LRU 留在内存里，总大小不超过预算。
+// 包以全部成员的文件名、路径和内容哈希为键，文件内容变化后旧包自然不再命中
+class BundleCache {
+public:
+    using Callback = std::function<void(std::shared_ptr<const FileBundle>)>;
+
+    explicit BundleCache(std::size_t budgetBytes);
+
+    // 命中缓存时在调用线程上直接调用 callback，否则在 pool 的线程上打包后调用；一个文件都读不出来时结果为空
+    void AsyncGet(DiskIoPool& pool, std::vector<BundleMember>&& members, Callback callback);
+
+    BundleCacheStats GetStats() const;
+
+private:
+    struct Entry {
+        std::shared_ptr<const FileBundle> bundle;   // 为空时还在打包
+        std::vector<Callback> waiters;
+        std::list<std::string>::iterator lru;
+    };
+
+    static std::string MakeKey(const std::vector<BundleMember>& members);
+    static std::shared_ptr<const FileBundle> Build(const std::vector<BundleMember>& members);
+    void Finish(const std::string& key, std::shared_ptr<const FileBundle> bundle);
+    void EvictToBudget();   // 调用方需持有 mutex_
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;   // 缓存的和正在打的包
+    std::list<std::string> lru_;                       // 缓存的包，头部最近使用
+    std::unordered_set<std::size_t> seen_;             // 打过一次、没有缓存的包的键哈希
+    std::size_t budgetBytes_;
+    std::size_t residentBytes_;
+
+    std::atomic<std::uint64_t> hits_{ 0 };
+    std::atomic<std::uint64_t> builds_{ 0 };
+    std::atomic<std::uint64_t> shared_{ 0 };
+};
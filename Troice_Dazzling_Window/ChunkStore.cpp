@@ -0,0 +1,208 @@
+#include "ChunkStore.h"
+#include "ManifestFile.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <fstream>
+
+namespace {
+    const std::uint64_t FNV_OFFSET = 0xCBF29CE484222325ULL;
+    const std::uint64_t FNV_PRIME = 0x100000001B3ULL;
+    // 高 18 位和高 14 位：块长到平均值之前更难切开，之后更容易，块长集中在平均值附近
+    const std::uint64_t MASK_SMALL = ~0ULL << (64 - 18);
+    const std::uint64_t MASK_LARGE = ~0ULL << (64 - 14);
+    // 读文件的单位，是 8KB 的整数倍，和内容哈希的分块对齐
+    const std::size_t READ_SIZE = 4 * 1024 * 1024;
+
+    const std::array<std::uint64_t, 256>& GearTable() {
+        static const std::array<std::uint64_t, 256> table = []() {
+            std::array<std::uint64_t, 256> result{};
+            std::uint64_t state = 0;
+            for (auto& value : result) {
+                state += 0x9E3779B97F4A7C15ULL;
+                std::uint64_t z = state;
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                value = z ^ (z >> 31);
+            }
+            return result;
+        }();
+        return table;
+    }
+}
+
+std::size_t FindChunkBoundary(std::string_view data) {
+    if (data.size() <= ContentChunking::MIN_SIZE) {
+        return data.size();
+    }
+    const auto& gear = GearTable();
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data());
+    std::size_t end = std::min(data.size(), ContentChunking::MAX_SIZE);
+    std::size_t normal = std::min(end, ContentChunking::AVERAGE_SIZE);
+    std::uint64_t fingerprint = 0;
+    std::size_t i = ContentChunking::MIN_SIZE;
+    for (; i < normal; ++i) {
+        fingerprint = (fingerprint << 1) + gear[p[i]];
+        if ((fingerprint & MASK_SMALL) == 0) {
+            return i + 1;
+        }
+    }
+    for (; i < end; ++i) {
+        fingerprint = (fingerprint << 1) + gear[p[i]];
+        if ((fingerprint & MASK_LARGE) == 0) {
+            return i + 1;
+        }
+    }
+    return end;
+}
+
+std::uint64_t ChunkId(std::string_view chunk) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(chunk.data());
+    std::uint64_t hash = FNV_OFFSET;
+    std::size_t i = 0;
+    for (; i + 8 <= chunk.size(); i += 8) {
+        std::uint64_t word = 0;
+        for (int b = 7; b >= 0; --b) {
+            word = (word << 8) | p[i + b];
+        }
+        hash = (hash ^ word) * FNV_PRIME;
+    }
+    for (; i < chunk.size(); ++i) {
+        hash = (hash ^ p[i]) * FNV_PRIME;
+    }
+    return (hash ^ chunk.size()) * FNV_PRIME;
+}
+
+void SplitIntoChunks(std::string_view data, std::vector<ChunkRef>& chunks) {
+    chunks.clear();
+    while (!data.empty()) {
+        std::size_t length = FindChunkBoundary(data);
+        chunks.push_back({ ChunkId(data.substr(0, length)), static_cast<std::uint32_t>(length) });
+        data.remove_prefix(length);
+    }
+}
+
+// ChunkStore 实现
+ChunkStore::ChunkStore(std::filesystem::path root)
+    : root_(std::move(root))
+{
+}
+
+std::string ChunkStore::ChunkName(std::uint64_t id) {
+    static const char digits[] = "0123456789abcdef";
+    std::string text(16, '0');
+    for (int i = 15; i >= 0; --i) {
+        text[i] = digits[id & 0xF];
+        id >>= 4;
+    }
+    return text;
+}
+
+std::filesystem::path ChunkStore::ChunkPath(std::uint64_t id) const {
+    std::string name = ChunkName(id);
+    return root_ / name.substr(0, 2) / name;
+}
+
+bool ChunkStore::Put(const ChunkRef& chunk, std::string_view data) {
+    std::filesystem::path path = ChunkPath(chunk.id);
+    std::error_code error;
+    std::uintmax_t existing = std::filesystem::file_size(path, error);
+    if (!error) {
+        // 编号相同而大小不同只会是编号冲突或者块文件损坏，这个版本不存
+        return existing == chunk.size;
+    }
+    std::filesystem::create_directories(path.parent_path(), error);
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!file) {
+            return false;
+        }
+    }
+    std::filesystem::rename(temporary, path, error);
+    return !error;
+}
+
+bool ChunkStore::StoreFile(const std::filesystem::path& file, std::size_t expectedHash, std::vector<ChunkRef>& chunks,
+                           const std::atomic<bool>* stop) {
+    chunks.clear();
+    std::ifstream input(file, std::ios::binary);
+    if (!input.is_open()) {
+        return false;
+    }
+
+    // 攒够一个最大块再切，切点和一次读入整个文件时相同
+    std::string pending;
+    std::size_t hash = 0;
+    for (;;) {
+        if (stop && *stop) {
+            return false;
+        }
+        std::size_t previous = pending.size();
+        pending.resize(previous + READ_SIZE);
+        input.read(&pending[previous], static_cast<std::streamsize>(READ_SIZE));
+        std::size_t count = static_cast<std::size_t>(input.gcount());
+        pending.resize(previous + count);
+        hash ^= HashDataContent(std::string_view(pending).substr(previous));
+        bool finished = count < READ_SIZE;
+
+        std::size_t start = 0;
+        while (pending.size() - start >= ContentChunking::MAX_SIZE || (finished && start < pending.size())) {
+            std::string_view rest = std::string_view(pending).substr(start);
+            std::size_t length = FindChunkBoundary(rest);
+            ChunkRef chunk{ ChunkId(rest.substr(0, length)), static_cast<std::uint32_t>(length) };
+            if (!Put(chunk, rest.substr(0, length))) {
+                return false;
+            }
+            chunks.push_back(chunk);
+            start += length;
+        }
+        pending.erase(0, start);
+        if (finished) {
+            break;
+        }
+    }
+    return !input.bad() && hash == expectedHash;
+}
+
+bool ChunkStore::Assemble(const std::vector<ChunkRef>& chunks, std::string& data) const {
+    data.clear();
+    for (const auto& chunk : chunks) {
+        std::ifstream file(ChunkPath(chunk.id), std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::size_t previous = data.size();
+        data.resize(previous + chunk.size);
+        file.read(&data[previous], chunk.size);
+        if (static_cast<std::size_t>(file.gcount()) != chunk.size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ChunkStore::RemoveUnreferenced(const std::vector<std::uint64_t>& keep) const {
+    namespace fs = std::filesystem;
+    std::error_code error;
+    for (fs::recursive_directory_iterator it(root_, error), end; !error && it != end; it.increment(error)) {
+        if (!it->is_regular_file(error)) {
+            continue;
+        }
+        std::string name = it->path().filename().string();
+        std::uint64_t id = 0;
+        auto [ptr, ec] = std::from_chars(name.data(), name.data() + name.size(), id, 16);
+        bool referenced = ec == std::errc() && ptr == name.data() + name.size() && name.size() == 16
+                       && std::binary_search(keep.begin(), keep.end(), id);
+        if (!referenced) {
+            std::error_code ignored;
+            fs::remove(it->path(), ignored);
+        }
+    }
+}
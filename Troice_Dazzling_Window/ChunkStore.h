@@ -0,0 +1,57 @@
+#pragma once
+
+// 标准库
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 按内容切块（FastCDC），客户端要用完全相同的规则才能报告自己已有的块：
+//   GEAR[i]   种子为 0 的 SplitMix64 的第 i + 1 个输出，i = 0..255
+//   指纹      fp = (fp << 1) + GEAR[字节]，从块起点后第 MIN_SIZE 个字节开始累加
+//   切点      块长不到 AVERAGE_SIZE 时 fp 的高 18 位全为 0 处切开，之后放宽到高 14 位，
+//             到 MAX_SIZE 强制切开；文件末尾剩下的部分单独成块
+//   块编号    块内容按 8 字节小端整数做 FNV-1a（64 位），不足 8 字节的尾部逐字节，最后再混入块长
+// 插入或删除内容只影响附近的一两个块，同一文件的相邻版本、不同文件里相同的片段切出相同的块
+namespace ContentChunking {
+    const std::size_t MIN_SIZE = 16 * 1024;
+    const std::size_t AVERAGE_SIZE = 64 * 1024;
+    const std::size_t MAX_SIZE = 256 * 1024;
+}
+
+struct ChunkRef {
+    std::uint64_t id;
+    std::uint32_t size;
+};
+
+// data 开头第一个块的长度；data 不是文件的最后一段时至少要有 MAX_SIZE 字节，切点才和整个文件切块时一致
+std::size_t FindChunkBoundary(std::string_view data);
+std::uint64_t ChunkId(std::string_view chunk);
+// 把整段内容切块
+void SplitIntoChunks(std::string_view data, std::vector<ChunkRef>& chunks);
+
+// 块按编号存成单独的文件，同样内容只存一份：<root>/<编号前两位>/<16 位十六进制编号>
+class ChunkStore {
+public:
+    explicit ChunkStore(std::filesystem::path root);
+
+    // 读文件并切块存入，chunks 收到块列表。读出的内容哈希和 expectedHash 不同
+    // （读的时候文件被改了）、写入失败或 stop 置位时返回 false
+    bool StoreFile(const std::filesystem::path& file, std::size_t expectedHash, std::vector<ChunkRef>& chunks,
+                   const std::atomic<bool>* stop);
+    // 按块列表拼出文件内容，缺块时返回 false
+    bool Assemble(const std::vector<ChunkRef>& chunks, std::string& data) const;
+    // 删除 keep（已排序）之外的块
+    void RemoveUnreferenced(const std::vector<std::uint64_t>& keep) const;
+
+    std::filesystem::path ChunkPath(std::uint64_t id) const;
+    static std::string ChunkName(std::uint64_t id);
+
+private:
+    bool Put(const ChunkRef& chunk, std::string_view data);
+
+    std::filesystem::path root_;
+};
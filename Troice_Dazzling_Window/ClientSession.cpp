@@ -0,0 +1,1296 @@
+#include "ClientSession.h"
+#include "WindowManager.h"
+
+#include <algorithm>
+#include <charconv>
+#include <iterator>
+
+namespace {
+    const std::string_view END_OF_MESSAGE = "<END_OF_MESSAGE>";
+
+    // async_read_until 的字符串重载会把分隔符拷进一个 std::string，
+    // 改用匹配函数对象，读循环里不再为分隔符分配内存
+    struct MessageEndMatcher {
+        template <typename Iterator>
+        std::pair<Iterator, bool> operator()(Iterator begin, Iterator end) const {
+            Iterator it = std::search(begin, end, END_OF_MESSAGE.begin(), END_OF_MESSAGE.end());
+            if (it != end) {
+                return std::make_pair(it + END_OF_MESSAGE.size(), true);
+            }
+            // 末尾可能是结束标记的前半段，下次从那里继续查找
+            std::size_t length = end - begin;
+            if (length < END_OF_MESSAGE.size()) {
+                return std::make_pair(begin, false);
+            }
+            return std::make_pair(end - (END_OF_MESSAGE.size() - 1), false);
+        }
+    };
+
+    // 指向 writeBuffers_ 的轻量缓冲区序列。
+    // 直接把 std::vector 交给 async_write 时 asio 会复制整个 vector，这里只复制两个指针
+    struct ConstBufferView {
+        using value_type = asio::const_buffer;
+        using const_iterator = const asio::const_buffer*;
+
+        const asio::const_buffer* first;
+        const asio::const_buffer* last;
+
+        const_iterator begin() const { return first; }
+        const_iterator end() const { return last; }
+    };
+
+    // 超过该容量的响应缓冲区（如整文件消息）不回收，避免长期占用内存
+    const std::size_t MAX_RECYCLED_BUFFER_SIZE = 64 * 1024;
+    const std::size_t MAX_SPARE_BUFFERS = 8;
+
+    // 等待可读的操作很小，空闲会话只为它保留这么多处理器内存
+    const std::size_t WAIT_HANDLER_BYTES = 256;
+
+    // 每个会话最多同时排队的文件数据块，一块在写的同时读下一块
+    const std::size_t MAX_QUEUED_CHUNKS = 2;
+
+    // 等缓冲块时最多让之后到达的多少个会话先拿；剩余越少让得越少，快传完的会话先完成
+    const std::size_t MAX_BUFFER_WAIT_SKEW = 64;
+
+    const std::string END_CONTENT = "|<END_CONTENT>|<END_OF_MESSAGE>";
+
+    // 每个会话为下一个文件最多预读的数据量，以及提示内核预读的范围
+    const std::uint64_t PREFETCH_AHEAD_BYTES = 2 * 1024 * 1024;
+    const std::uint64_t PREFETCH_HINT_BYTES = 16 * 1024 * 1024;
+
+    // 打包发送的小文件上限，以及一个包最多的字节数和文件数
+    const std::uint64_t BUNDLE_FILE_BYTES = 64 * 1024;
+    const std::uint64_t MAX_BUNDLE_BYTES = 1024 * 1024;
+    const std::size_t MAX_BUNDLE_FILES = 256;
+
+    // 分帧模式下每次写入最多带的数据帧字节数，控制帧最多等这么多数据
+    const std::size_t STREAM_WRITE_BATCH_BYTES = 256 * 1024;
+
+    // 缓冲池的块转成共享块，多个帧或多个会话引用同一份内存
+    std::shared_ptr<const FileChunk> ShareSlab(PooledBuffer&& slab) {
+        auto shared = std::make_shared<FileChunk>();
+        shared->size = slab.Size();
+        shared->slab = std::move(slab);
+        return shared;
+    }
+
+    void PutUint32(char* out, std::uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+        }
+    }
+
+    const std::string& TransferCommand(ClientSession::TransferKind kind) {
+        switch (kind) {
+        case ClientSession::TransferKind::Patch:
+            return Command::PATCH_FILES;
+        case ClientSession::TransferKind::Chunk:
+            return Command::CHUNK_DATA;
+        case ClientSession::TransferKind::Bundle:
+            return Command::BUNDLE_FILES;
+        default:
+            return Command::UPDATE_FILES;
+        }
+    }
+
+    // 去掉可选的 REQ|<编号>| 前缀后命令开始的位置
+    std::size_t CommandStart(const std::string& command) {
+        if (command.compare(0, Command::REQUEST.size(), Command::REQUEST) == 0) {
+            std::size_t end = command.find('|', Command::REQUEST.size());
+            if (end != std::string::npos) {
+                return end + 1;
+            }
+        }
+        return 0;
+    }
+
+    // 会发送文件或要等哈希的命令，分帧模式下也要排队
+    bool IsTransferCommand(const std::string& command) {
+        std::size_t start = CommandStart(command);
+        for (const std::string* header : { &Command::CHECK_PATCHES, &Command::CHECK_PATCHES_BIN,
+                                           &Command::SYNC, &Command::GET_MANIFEST }) {
+            if (command.compare(start, header->size(), *header) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 一次请求最多携带的二进制清单或块编号
+    const std::size_t MAX_BINARY_PAYLOAD = 64 * 1024 * 1024;
+
+    // CHECK_PATCHES_BIN|<字节数>| 和 HAVE_CHUNKS|<字节数>| 后面跟着的负载长度，其他命令为 0；长度无效时返回 false
+    bool GetBinaryPayloadSize(const std::string& command, std::size_t& payload) {
+        payload = 0;
+        std::size_t start = CommandStart(command);
+        const std::string* header = nullptr;
+        for (const std::string* candidate : { &Command::CHECK_PATCHES_BIN, &Command::HAVE_CHUNKS }) {
+            if (command.compare(start, candidate->size(), *candidate) == 0) {
+                header = candidate;
+            }
+        }
+        if (header == nullptr) {
+            return true;
+        }
+        const char* begin = command.data() + start + header->size();
+        const char* end = command.data() + command.size();
+        auto [ptr, ec] = std::from_chars(begin, end, payload);
+        return ec == std::errc() && ptr != end && *ptr == '|' && payload <= MAX_BINARY_PAYLOAD;
+    }
+}
+
+namespace asio {
+    template <> struct is_match_condition<MessageEndMatcher> : public std::true_type {};
+}
+
+ClientSession::ClientSession(TcpServer& server, asio::ip::tcp::socket socket)
+    : server_(server)
+    , socket_(std::move(socket))
+    , lastActivity_(std::chrono::steady_clock::now())
+    , waitHandlerMemory_(WAIT_HANDLER_BYTES)
+    , writing_(false)
+    , transferIndex_(0)
+    , transferHash_(0)
+    , transferSize_(0)
+    , transferOffset_(0)
+    , transferActive_(false)
+    , diskOpInFlight_(false)
+    , queuedChunks_(0)
+    , waitingForBuffer_(false)
+    , prefetch_()
+    , cancelled_(false)
+    , requestActive_(false)
+    , inCommand_(false)
+    , streamsEnabled_(false)
+    , nextStreamId_(1)
+    , currentStream_(0)
+    , currentPriority_(0)
+    , flowControl_(false)
+    , sendCredit_(0)
+    , diffsEnabled_(false)
+    , chunksEnabled_(false)
+    , bundlesEnabled_(false)
+{
+}
+
+ClientSession::~ClientSession() {
+    // 会话可能在 TcpServer 之后销毁，这里只碰进程级的预算
+    PrefetchBudget::Instance().Release(prefetch_.reservedBytes);
+}
+
+void ClientSession::Start() {
+    DoRead();
+}
+
+void ClientSession::Close() {
+    CancelTransfers();
+    if (socket_.is_open()) {
+        asio::error_code ec;
+        socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+        socket_.close(ec);
+    }
+}
+
+void ClientSession::DoRead() {
+    if (receiveBuffer_ && receiveBuffer_->size() != 0) {
+        ReadMessage();
+        return;
+    }
+
+    // 没有半截消息时把接收缓冲区还给服务器，等 socket 可读后再借一个来读
+    server_.RecycleReceiveBuffer(std::move(receiveBuffer_));
+    socket_.async_wait(asio::socket_base::wait_read,
+        MakeCustomAllocHandler(waitHandlerMemory_,
+            [self = shared_from_this()](const asio::error_code& error) {
+                self->OnReadable(error);
+            }));
+}
+
+void ClientSession::OnReadable(const asio::error_code& error) {
+    if (error) {
+        Close();
+        server_.RemoveSession(shared_from_this());
+        return;
+    }
+    lastActivity_ = std::chrono::steady_clock::now();
+    receiveBuffer_ = server_.AcquireReceiveBuffer();
+    ReadMessage();
+}
+
+void ClientSession::ReadMessage() {
+    asio::async_read_until(socket_, *receiveBuffer_, MessageEndMatcher(),
+        MakeCustomAllocHandler(readHandlerMemory_,
+            [self = shared_from_this()](const asio::error_code& error, std::size_t bytes_transferred) {
+                self->OnRead(error, bytes_transferred);
+            }));
+}
+
+void ClientSession::OnRead(const asio::error_code& error, std::size_t bytes_transferred) {
+    if (error) {
+        // 客户端断开连接或读取失败，剩下的文件不必再读再发
+        Close();
+        server_.RemoveSession(shared_from_this());
+        return;
+    }
+
+    // async_read_until 保证结束标记恰好位于已读数据的末尾
+    if (TakeMessage(bytes_transferred)) {
+        ProcessBufferedMessages();
+    }
+}
+
+bool ClientSession::TakeMessage(std::size_t length) {
+    // 直接拷到复用的命令缓冲区
+    const char* begin = static_cast<const char*>(receiveBuffer_->data().data());
+    command_.assign(begin, length - END_OF_MESSAGE.size());
+    receiveBuffer_->consume(length);
+
+    std::size_t payload = 0;
+    if (!GetBinaryPayloadSize(command_, payload)) {
+        // 负载长度不对就无法找到下一条消息的开头，只能断开
+        Close();
+        server_.RemoveSession(shared_from_this());
+        return false;
+    }
+    if (payload > receiveBuffer_->size()) {
+        ReadPayload(payload);
+        return false;
+    }
+    // 负载接在命令后面一起交给服务器
+    command_.append(static_cast<const char*>(receiveBuffer_->data().data()), payload);
+    receiveBuffer_->consume(payload);
+    DispatchCommand();
+    return true;
+}
+
+void ClientSession::ReadPayload(std::size_t payload) {
+    asio::async_read(socket_, *receiveBuffer_, asio::transfer_at_least(payload - receiveBuffer_->size()),
+        MakeCustomAllocHandler(readHandlerMemory_,
+            [self = shared_from_this(), payload](const asio::error_code& error, std::size_t) {
+                self->OnPayloadRead(error, payload);
+            }));
+}
+
+void ClientSession::OnPayloadRead(const asio::error_code& error, std::size_t payload) {
+    if (error) {
+        Close();
+        server_.RemoveSession(shared_from_this());
+        return;
+    }
+    lastActivity_ = std::chrono::steady_clock::now();
+    command_.append(static_cast<const char*>(receiveBuffer_->data().data()), payload);
+    receiveBuffer_->consume(payload);
+    DispatchCommand();
+    ProcessBufferedMessages();
+}
+
+void ClientSession::ProcessBufferedMessages() {
+    // 客户端连发的命令已经在缓冲区里时直接处理，不再多走一轮异步读
+    while (!cancelled_) {
+        std::string_view rest(static_cast<const char*>(receiveBuffer_->data().data()), receiveBuffer_->size());
+        std::size_t end = rest.find(END_OF_MESSAGE);
+        if (end == std::string_view::npos) {
+            break;
+        }
+        if (!TakeMessage(end + END_OF_MESSAGE.size())) {
+            return;
+        }
+    }
+
+    // 继续读下一个消息
+    DoRead();
+}
+
+void ClientSession::DispatchCommand() {
+    if (requestActive_ && streamsEnabled_ && !IsTransferCommand(command_)) {
+        RunSideCommand();
+        return;
+    }
+    if (requestActive_) {
+        // 前一个请求还在进行，命令排队等它结束，保证响应顺序
+        std::string command = AcquireBuffer();
+        command.assign(command_);
+        deferredCommands_.push_back(std::move(command));
+        return;
+    }
+    StartRequest(command_);
+    CompleteRequestIfIdle();
+}
+
+void ClientSession::StartRequest(std::string& command) {
+    requestActive_ = true;
+    ParseRequestTag(command);
+
+    inCommand_ = true;
+    server_.HandleCommand(shared_from_this(), command);
+    inCommand_ = false;
+}
+
+void ClientSession::ParseRequestTag(std::string& command) {
+    // 去掉可选的 REQ|<编号>| 前缀，之后的响应都带上它
+    requestTag_.clear();
+    if (command.compare(0, Command::REQUEST.size(), Command::REQUEST) == 0) {
+        std::size_t end = command.find('|', Command::REQUEST.size());
+        if (end != std::string::npos && end > Command::REQUEST.size()) {
+            requestTag_.assign(command, 0, end + 1);
+            command.erase(0, end + 1);
+        }
+    }
+}
+
+void ClientSession::RunSideCommand() {
+    // 控制流上的响应各自带编号，和正在进行的传输请求互不影响
+    std::string activeTag;
+    activeTag.swap(requestTag_);
+    ParseRequestTag(command_);
+
+    bool wasInCommand = inCommand_;
+    inCommand_ = true;
+    server_.HandleCommand(shared_from_this(), command_);
+    inCommand_ = wasInCommand;
+
+    if (!requestTag_.empty()) {
+        Send(Command::REQUEST_DONE + "<END_OF_MESSAGE>");
+    }
+    requestTag_.swap(activeTag);
+}
+
+bool ClientSession::RequestBusy() const {
+    // 文件打开期间 transferActive_ 还没置位，靠 diskOpInFlight_ 判断
+    return !scratch_.pendingChecks.empty() || scratch_.waitingForManifest || transferActive_ || diskOpInFlight_
+        || transferIndex_ < transferQueue_.size();
+}
+
+void ClientSession::CompleteRequestIfIdle() {
+    // HandleCommand 内部的调用留给外层处理，避免在命令执行到一半时开始下一条
+    if (!requestActive_ || inCommand_ || cancelled_ || RequestBusy()) {
+        return;
+    }
+
+    for (;;) {
+        if (!requestTag_.empty() && streamsEnabled_ && !pendingWrites_.empty()) {
+            // 文件流还没发完，结束标记排在所有数据帧之后，单独占一个流
+            std::string done = AcquireBuffer();
+            done.assign(requestTag_).append(Command::REQUEST_DONE).append(END_OF_MESSAGE);
+            QueueStreamText(nextStreamId_++, UINT64_MAX, std::move(done), true);
+            requestTag_.clear();
+        }
+        else if (!requestTag_.empty()) {
+            Send(Command::REQUEST_DONE + "<END_OF_MESSAGE>");
+            requestTag_.clear();
+        }
+        requestActive_ = false;
+
+        if (deferredCommands_.empty()) {
+            return;
+        }
+        std::string command = std::move(deferredCommands_.front());
+        deferredCommands_.erase(deferredCommands_.begin());
+        StartRequest(command);
+        RecycleBuffer(std::move(command));
+        if (cancelled_ || RequestBusy()) {
+            return;
+        }
+    }
+}
+
+void ClientSession::Send(const std::string& response) {
+    std::string buffer = AcquireBuffer();
+    buffer.assign(requestTag_);
+    buffer.append(response);
+    QueueText(std::move(buffer));
+}
+
+void ClientSession::Send(std::string&& response) {
+    if (!requestTag_.empty()) {
+        response.insert(0, requestTag_);
+    }
+    QueueText(std::move(response));
+}
+
+void ClientSession::QueueText(std::string&& text) {
+    OutgoingMessage message;
+    if (!streamsEnabled_) {
+        message.text = std::move(text);
+        pendingWrites_.push_back(std::move(message));
+    }
+    else if (text.size() <= Stream::MAX_FRAME_PAYLOAD) {
+        message.text = std::move(text);
+        QueueFrame(std::move(message), Stream::CONTROL_STREAM, 0);
+    }
+    else {
+        // 超长的控制消息（如很长的公告）拆成多帧，控制流内按顺序拼接
+        for (std::size_t offset = 0; offset < text.size(); offset += Stream::MAX_FRAME_PAYLOAD) {
+            OutgoingMessage piece;
+            piece.text.assign(text, offset, Stream::MAX_FRAME_PAYLOAD);
+            QueueFrame(std::move(piece), Stream::CONTROL_STREAM, 0);
+        }
+        RecycleBuffer(std::move(text));
+    }
+    if (!writing_) {
+        DoWrite();
+    }
+}
+
+void ClientSession::SendChunk(PooledBuffer&& chunk) {
+    if (streamsEnabled_) {
+        QueueStreamData(currentStream_, currentPriority_, ShareSlab(std::move(chunk)), true);
+        return;
+    }
+    OutgoingMessage message;
+    message.chunk = std::move(chunk);
+    message.countsChunk = true;
+    pendingWrites_.push_back(std::move(message));
+    if (!writing_) {
+        DoWrite();
+    }
+}
+
+void ClientSession::SendShared(std::shared_ptr<const FileChunk> chunk) {
+    if (streamsEnabled_) {
+        QueueStreamData(currentStream_, currentPriority_, std::move(chunk), true);
+        return;
+    }
+    OutgoingMessage message;
+    message.length = chunk->size;
+    message.shared = std::move(chunk);
+    message.countsChunk = true;
+    pendingWrites_.push_back(std::move(message));
+    if (!writing_) {
+        DoWrite();
+    }
+}
+
+void ClientSession::EnableStreams() {
+    // 这条回复本身不分帧，之后的所有输出都分帧
+    std::string reply = Command::STREAMS_ENABLED + std::to_string(Stream::MAX_FRAME_PAYLOAD) + "|";
+    if (flowControl_) {
+        reply += std::to_string(sendCredit_) + "|";
+    }
+    Send(reply + "<END_OF_MESSAGE>");
+    streamsEnabled_ = true;
+}
+
+void ClientSession::EnableFlowControl(std::uint64_t initialWindow) {
+    flowControl_ = true;
+    sendCredit_ = initialWindow;
+}
+
+void ClientSession::GrantCredit(std::uint64_t bytes) {
+    if (!flowControl_) {
+        return;
+    }
+    sendCredit_ += bytes;
+    if (!writing_) {
+        DoWrite();
+    }
+}
+
+void ClientSession::QueueStreamText(std::uint32_t stream, std::uint64_t priority, std::string&& text, bool fin) {
+    OutgoingMessage message;
+    message.text = std::move(text);
+    message.priority = priority;
+    QueueFrame(std::move(message), stream, fin ? Stream::FLAG_FIN : 0);
+    if (!writing_) {
+        DoWrite();
+    }
+}
+
+void ClientSession::QueueStreamData(std::uint32_t stream, std::uint64_t priority,
+                                    std::shared_ptr<const FileChunk> chunk, bool countsChunk) {
+    // 按最大帧长切开，只有最后一帧写完时才算这一块发完
+    std::size_t size = chunk->size;
+    std::size_t offset = 0;
+    do {
+        OutgoingMessage frame;
+        frame.shared = chunk;
+        frame.offset = offset;
+        frame.length = std::min<std::size_t>(size - offset, Stream::MAX_FRAME_PAYLOAD);
+        frame.priority = priority;
+        offset += frame.length;
+        frame.countsChunk = countsChunk && offset == size;
+        QueueFrame(std::move(frame), stream, 0);
+    } while (offset < size);
+    if (!writing_) {
+        DoWrite();
+    }
+}
+
+void ClientSession::QueueFrame(OutgoingMessage&& frame, std::uint32_t stream, std::uint8_t flags) {
+    frame.framed = true;
+    PutUint32(frame.header, stream);
+    frame.header[4] = static_cast<char>(flags);
+    PutUint32(frame.header + 5, static_cast<std::uint32_t>(frame.PayloadSize()));
+
+    if (stream == Stream::CONTROL_STREAM) {
+        controlWrites_.push_back(std::move(frame));
+        return;
+    }
+    // 数据帧按优先级插入，同一优先级（同一个流）保持先后顺序
+    auto position = std::upper_bound(pendingWrites_.begin(), pendingWrites_.end(), frame.priority,
+        [](std::uint64_t priority, const OutgoingMessage& message) {
+            return message.framed && priority < message.priority;
+        });
+    pendingWrites_.insert(position, std::move(frame));
+}
+
+void ClientSession::SetClientChunks(std::vector<std::uint64_t>&& chunks) {
+    std::sort(chunks.begin(), chunks.end());
+    chunks.erase(std::unique(chunks.begin(), chunks.end()), chunks.end());
+    clientChunks_ = std::move(chunks);
+    sentChunks_.clear();
+    chunksEnabled_ = true;
+}
+
+bool ClientSession::NeedsChunk(std::uint64_t id) {
+    if (std::binary_search(clientChunks_.begin(), clientChunks_.end(), id)) {
+        return false;
+    }
+    return sentChunks_.insert(id).second;
+}
+
+void ClientSession::EnableBundles() {
+    bundlesEnabled_ = true;
+    Send(Command::BUNDLES_ENABLED + std::to_string(BUNDLE_FILE_BYTES) + "|" + std::to_string(MAX_BUNDLE_BYTES)
+         + "|<END_OF_MESSAGE>");
+}
+
+void ClientSession::QueueFileTransfers(const std::vector<TransferRequest>& files) {
+    // 正在往里加文件的包在 transferQueue_ 中的位置，遇到不打包的文件就结束，不改变文件的先后顺序
+    std::size_t first = transferQueue_.size();
+    std::size_t bundle = SIZE_MAX;
+    for (const auto& file : files) {
+        std::string path = file.path.empty() ? server_.DataDirectory() + std::string(file.name) : std::string(file.path);
+        if (!bundlesEnabled_ || file.kind != TransferKind::File || file.size > BUNDLE_FILE_BYTES) {
+            transferQueue_.push_back(QueuedTransfer{ std::string(file.name), std::move(path), file.contentHash, file.size,
+                                                     file.kind, false, {} });
+            bundle = SIZE_MAX;
+            continue;
+        }
+        if (bundle == SIZE_MAX || transferQueue_[bundle].members.size() >= MAX_BUNDLE_FILES
+            || transferQueue_[bundle].size + file.size > MAX_BUNDLE_BYTES) {
+            bundle = transferQueue_.size();
+            transferQueue_.push_back(QueuedTransfer{ std::string(), std::string(), 0, 0, TransferKind::Bundle, false, {} });
+        }
+        QueuedTransfer& target = transferQueue_[bundle];
+        target.members.push_back(BundleMember{ std::string(file.name), std::move(path), file.contentHash });
+        target.size += file.size;
+    }
+    // 只有一个文件的包照常发送
+    for (std::size_t i = first; i < transferQueue_.size(); ++i) {
+        QueuedTransfer& transfer = transferQueue_[i];
+        if (transfer.kind == TransferKind::Bundle && transfer.members.size() == 1) {
+            BundleMember& member = transfer.members.front();
+            transfer.name = std::move(member.name);
+            transfer.path = std::move(member.path);
+            transfer.contentHash = member.contentHash;
+            transfer.kind = TransferKind::File;
+            transfer.members.clear();
+        }
+    }
+    PumpTransfer();
+}
+
+void ClientSession::PumpTransfer() {
+    while (!cancelled_ && queuedChunks_ < MAX_QUEUED_CHUNKS && !waitingForBuffer_ && !diskOpInFlight_) {
+        if (!transferActive_) {
+            // 跳过预读时已经整个发出的文件
+            while (transferIndex_ < transferQueue_.size() && transferQueue_[transferIndex_].sent) {
+                ++transferIndex_;
+            }
+            if (transferIndex_ >= transferQueue_.size()) {
+                transferQueue_.clear();
+                transferIndex_ = 0;
+                // 传输全部结束，等待得来的块不再需要
+                reservedChunk_.Reset();
+                CompleteRequestIfIdle();
+                return;
+            }
+
+            if (transferQueue_[transferIndex_].kind == TransferKind::Bundle) {
+                StartBundle(transferIndex_++);
+                return;
+            }
+
+            // 下一个文件已经在预读，接上它的读取器和数据块
+            if (prefetch_.active && prefetch_.index == transferIndex_) {
+                if (prefetch_.inFlight) {
+                    // 预读的操作完成后会再回到这里
+                    return;
+                }
+                TakePrefetchedFile();
+                continue;
+            }
+
+            // 打开文件和取大小也可能卡在冷盘上，交给磁盘线程
+            std::size_t index = transferIndex_++;
+            diskOpInFlight_ = true;
+            transferPath_ = transferQueue_[index].path;
+            transferHash_ = transferQueue_[index].contentHash;
+            if (!fileReader_) {
+                fileReader_.reset(new FileReader(socket_.get_executor(), server_.DiskPool()));
+            }
+            fileReader_->SetWillNeedHint(0);
+            fileReader_->AsyncOpen(transferPath_,
+                asio::bind_cancellation_slot(transferCancel_.slot(),
+                    MakeCustomAllocHandler(fileHandlerMemory_,
+                        [self = shared_from_this(), index](const asio::error_code& error, std::uint64_t size) {
+                            self->OnFileOpened(error, index, size);
+                        })));
+            return;
+        }
+
+        if (transferOffset_ == transferSize_) {
+            fileReader_->Close();
+            transferActive_ = false;
+            std::string tail = AcquireBuffer();
+            tail.assign(END_CONTENT);
+            if (streamsEnabled_) {
+                QueueStreamText(currentStream_, currentPriority_, std::move(tail), true);
+            }
+            else {
+                QueueText(std::move(tail));
+            }
+            continue;
+        }
+
+        // 热点文件的块直接从缓存发送，不再读盘
+        std::size_t chunkSize = BufferPool::Instance().SlabSize();
+        std::uint64_t chunkIndex = transferOffset_ / chunkSize;
+        std::size_t expected = static_cast<std::size_t>(
+            std::min<std::uint64_t>(transferSize_ - transferOffset_, chunkSize));
+        auto cached = server_.Cache().Find(transferPath_, transferHash_, chunkIndex);
+        if (cached && cached->size == expected) {
+            transferOffset_ += expected;
+            ++queuedChunks_;
+            SendShared(std::move(cached));
+            continue;
+        }
+
+        // 别的会话正在读同一块时等它的结果，不需要自己的缓冲块
+        if (server_.Broadcast().Join(transferPath_, transferHash_, chunkIndex, MakeFlightCallback(chunkIndex))) {
+            diskOpInFlight_ = true;
+            return;
+        }
+
+        PooledBuffer chunk = reservedChunk_ ? std::move(reservedChunk_) : BufferPool::Instance().TryAcquire();
+        if (!chunk) {
+            // 缓冲池达到上限，排队等待归还的块，拿到后回到本会话的执行器继续
+            waitingForBuffer_ = true;
+            std::weak_ptr<ClientSession> weak = shared_from_this();
+            std::uint64_t remainingSlabs = UnsentTransferBytes() / BufferPool::Instance().SlabSize();
+            std::size_t skew = static_cast<std::size_t>(std::min<std::uint64_t>(remainingSlabs, MAX_BUFFER_WAIT_SKEW));
+            BufferPool::Instance().AcquireAsync([weak](PooledBuffer buffer) {
+                if (auto self = weak.lock()) {
+                    asio::post(self->socket_.get_executor(), [self, buffer = std::move(buffer)]() mutable {
+                        self->waitingForBuffer_ = false;
+                        if (self->cancelled_) {
+                            // 会话已经取消，块随 buffer 析构转交给下一个等待者
+                            return;
+                        }
+                        self->reservedChunk_ = std::move(buffer);
+                        self->PumpTransfer();
+                    });
+                }
+            }, skew);
+            return;
+        }
+
+        // 等缓冲块期间可能已经有人开始读这一块，此时把块留着下次用
+        if (server_.Broadcast().JoinOrLead(transferPath_, transferHash_, chunkIndex, MakeFlightCallback(chunkIndex))) {
+            reservedChunk_ = std::move(chunk);
+            diskOpInFlight_ = true;
+            return;
+        }
+
+        std::size_t length = expected;
+        std::uint64_t offset = transferOffset_;
+        char* data = chunk.Data();
+        chunk.SetSize(length);
+        transferOffset_ += length;
+
+        diskOpInFlight_ = true;
+        ++queuedChunks_;
+        fileReader_->AsyncRead(offset, data, length,
+            asio::bind_cancellation_slot(transferCancel_.slot(),
+                MakeCustomAllocHandler(fileHandlerMemory_,
+                    [self = shared_from_this(), chunk = std::move(chunk), chunkIndex](const asio::error_code& error) mutable {
+                        self->OnChunkRead(error, std::move(chunk), chunkIndex);
+                    })));
+    }
+}
+
+void ClientSession::OnFileOpened(const asio::error_code& error, std::size_t index, std::uint64_t size) {
+    diskOpInFlight_ = false;
+    if (!error && !cancelled_) {
+        BeginFile(index, size);
+        StartPrefetch();
+    }
+    PumpTransfer();
+}
+
+void ClientSession::BeginFile(std::size_t index, std::uint64_t size) {
+    // 包头、文件内容、包尾依次进入发送队列，拼起来与原来的整条消息完全相同
+    const QueuedTransfer& file = transferQueue_[index];
+    std::string header = TransferCommand(file.kind) + file.name + "|"
+                       + std::to_string(size) + "|<START_CONTENT>|";
+    if (streamsEnabled_) {
+        // 每个文件一个新流，小文件优先
+        currentStream_ = nextStreamId_++;
+        currentPriority_ = size;
+        header.insert(0, requestTag_);
+        QueueStreamText(currentStream_, currentPriority_, std::move(header), false);
+    }
+    else {
+        Send(std::move(header));
+    }
+    transferSize_ = size;
+    transferOffset_ = 0;
+    transferActive_ = true;
+}
+
+void ClientSession::StartPrefetch() {
+    std::size_t next = transferIndex_;
+    while (next < transferQueue_.size() && transferQueue_[next].sent) {
+        ++next;
+    }
+    // 包由磁盘线程一次读出，不预读
+    if (prefetch_.active || next >= transferQueue_.size() || transferQueue_[next].kind == TransferKind::Bundle
+        || PrefetchBudget::Instance().Budget() == 0) {
+        return;
+    }
+
+    prefetch_.active = true;
+    prefetch_.inFlight = true;
+    prefetch_.stopped = false;
+    prefetch_.index = next;
+    prefetch_.path = transferQueue_[next].path;
+    prefetch_.contentHash = transferQueue_[next].contentHash;
+    prefetch_.openError.clear();
+    prefetch_.size = 0;
+    prefetch_.offset = 0;
+    if (!prefetchReader_) {
+        prefetchReader_.reset(new FileReader(socket_.get_executor(), server_.DiskPool()));
+    }
+    prefetchReader_->SetWillNeedHint(PREFETCH_HINT_BYTES);
+    prefetchReader_->AsyncOpen(prefetch_.path,
+        asio::bind_cancellation_slot(prefetchCancel_.slot(),
+            MakeCustomAllocHandler(prefetchHandlerMemory_,
+                [self = shared_from_this()](const asio::error_code& error, std::uint64_t size) {
+                    self->OnPrefetchOpened(error, size);
+                })));
+}
+
+void ClientSession::ContinuePrefetch() {
+    if (prefetch_.stopped || prefetch_.openError) {
+        return;
+    }
+
+    std::uint64_t limit = std::min(prefetch_.size, PREFETCH_AHEAD_BYTES);
+    if (prefetch_.offset >= limit) {
+        return;
+    }
+
+    BufferPool& pool = BufferPool::Instance();
+    std::size_t chunkSize = pool.SlabSize();
+    std::uint64_t chunkIndex = prefetch_.offset / chunkSize;
+    std::size_t length = static_cast<std::size_t>(std::min<std::uint64_t>(prefetch_.size - prefetch_.offset, chunkSize));
+
+    // 已缓存的块发送时直接取缓存，不必预读；
+    // 缓冲池至少留一半给正在发送的文件，预读占着块不放也不会让它们互相等死
+    if (server_.Cache().Contains(prefetch_.path, prefetch_.contentHash, chunkIndex)
+        || pool.OutstandingBytes() + chunkSize > pool.MaxOutstandingBytes() / 2
+        || !PrefetchBudget::Instance().TryReserve(length)) {
+        prefetch_.stopped = true;
+        return;
+    }
+
+    PooledBuffer chunk = pool.TryAcquire();
+    if (!chunk) {
+        PrefetchBudget::Instance().Release(length);
+        prefetch_.stopped = true;
+        return;
+    }
+
+    std::uint64_t offset = prefetch_.offset;
+    char* data = chunk.Data();
+    chunk.SetSize(length);
+    prefetch_.reservedBytes += length;
+    prefetch_.offset += length;
+    prefetch_.inFlight = true;
+    prefetchReader_->AsyncRead(offset, data, length,
+        asio::bind_cancellation_slot(prefetchCancel_.slot(),
+            MakeCustomAllocHandler(prefetchHandlerMemory_,
+                [self = shared_from_this(), chunk = std::move(chunk)](const asio::error_code& error) mutable {
+                    self->OnPrefetchRead(error, std::move(chunk));
+                })));
+}
+
+void ClientSession::OnPrefetchOpened(const asio::error_code& error, std::uint64_t size) {
+    prefetch_.inFlight = false;
+    if (cancelled_) {
+        return;
+    }
+    prefetch_.openError = error;
+    prefetch_.size = size;
+    ContinuePrefetch();
+    SendPrefetchedFileIfComplete();
+    if (!prefetch_.inFlight && !transferActive_) {
+        // 发送流程正在等预读
+        PumpTransfer();
+    }
+}
+
+void ClientSession::OnPrefetchRead(const asio::error_code& error, PooledBuffer&& chunk) {
+    prefetch_.inFlight = false;
+    if (cancelled_) {
+        // 预算在取消时已经归还，块随 chunk 析构回到缓冲池
+        return;
+    }
+    if (error) {
+        // 预读失败不影响发送，剩下的部分由发送流程自己读
+        PrefetchBudget::Instance().Release(chunk.Size());
+        prefetch_.reservedBytes -= chunk.Size();
+        prefetch_.offset -= chunk.Size();
+        prefetch_.stopped = true;
+    }
+    else {
+        prefetch_.chunks.push_back(std::move(chunk));
+        ContinuePrefetch();
+        SendPrefetchedFileIfComplete();
+    }
+    if (!prefetch_.inFlight && !transferActive_) {
+        PumpTransfer();
+    }
+}
+
+void ClientSession::SendPrefetchedFileIfComplete() {
+    if (!streamsEnabled_ || !prefetch_.active || prefetch_.inFlight || prefetch_.stopped
+        || prefetch_.openError || prefetch_.offset != prefetch_.size) {
+        return;
+    }
+
+    // 整个文件都在内存里，开一个流直接发出；这些块不占当前文件的发送名额
+    QueuedTransfer& file = transferQueue_[prefetch_.index];
+    std::uint32_t stream = nextStreamId_++;
+    std::string header = AcquireBuffer();
+    header.assign(requestTag_);
+    header.append(TransferCommand(file.kind)).append(file.name).append("|").append(std::to_string(prefetch_.size))
+          .append("|<START_CONTENT>|");
+    QueueStreamText(stream, prefetch_.size, std::move(header), false);
+    for (auto& chunk : prefetch_.chunks) {
+        QueueStreamData(stream, prefetch_.size, ShareSlab(std::move(chunk)), false);
+    }
+    std::string tail = AcquireBuffer();
+    tail.assign(END_CONTENT);
+    QueueStreamText(stream, prefetch_.size, std::move(tail), true);
+    file.sent = true;
+
+    PrefetchBudget::Instance().RecordHandoff(prefetch_.reservedBytes);
+    PrefetchBudget::Instance().Release(prefetch_.reservedBytes);
+    prefetch_.reservedBytes = 0;
+    prefetch_.chunks.clear();
+    prefetch_.active = false;
+    StartPrefetch();
+}
+
+void ClientSession::StartBundle(std::size_t index) {
+    diskOpInFlight_ = true;
+    std::weak_ptr<ClientSession> weak = shared_from_this();
+    server_.Bundles().AsyncGet(server_.DiskPool(), std::move(transferQueue_[index].members),
+        [weak](std::shared_ptr<const FileBundle> bundle) {
+            if (auto self = weak.lock()) {
+                asio::post(self->socket_.get_executor(),
+                    MakeCustomAllocHandler(self->fileHandlerMemory_, [self, bundle = std::move(bundle)]() mutable {
+                        self->OnBundleReady(std::move(bundle));
+                    }));
+            }
+        });
+}
+
+void ClientSession::OnBundleReady(std::shared_ptr<const FileBundle> bundle) {
+    diskOpInFlight_ = false;
+    if (cancelled_) {
+        return;
+    }
+    // 一个文件都读不出来时和打不开的文件一样跳过
+    if (bundle) {
+        std::string header = AcquireBuffer();
+        header.assign(TransferCommand(TransferKind::Bundle)).append(bundle->toc).append("<START_CONTENT>|");
+        std::string tail = AcquireBuffer();
+        tail.assign(END_CONTENT);
+        ++queuedChunks_;
+        if (streamsEnabled_) {
+            // 整个包一个流，按总大小排优先级
+            std::uint32_t stream = nextStreamId_++;
+            std::uint64_t priority = bundle->content->size;
+            header.insert(0, requestTag_);
+            QueueStreamText(stream, priority, std::move(header), false);
+            QueueStreamData(stream, priority, bundle->content, true);
+            QueueStreamText(stream, priority, std::move(tail), true);
+        }
+        else {
+            Send(std::move(header));
+            SendShared(bundle->content);
+            QueueText(std::move(tail));
+        }
+    }
+    PumpTransfer();
+}
+
+void ClientSession::TakePrefetchedFile() {
+    std::size_t index = transferIndex_++;
+    prefetch_.active = false;
+    std::swap(fileReader_, prefetchReader_);
+    transferPath_.swap(prefetch_.path);
+    transferHash_ = prefetch_.contentHash;
+
+    if (!prefetch_.openError) {
+        BeginFile(index, prefetch_.size);
+        PrefetchBudget::Instance().RecordHandoff(prefetch_.reservedBytes);
+        for (auto& chunk : prefetch_.chunks) {
+            transferOffset_ += chunk.Size();
+            ++queuedChunks_;
+            SendChunk(std::move(chunk));
+        }
+    }
+    prefetch_.chunks.clear();
+    PrefetchBudget::Instance().Release(prefetch_.reservedBytes);
+    prefetch_.reservedBytes = 0;
+
+    if (transferActive_) {
+        StartPrefetch();
+    }
+}
+
+void ClientSession::OnChunkRead(const asio::error_code& error, PooledBuffer&& chunk, std::uint64_t chunkIndex) {
+    diskOpInFlight_ = false;
+    auto subscribers = server_.Broadcast().Finish(transferPath_, transferHash_, chunkIndex);
+    if (error) {
+        // 订阅者收到错误后各自重新读取
+        for (auto& subscriber : subscribers) {
+            subscriber(error, nullptr);
+        }
+        // 读盘失败时消息已经无法补全，只能断开连接；取消导致的失败不用再处理
+        --queuedChunks_;
+        if (!cancelled_) {
+            Close();
+        }
+        return;
+    }
+
+    // 被缓存接纳的块改为发送共享副本，缓冲池的块随即归还；
+    // 有订阅者但缓存不收时，缓冲块本身转成共享块，所有会话写完后才归还
+    auto shared = server_.Cache().Admit(transferPath_, transferHash_, chunkIndex, chunk.Data(), chunk.Size(),
+                                        !subscribers.empty());
+    if (!shared && !subscribers.empty()) {
+        shared = ShareSlab(std::move(chunk));
+    }
+    for (auto& subscriber : subscribers) {
+        subscriber(error, shared);
+    }
+
+    if (cancelled_) {
+        --queuedChunks_;
+        return;
+    }
+    if (shared) {
+        chunk.Reset();
+        SendShared(std::move(shared));
+    }
+    else {
+        SendChunk(std::move(chunk));
+    }
+    PumpTransfer();
+}
+
+BroadcastReader::Callback ClientSession::MakeFlightCallback(std::uint64_t chunkIndex) {
+    // 领读者在自己的线程上调用，这里只投递回本会话的执行器；会话已经销毁时什么也不做
+    std::weak_ptr<ClientSession> weak = shared_from_this();
+    return [weak, chunkIndex](const asio::error_code& error, std::shared_ptr<const FileChunk> chunk) {
+        if (auto self = weak.lock()) {
+            asio::post(self->socket_.get_executor(),
+                MakeCustomAllocHandler(self->fileHandlerMemory_,
+                    [self, error, chunk = std::move(chunk), chunkIndex]() mutable {
+                        self->OnSharedChunk(error, std::move(chunk), chunkIndex);
+                    }));
+        }
+    };
+}
+
+void ClientSession::OnSharedChunk(const asio::error_code& error, std::shared_ptr<const FileChunk> chunk,
+                                  std::uint64_t chunkIndex) {
+    diskOpInFlight_ = false;
+    if (cancelled_) {
+        return;
+    }
+    std::size_t chunkSize = BufferPool::Instance().SlabSize();
+    std::size_t expected = static_cast<std::size_t>(
+        std::min<std::uint64_t>(transferSize_ - transferOffset_, chunkSize));
+    // 领读者失败或结果对不上时不发送，PumpTransfer 会自己重新读这一块
+    if (!error && chunk && chunk->size == expected && transferOffset_ / chunkSize == chunkIndex) {
+        transferOffset_ += expected;
+        ++queuedChunks_;
+        SendShared(std::move(chunk));
+    }
+    PumpTransfer();
+}
+
+void ClientSession::DoWrite() {
+    writeBuffers_.clear();
+    if (streamsEnabled_) {
+        DoWriteFrames();
+    }
+    else {
+        // 把排队的响应一次性交给 async_write，发送期间新的响应继续排在 pendingWrites_
+        activeWrites_.swap(pendingWrites_);
+    }
+    for (const auto& message : activeWrites_) {
+        if (message.framed) {
+            writeBuffers_.push_back(asio::buffer(message.header, Stream::FRAME_HEADER_SIZE));
+        }
+        writeBuffers_.push_back(asio::buffer(message.Payload(), message.PayloadSize()));
+    }
+    if (activeWrites_.empty()) {
+        // 数据帧都在等窗口
+        return;
+    }
+
+    writing_ = true;
+    auto handler = asio::bind_cancellation_slot(writeCancel_.slot(),
+        MakeCustomAllocHandler(writeHandlerMemory_,
+            [self = shared_from_this()](const asio::error_code& error, std::size_t /*bytes_transferred*/) {
+                self->OnWrite(error);
+            }));
+
+    // 常见的单条响应按单缓冲区发送，多条时走聚集写
+    if (writeBuffers_.size() == 1) {
+        asio::async_write(socket_, writeBuffers_.front(), std::move(handler));
+    }
+    else {
+        const asio::const_buffer* first = writeBuffers_.data();
+        asio::async_write(socket_, ConstBufferView{ first, first + writeBuffers_.size() }, std::move(handler));
+    }
+}
+
+void ClientSession::DoWriteFrames() {
+    auto taken = pendingWrites_.begin();
+    bool split = false;
+    if (taken != pendingWrites_.end() && !taken->framed) {
+        // 开启分帧之前排队的消息原样先发完
+        while (taken != pendingWrites_.end() && !taken->framed) {
+            ++taken;
+        }
+    }
+    else {
+        // 控制帧全部优先，数据帧按优先级取一批
+        activeWrites_.swap(controlWrites_);
+        std::size_t batchBytes = 0;
+        while (taken != pendingWrites_.end() && batchBytes < STREAM_WRITE_BATCH_BYTES) {
+            if (flowControl_ && taken->IsFileData()) {
+                if (taken->PayloadSize() > sendCredit_) {
+                    split = sendCredit_ != 0;
+                    break;
+                }
+                sendCredit_ -= taken->PayloadSize();
+            }
+            batchBytes += taken->PayloadSize();
+            ++taken;
+        }
+    }
+    std::move(pendingWrites_.begin(), taken, std::back_inserter(activeWrites_));
+    pendingWrites_.erase(pendingWrites_.begin(), taken);
+
+    if (split) {
+        // 额度内的部分先发，其余留在队首等下一次授权
+        OutgoingMessage& rest = pendingWrites_.front();
+        OutgoingMessage part;
+        part.shared = rest.shared;
+        part.offset = rest.offset;
+        part.length = static_cast<std::size_t>(sendCredit_);
+        part.priority = rest.priority;
+        part.framed = true;
+        std::copy(rest.header, rest.header + Stream::FRAME_HEADER_SIZE, part.header);
+        PutUint32(part.header + 5, static_cast<std::uint32_t>(part.length));
+        rest.offset += part.length;
+        rest.length -= part.length;
+        PutUint32(rest.header + 5, static_cast<std::uint32_t>(rest.length));
+        sendCredit_ = 0;
+        activeWrites_.push_back(std::move(part));
+    }
+}
+
+void ClientSession::OnWrite(const asio::error_code& error) {
+    writing_ = false;
+    lastActivity_ = std::chrono::steady_clock::now();
+    for (auto& message : activeWrites_) {
+        if (message.countsChunk) {
+            --queuedChunks_;
+        }
+        if (!message.IsFileData()) {
+            RecycleBuffer(std::move(message.text));
+        }
+    }
+    // 清空时数据块随之归还缓冲池
+    activeWrites_.clear();
+
+    if (error) {
+        // 写失败时关闭连接，读回调会负责清理会话
+        Close();
+        return;
+    }
+
+    if (!pendingWrites_.empty() || !controlWrites_.empty()) {
+        DoWrite();
+    }
+    PumpTransfer();
+}
+
+void ClientSession::CancelTransfers() {
+    if (cancelled_) {
+        return;
+    }
+    cancelled_ = true;
+    std::uint64_t avoidedBytes = UnsentTransferBytes();
+
+    // 正在进行的读盘、预读和发送以 operation_aborted 完成，回调里不再继续
+    transferCancel_.emit(asio::cancellation_type::terminal);
+    prefetchCancel_.emit(asio::cancellation_type::terminal);
+    writeCancel_.emit(asio::cancellation_type::terminal);
+
+    // 排队的数据块和预读的块立即回到缓冲池，等哈希的文件也不再处理
+    scratch_.pendingChecks.clear();
+    for (auto& command : deferredCommands_) {
+        RecycleBuffer(std::move(command));
+    }
+    deferredCommands_.clear();
+    transferQueue_.clear();
+    transferIndex_ = 0;
+    transferActive_ = false;
+    for (auto& message : pendingWrites_) {
+        if (!message.IsFileData()) {
+            RecycleBuffer(std::move(message.text));
+        }
+    }
+    pendingWrites_.clear();
+    controlWrites_.clear();
+    reservedChunk_.Reset();
+    prefetch_.chunks.clear();
+    prefetch_.active = false;
+    PrefetchBudget::Instance().Release(prefetch_.reservedBytes);
+    prefetch_.reservedBytes = 0;
+
+    if (avoidedBytes != 0) {
+        server_.RecordCancelledTransfer(avoidedBytes);
+    }
+}
+
+std::uint64_t ClientSession::UnsentTransferBytes() const {
+    // 排队未写的数据块、当前文件剩下的部分、还没开始的文件，以及还在等哈希的文件（按需要发送估计）
+    std::uint64_t bytes = 0;
+    for (const auto& check : scratch_.pendingChecks) {
+        bytes += check.file->totalBytes;
+    }
+    for (const auto& message : pendingWrites_) {
+        if (message.IsFileData()) {
+            bytes += message.PayloadSize();
+        }
+    }
+    if (transferActive_) {
+        bytes += transferSize_ - transferOffset_;
+    }
+    for (std::size_t i = transferIndex_; i < transferQueue_.size(); ++i) {
+        if (!transferQueue_[i].sent) {
+            bytes += transferQueue_[i].size;
+        }
+    }
+    return bytes;
+}
+
+bool ClientSession::IsIdle() const {
+    return !receiveBuffer_ && !requestActive_ && !writing_ && pendingWrites_.empty() && controlWrites_.empty()
+        && transferQueue_.empty() && !transferActive_ && !diskOpInFlight_ && !waitingForBuffer_ && !prefetch_.active;
+}
+
+void ClientSession::TrimIdleMemory() {
+    if (cancelled_ || !IsIdle()) {
+        return;
+    }
+    // 处理器内存和读取器下次用到时重新分配，容器换成空的交还容量
+    readHandlerMemory_.Trim();
+    writeHandlerMemory_.Trim();
+    fileHandlerMemory_.Trim();
+    prefetchHandlerMemory_.Trim();
+    fileReader_.reset();
+    prefetchReader_.reset();
+    reservedChunk_.Reset();
+    std::string().swap(command_);
+    std::string().swap(transferPath_);
+    std::string().swap(prefetch_.path);
+    std::vector<PooledBuffer>().swap(prefetch_.chunks);
+    std::vector<OutgoingMessage>().swap(pendingWrites_);
+    std::vector<OutgoingMessage>().swap(controlWrites_);
+    std::vector<OutgoingMessage>().swap(activeWrites_);
+    std::vector<std::string>().swap(spareBuffers_);
+    std::vector<asio::const_buffer>().swap(writeBuffers_);
+    std::vector<QueuedTransfer>().swap(transferQueue_);
+    std::vector<std::string>().swap(deferredCommands_);
+    scratch_ = PatchScratch();
+}
+
+std::size_t ClientSession::MemoryUsage() const {
+    // 只统计超出短字符串优化的堆容量
+    auto heapBytes = [](const std::string& text) -> std::size_t {
+        return text.capacity() >= sizeof(std::string) ? text.capacity() + 1 : 0;
+    };
+
+    std::size_t bytes = sizeof(*this);
+    bytes += waitHandlerMemory_.AllocatedBytes() + readHandlerMemory_.AllocatedBytes()
+           + writeHandlerMemory_.AllocatedBytes() + fileHandlerMemory_.AllocatedBytes()
+           + prefetchHandlerMemory_.AllocatedBytes();
+    if (receiveBuffer_) {
+        bytes += sizeof(asio::streambuf) + receiveBuffer_->capacity();
+    }
+    if (fileReader_) {
+        bytes += sizeof(FileReader);
+    }
+    if (prefetchReader_) {
+        bytes += sizeof(FileReader);
+    }
+    bytes += heapBytes(command_) + heapBytes(transferPath_) + heapBytes(prefetch_.path);
+    bytes += (pendingWrites_.capacity() + controlWrites_.capacity() + activeWrites_.capacity()) * sizeof(OutgoingMessage);
+    bytes += writeBuffers_.capacity() * sizeof(asio::const_buffer);
+    bytes += transferQueue_.capacity() * sizeof(QueuedTransfer) + prefetch_.chunks.capacity() * sizeof(PooledBuffer);
+    bytes += (spareBuffers_.capacity() + deferredCommands_.capacity()) * sizeof(std::string);
+    for (const auto& buffer : spareBuffers_) {
+        bytes += heapBytes(buffer);
+    }
+    for (const auto& command : deferredCommands_) {
+        bytes += heapBytes(command);
+    }
+    bytes += scratch_.tokens.capacity() * sizeof(std::string_view) + scratch_.clientFiles.capacity() * sizeof(std::string_view)
+           + scratch_.needUpdateFiles.capacity() * sizeof(TransferRequest)
+           + scratch_.needDeleteFiles.capacity() * sizeof(std::string_view)
+           + scratch_.pendingChecks.capacity() * sizeof(PatchScratch::PendingCheck)
+           + heapBytes(scratch_.message) + scratch_.binaryManifest.MemoryUsage();
+    // 节点和桶按常见实现估计
+    bytes += clientChunks_.capacity() * sizeof(std::uint64_t)
+           + sentChunks_.size() * (sizeof(std::uint64_t) + 2 * sizeof(void*)) + sentChunks_.bucket_count() * sizeof(void*);
+    return bytes;
+}
+
+std::string ClientSession::AcquireBuffer() {
+    if (spareBuffers_.empty()) {
+        return std::string();
+    }
+    std::string buffer = std::move(spareBuffers_.back());
+    spareBuffers_.pop_back();
+    return buffer;
+}
+
+void ClientSession::RecycleBuffer(std::string&& buffer) {
+    if (buffer.capacity() <= MAX_RECYCLED_BUFFER_SIZE && spareBuffers_.size() < MAX_SPARE_BUFFERS) {
+        buffer.clear();
+        spareBuffers_.push_back(std::move(buffer));
+    }
+}
@@ -0,0 +1,297 @@
+#pragma once
+
+// ASIO 相关定义
+#define ASIO_STANDALONE
+#define ASIO_NO_WIN32_LEAN_AND_MEAN
+#include <asio.hpp>
+#include "HandlerAllocator.h"
+#include "BufferPool.h"
+#include "FileReader.h"
+#include "FileCache.h"
+#include "BroadcastReader.h"
+#include "PrefetchBudget.h"
+#include "Protocol.h"
+#include "BinaryManifest.h"
+#include "BundleCache.h"
+
+// 标准库
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+class TcpServer;
+struct FileHashState;
+
+// 单个客户端连接。
+// 读写各自使用一块可复用的处理器内存，响应缓冲区发送完后回收到空闲列表，
+// 所以一个只做握手和校验的连接在稳态下不再产生堆分配。
+// 客户端可以连续发送多条命令：缓冲区里已经完整的消息一次处理完，
+// 前一个请求（如文件传输）还没结束时后面的命令先排队，响应严格按请求顺序发出。
+// CHECK_PATCHES_BIN 的二进制清单和 HAVE_CHUNKS 的块编号跟在消息结束标记之后，按消息里给出的长度整段读入，不按结束标记切分。
+// 客户端发送 ENABLE_STREAMS 后改为分帧输出（见 Protocol.h），控制消息不再排在文件数据后面。
+// 没有半截消息时不持有接收缓冲区，只挂一个等待可读的操作；长时间空闲后由服务器调用
+// TrimIdleMemory 交还处理器内存和各种缓冲区，挂着不动的启动器每个只占很少的内存。
+class ClientSession : public std::enable_shared_from_this<ClientSession> {
+public:
+    ClientSession(TcpServer& server, asio::ip::tcp::socket socket);
+    ~ClientSession();
+
+    void Start();
+    void Close();
+
+    // 把一条响应放入发送队列，内容会被拷贝到回收的缓冲区中。
+    // 当前请求带编号时自动加上 REQ|<编号>| 前缀
+    void Send(const std::string& response);
+    void Send(std::string&& response);
+    // 发送当前文件的一块来自缓冲池的数据，写完后自动归还
+    void SendChunk(PooledBuffer&& chunk);
+    // 发送当前文件的一块共享的只读数据（如缓存中的块），不拷贝
+    void SendShared(std::shared_ptr<const FileChunk> chunk);
+
+    // 切换到分帧多路复用输出
+    void EnableStreams();
+    // 在 EnableStreams 之前调用，之后文件内容只在客户端授予的窗口内发送
+    void EnableFlowControl(std::uint64_t initialWindow);
+    void GrantCredit(std::uint64_t bytes);
+
+    // 客户端发过 ENABLE_DIFFS，能处理 PATCH_FILES
+    void EnableDiffs() { diffsEnabled_ = true; }
+    bool DiffsEnabled() const { return diffsEnabled_; }
+
+    // 客户端发过 HAVE_CHUNKS，能按块列表拼出文件
+    void SetClientChunks(std::vector<std::uint64_t>&& chunks);
+    bool ChunksEnabled() const { return chunksEnabled_; }
+    // 客户端没有、本连接也还没发过这个块时记下并返回 true
+    bool NeedsChunk(std::uint64_t id);
+
+    // 客户端发过 ENABLE_BUNDLES，小文件打包发送；回复 BUNDLES_ENABLED
+    void EnableBundles();
+
+    // 发送的内容：整个文件（UPDATE_FILES）、补丁（PATCH_FILES）、一个块（CHUNK_DATA）或几个小文件的包（BUNDLE_FILES）
+    enum class TransferKind { File, Patch, Chunk, Bundle };
+
+    // 待发送的文件：文件名、服务器端的内容哈希和列目录时的大小（用于统计）。
+    // 补丁和块从 path 读取，name 是协议里的名字（块是十六进制编号），size 是要发送的大小
+    struct TransferRequest {
+        std::string_view name;
+        std::size_t contentHash;
+        std::uint64_t size;
+        std::string_view path = {};
+        TransferKind kind = TransferKind::File;
+    };
+
+    // 把文件加入发送队列，文件按块读出（或从缓存取出）并发送；开启打包时连续的小文件合成一个包
+    void QueueFileTransfers(const std::vector<TransferRequest>& files);
+
+    asio::ip::tcp::socket& Socket() { return socket_; }
+
+    // 当前请求的异步部分（等哈希、文件传输）有进展时调用，全部结束后开始处理排队的命令
+    void CompleteRequestIfIdle();
+
+    // 断开后把接收缓冲区交还给服务器的缓冲池
+    std::unique_ptr<asio::streambuf> ReleaseReceiveBuffer() { return std::move(receiveBuffer_); }
+
+    // 空闲会话的内存回收，只在网络线程上调用
+    bool IsIdle() const;
+    std::chrono::steady_clock::time_point LastActivity() const { return lastActivity_; }
+    void TrimIdleMemory();
+    // 会话自身占用的用户态内存（估计值，不含内核和 asio 内部的套接字状态）
+    std::size_t MemoryUsage() const;
+
+    // CHECK_PATCHES 解析时使用的临时容器，随会话复用以保留容量
+    struct PatchScratch {
+        std::vector<std::string_view> tokens;
+        std::vector<std::string_view> clientFiles;
+        std::vector<TransferRequest> needUpdateFiles;
+        std::vector<std::string_view> needDeleteFiles;
+        std::string message;
+
+        // 哈希还没算完的服务器文件，算完后再决定是否发送
+        struct PendingCheck {
+            const FileHashState* file;
+            bool clientHas;
+            std::size_t clientCrc;
+        };
+        std::vector<PendingCheck> pendingChecks;
+        bool waitingForHashes = false;
+        // CHECK_PATCHES_BIN 的解析结果
+        BinaryManifestReader binaryManifest;
+        // GET_MANIFEST 在等全部哈希算完
+        bool waitingForManifest = false;
+    };
+    PatchScratch& Scratch() { return scratch_; }
+
+private:
+    void DoRead();
+    void OnReadable(const asio::error_code& error);
+    void ReadMessage();
+    void OnRead(const asio::error_code& error, std::size_t bytes_transferred);
+    // 取出缓冲区开头长度为 length 的消息并处理；后面的二进制负载还没收齐时先去读，返回 false
+    bool TakeMessage(std::size_t length);
+    void ReadPayload(std::size_t payload);
+    void OnPayloadRead(const asio::error_code& error, std::size_t payload);
+    // 处理缓冲区里已经完整的消息，然后继续读
+    void ProcessBufferedMessages();
+    void DoWrite();
+    void OnWrite(const asio::error_code& error);
+    // 不加请求前缀，直接放入发送队列；分帧模式下走控制流
+    void QueueText(std::string&& text);
+
+    // 分帧模式：文件流的文本和数据，priority 小的先发
+    void QueueStreamText(std::uint32_t stream, std::uint64_t priority, std::string&& text, bool fin);
+    void QueueStreamData(std::uint32_t stream, std::uint64_t priority, std::shared_ptr<const FileChunk> chunk,
+                         bool countsChunk);
+    struct OutgoingMessage;
+    void QueueFrame(OutgoingMessage&& frame, std::uint32_t stream, std::uint8_t flags);
+    void DoWriteFrames();
+
+    // 请求的排队与顺序
+    void DispatchCommand();
+    void StartRequest(std::string& command);
+    void ParseRequestTag(std::string& command);
+    // 分帧模式下不涉及文件传输的命令不必排队
+    void RunSideCommand();
+    bool RequestBusy() const;
+
+    // 连接断开时取消读盘、预读和发送，立即归还占用的缓冲块
+    void CancelTransfers();
+    std::uint64_t UnsentTransferBytes() const;
+
+    void PumpTransfer();
+    void OnFileOpened(const asio::error_code& error, std::size_t index, std::uint64_t size);
+    void BeginFile(std::size_t index, std::uint64_t size);
+    void OnChunkRead(const asio::error_code& error, PooledBuffer&& chunk, std::uint64_t chunkIndex);
+    // 搭上别的会话的读盘后，结果经由这里回到本会话
+    BroadcastReader::Callback MakeFlightCallback(std::uint64_t chunkIndex);
+    void OnSharedChunk(const asio::error_code& error, std::shared_ptr<const FileChunk> chunk,
+                       std::uint64_t chunkIndex);
+
+    // 预读：当前文件发送期间，提前打开下一个文件并读出开头几块
+    void StartPrefetch();
+    void ContinuePrefetch();
+    void OnPrefetchOpened(const asio::error_code& error, std::uint64_t size);
+    void OnPrefetchRead(const asio::error_code& error, PooledBuffer&& chunk);
+    void TakePrefetchedFile();
+    // 分帧模式下已经整个读完的小文件直接在自己的流上发出，不等前面的大文件
+    void SendPrefetchedFileIfComplete();
+
+    // 在磁盘线程上打包（或从包缓存取出），完成后作为一条 BUNDLE_FILES 发出
+    void StartBundle(std::size_t index);
+    void OnBundleReady(std::shared_ptr<const FileBundle> bundle);
+
+    std::string AcquireBuffer();
+    void RecycleBuffer(std::string&& buffer);
+
+    TcpServer& server_;
+    asio::ip::tcp::socket socket_;
+    std::unique_ptr<asio::streambuf> receiveBuffer_;   // 只在读消息期间持有
+    std::chrono::steady_clock::time_point lastActivity_;
+    std::string command_;                       // 当前命令，复用容量
+
+    HandlerMemory waitHandlerMemory_;           // 等待可读，空闲时也一直挂着，所以单独用一小块
+    HandlerMemory readHandlerMemory_;
+    HandlerMemory writeHandlerMemory_;
+    HandlerMemory fileHandlerMemory_;
+    HandlerMemory prefetchHandlerMemory_;
+
+    // 发送队列中的一项：文本响应、缓冲池中的文件数据块或共享的缓存块。
+    // 分帧模式下一项就是一帧，共享块按 offset/length 切成多帧
+    struct OutgoingMessage {
+        std::string text;
+        PooledBuffer chunk;
+        std::shared_ptr<const FileChunk> shared;
+        bool countsChunk = false;       // 写完后从 queuedChunks_ 中扣除
+        bool framed = false;
+        std::uint64_t priority = 0;
+        std::size_t offset = 0;
+        std::size_t length = 0;
+        char header[Stream::FRAME_HEADER_SIZE];
+
+        bool IsFileData() const { return chunk || shared; }
+        const char* Payload() const {
+            return chunk ? chunk.Data() : shared ? shared->Data() + offset : text.data();
+        }
+        std::size_t PayloadSize() const {
+            return chunk ? chunk.Size() : shared ? length : text.size();
+        }
+    };
+
+    std::vector<OutgoingMessage> pendingWrites_;    // 等待发送的响应；分帧模式下是按优先级排好的数据帧
+    std::vector<OutgoingMessage> controlWrites_;    // 分帧模式下等待发送的控制帧
+    std::vector<OutgoingMessage> activeWrites_;     // 正在发送的响应
+    std::vector<std::string> spareBuffers_;     // 可复用的响应缓冲区
+    std::vector<asio::const_buffer> writeBuffers_;
+    bool writing_;
+
+    // 文件传输状态
+    struct QueuedTransfer {
+        std::string name;
+        std::string path;                       // 读取的文件：Data 下的文件、补丁或块
+        std::size_t contentHash;
+        std::uint64_t size;
+        TransferKind kind;
+        bool sent;                              // 已经由预读整个发出
+        std::vector<BundleMember> members;      // 包里的小文件，size 是它们的大小之和
+    };
+    std::vector<QueuedTransfer> transferQueue_; // 待发送的文件
+    std::size_t transferIndex_;                 // 下一个要打开的文件
+    std::unique_ptr<FileReader> fileReader_;    // 第一次传输时才创建
+    std::string transferPath_;                  // 当前文件路径，同时用作缓存键
+    std::size_t transferHash_;                  // 当前文件的内容哈希
+    std::uint64_t transferSize_;                // 当前文件大小
+    std::uint64_t transferOffset_;              // 下一块的读取位置
+    bool transferActive_;
+    bool diskOpInFlight_;                       // 同一时刻只有一个打开、读取或等待合并读取的请求，保证数据块按顺序发送
+    std::size_t queuedChunks_;                  // 正在读取或已排队但未写完的数据块数
+    bool waitingForBuffer_;                     // 缓冲池已满，等待归还
+    PooledBuffer reservedChunk_;                // 等待得来、尚未用上的块
+
+    // 下一个文件的预读状态，当前文件发完后读取器和已读出的块一起交给发送流程
+    struct PrefetchState {
+        bool active;
+        bool inFlight;                          // 预读的打开或读取尚未完成
+        bool stopped;                           // 预算用完或读取失败，不再继续
+        std::size_t index;                      // 对应 transferQueue_ 中的位置
+        std::string path;
+        std::size_t contentHash;
+        asio::error_code openError;
+        std::uint64_t size;
+        std::uint64_t offset;                   // 已经发出读取的位置
+        std::vector<PooledBuffer> chunks;
+        std::size_t reservedBytes;              // 在 PrefetchBudget 中登记的字节数
+    };
+    std::unique_ptr<FileReader> prefetchReader_;
+    PrefetchState prefetch_;
+
+    // 各类异步操作的取消信号，连接断开时一起触发
+    asio::cancellation_signal transferCancel_;
+    asio::cancellation_signal prefetchCancel_;
+    asio::cancellation_signal writeCancel_;
+    bool cancelled_;
+
+    // 请求状态
+    bool requestActive_;                        // 有请求还没处理完
+    bool inCommand_;                            // 正在执行 HandleCommand
+    std::string requestTag_;                    // 当前请求的 REQ|<编号>| 前缀，未编号时为空
+    std::vector<std::string> deferredCommands_; // 等前一个请求结束的命令
+
+    // 分帧多路复用
+    bool streamsEnabled_;
+    std::uint32_t nextStreamId_;
+    std::uint32_t currentStream_;               // 当前文件所在的流
+    std::uint64_t currentPriority_;
+    bool flowControl_;
+    std::uint64_t sendCredit_;                  // 还能发送的文件内容字节数
+
+    bool diffsEnabled_;                         // 可以用补丁代替整个文件
+    bool chunksEnabled_;                        // 可以按块发送
+    std::vector<std::uint64_t> clientChunks_;   // 客户端报告已有的块，已排序
+    std::unordered_set<std::uint64_t> sentChunks_;  // 本连接已经排队发送的块
+    bool bundlesEnabled_;                       // 小文件打包发送
+
+    PatchScratch scratch_;
+};
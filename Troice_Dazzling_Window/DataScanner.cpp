@@ -0,0 +1,351 @@
+#include "DataScanner.h"
+
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+    std::string Trim(const std::string& text) {
+        std::size_t begin = text.find_first_not_of(" \t\r\n");
+        if (begin == std::string::npos) {
+            return std::string();
+        }
+        std::size_t end = text.find_last_not_of(" \t\r\n");
+        return text.substr(begin, end - begin + 1);
+    }
+
+    bool SameChar(char a, char b) {
+        return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+    }
+
+    // 通配符匹配，* 不跨越 /，** 可以跨越，"**/" 也能匹配零层目录
+    bool GlobMatch(std::string_view pattern, std::string_view text) {
+        std::size_t p = 0;
+        std::size_t t = 0;
+        while (p < pattern.size()) {
+            if (pattern[p] == '*') {
+                bool deep = p + 1 < pattern.size() && pattern[p + 1] == '*';
+                std::size_t next = p + (deep ? 2 : 1);
+                if (deep && next < pattern.size() && pattern[next] == '/'
+                    && GlobMatch(pattern.substr(next + 1), text.substr(t))) {
+                    return true;
+                }
+                for (std::size_t k = t; k <= text.size(); ++k) {
+                    if (GlobMatch(pattern.substr(next), text.substr(k))) {
+                        return true;
+                    }
+                    if (k < text.size() && !deep && text[k] == '/') {
+                        break;
+                    }
+                }
+                return false;
+            }
+            if (t >= text.size()) {
+                return false;
+            }
+            if (pattern[p] == '?' ? text[t] == '/' : !SameChar(pattern[p], text[t])) {
+                return false;
+            }
+            ++p;
+            ++t;
+        }
+        return t == text.size();
+    }
+
+    // 目录中的一项；文件只有通过规则后才取大小和修改时间
+    struct ScanEntry {
+        std::string name;
+        std::string path;       // 相对 Data 的路径
+        bool directory;
+        std::uint64_t size;
+        std::int64_t mtime;
+    };
+
+    // 列出一个目录下要进入的子目录和要包含的文件，不跟随符号链接
+    void ListDirectory(const std::filesystem::path& root, const std::string& relative, std::size_t depth,
+                       const FileRules& rules, std::vector<ScanEntry>& entries) {
+        std::filesystem::path directory = relative.empty() ? root : root / relative;
+        auto accept = [&](std::string&& name, bool isDirectory) -> ScanEntry* {
+            std::string path = relative.empty() ? name : relative + '/' + name;
+            bool wanted = isDirectory ? rules.EntersDirectory(path, depth + 1) : rules.IncludesFile(path);
+            if (!wanted) {
+                return nullptr;
+            }
+            entries.push_back(ScanEntry{ std::move(name), std::move(path), isDirectory, 0, 0 });
+            return &entries.back();
+        };
+
+#ifdef _WIN32
+        // 大批量取目录项，大小和修改时间随目录项一起返回，不用再逐个取属性
+        std::wstring pattern = directory.wstring() + L"\\*";
+        WIN32_FIND_DATAW data;
+        HANDLE find = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &data, FindExSearchNameMatch,
+                                       nullptr, FIND_FIRST_EX_LARGE_FETCH);
+        if (find == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        do {
+            if (wcscmp(data.cFileName, L".") == 0 || wcscmp(data.cFileName, L"..") == 0
+                || (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+                continue;
+            }
+            // 和 FileReader 一样使用系统代码页的窄字符路径
+            int length = WideCharToMultiByte(CP_ACP, 0, data.cFileName, -1, nullptr, 0, nullptr, nullptr);
+            if (length <= 1) {
+                continue;
+            }
+            std::string name(static_cast<std::size_t>(length - 1), '\0');
+            WideCharToMultiByte(CP_ACP, 0, data.cFileName, -1, &name[0], length, nullptr, nullptr);
+
+            bool isDirectory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+            if (ScanEntry* entry = accept(std::move(name), isDirectory)) {
+                entry->size = (static_cast<std::uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+                entry->mtime = static_cast<std::int64_t>(
+                    (static_cast<std::uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32)
+                    | data.ftLastWriteTime.dwLowDateTime);
+            }
+        } while (FindNextFileW(find, &data));
+        FindClose(find);
+#else
+        // readdir 底层用 getdents64 成批读取目录项，类型已知时不用再取属性；
+        // 文件的属性相对目录句柄获取，不重复解析整条路径
+        DIR* dir = opendir(directory.c_str());
+        if (dir == nullptr) {
+            return;
+        }
+        int fd = dirfd(dir);
+        while (dirent* item = readdir(dir)) {
+            const char* name = item->d_name;
+            if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) {
+                continue;
+            }
+            unsigned char type = item->d_type;
+            struct stat info;
+            if (type == DT_UNKNOWN) {
+                if (fstatat(fd, name, &info, AT_SYMLINK_NOFOLLOW) != 0) {
+                    continue;
+                }
+                type = S_ISDIR(info.st_mode) ? DT_DIR : S_ISREG(info.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            if (type != DT_DIR && type != DT_REG) {
+                continue;
+            }
+            ScanEntry* entry = accept(std::string(name), type == DT_DIR);
+            if (entry == nullptr || entry->directory) {
+                continue;
+            }
+            if (fstatat(fd, name, &info, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(info.st_mode)) {
+                entries.pop_back();
+                continue;
+            }
+            entry->size = static_cast<std::uint64_t>(info.st_size);
+            entry->mtime = static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+        }
+        closedir(dir);
+#endif
+    }
+}
+
+// FileRules 实现
+FileRules::FileRules()
+    : includes_{ "*.mpq" }
+    , maxDepth_(0)
+{
+}
+
+void FileRules::Load(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return;
+    }
+
+    std::vector<std::string> includes;
+    std::vector<std::string> excludes;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = Trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            continue;
+        }
+        std::string key = Trim(line.substr(0, equals));
+        std::string value = Trim(line.substr(equals + 1));
+        std::replace(value.begin(), value.end(), '\\', '/');
+        if (value.empty()) {
+            continue;
+        }
+        if (key == "include") {
+            includes.push_back(value);
+        }
+        else if (key == "exclude") {
+            excludes.push_back(value);
+        }
+    }
+
+    if (!includes.empty()) {
+        includes_.swap(includes);
+    }
+    excludes_.swap(excludes);
+
+    maxDepth_ = 0;
+    for (const auto& pattern : includes_) {
+        if (pattern.find("**") != std::string::npos) {
+            maxDepth_ = static_cast<std::size_t>(-1);
+            break;
+        }
+        maxDepth_ = std::max<std::size_t>(maxDepth_, std::count(pattern.begin(), pattern.end(), '/'));
+    }
+}
+
+bool FileRules::IncludesFile(std::string_view path) const {
+    bool included = false;
+    for (const auto& pattern : includes_) {
+        if (GlobMatch(pattern, path)) {
+            included = true;
+            break;
+        }
+    }
+    if (!included) {
+        return false;
+    }
+    for (const auto& pattern : excludes_) {
+        if (GlobMatch(pattern, path)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FileRules::EntersDirectory(std::string_view path, std::size_t depth) const {
+    if (depth > maxDepth_) {
+        return false;
+    }
+    // "WTF" 和 "WTF/**" 都排除整个目录
+    std::string withSlash(path);
+    withSlash += '/';
+    for (const auto& pattern : excludes_) {
+        if (GlobMatch(pattern, path) || GlobMatch(pattern, withSlash)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// PathTree 实现
+PathTree::PathTree()
+    : directories_{ Directory{ ROOT, 0, 0 } }
+{
+}
+
+std::uint32_t PathTree::AddDirectory(std::uint32_t parent, std::string_view name) {
+    directories_.push_back({ parent, static_cast<std::uint32_t>(names_.size()), static_cast<std::uint32_t>(name.size()) });
+    names_.append(name);
+    return static_cast<std::uint32_t>(directories_.size() - 1);
+}
+
+void PathTree::AddFile(std::uint32_t directory, std::string_view name, std::uint64_t size, std::int64_t mtime) {
+    files_.push_back({ directory, static_cast<std::uint32_t>(names_.size()), static_cast<std::uint32_t>(name.size()),
+                       size, mtime });
+    names_.append(name);
+}
+
+void PathTree::AppendDirectory(std::uint32_t directory, std::string& out) const {
+    if (directory == ROOT) {
+        return;
+    }
+    const Directory& entry = directories_[directory];
+    AppendDirectory(entry.parent, out);
+    out.append(names_, entry.nameOffset, entry.nameLength);
+    out += '/';
+}
+
+void PathTree::GetPath(std::size_t file, std::string& out) const {
+    const File& entry = files_[file];
+    out.clear();
+    AppendDirectory(entry.directory, out);
+    out.append(names_, entry.nameOffset, entry.nameLength);
+}
+
+std::string PathTree::GetDirectoryPath(std::uint32_t directory) const {
+    std::string path;
+    AppendDirectory(directory, path);
+    if (!path.empty()) {
+        path.pop_back();
+    }
+    return path;
+}
+
+std::size_t PathTree::MemoryUsage() const {
+    return directories_.capacity() * sizeof(Directory) + files_.capacity() * sizeof(File) + names_.capacity();
+}
+
+PathTree ScanDataTree(const std::filesystem::path& root, const FileRules& rules, std::size_t threads) {
+    struct Task {
+        std::uint32_t directory;
+        std::string path;
+        std::size_t depth;
+    };
+
+    PathTree tree;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<Task> pending{ Task{ PathTree::ROOT, std::string(), 0 } };
+    std::size_t busy = 0;
+
+    // 每个线程取一个目录列出来，子目录放回队列；只有往树里登记时加锁
+    auto work = [&]() {
+        std::vector<ScanEntry> entries;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            changed.wait(lock, [&]() { return !pending.empty() || busy == 0; });
+            if (pending.empty()) {
+                return;
+            }
+            Task task = std::move(pending.back());
+            pending.pop_back();
+            ++busy;
+            lock.unlock();
+
+            entries.clear();
+            ListDirectory(root, task.path, task.depth, rules, entries);
+
+            lock.lock();
+            for (auto& entry : entries) {
+                if (entry.directory) {
+                    std::uint32_t id = tree.AddDirectory(task.directory, entry.name);
+                    pending.push_back(Task{ id, std::move(entry.path), task.depth + 1 });
+                }
+                else {
+                    tree.AddFile(task.directory, entry.name, entry.size, entry.mtime);
+                }
+            }
+            --busy;
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> helpers;
+    for (std::size_t i = 1; i < threads; ++i) {
+        helpers.emplace_back(work);
+    }
+    work();
+    for (auto& helper : helpers) {
+        helper.join();
+    }
+    return tree;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+// 标准库
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 哪些文件放进清单。规则从 Files.txt 读取，每行一项：
+//   include=<通配符>    相对 Data 的路径，用 / 分隔
+//   exclude=<通配符>
+// * 匹配一段路径内的任意字符，** 可以跨越多级目录，? 匹配一个字符，不区分大小写。
+// 文件要匹配至少一条 include 且不匹配任何 exclude；以 # 开头的行是注释。
+// 没有这个文件或里面没有 include 时只包含 Data 顶层的 .mpq，和原来一样
+class FileRules {
+public:
+    FileRules();
+
+    void Load(const std::string& path);
+
+    bool IncludesFile(std::string_view path) const;
+    // 目录下不可能有要包含的文件（超过 include 的层数或被 exclude 排除）时不必进入
+    bool EntersDirectory(std::string_view path, std::size_t depth) const;
+
+private:
+    std::vector<std::string> includes_;
+    std::vector<std::string> excludes_;
+    std::size_t maxDepth_;      // include 中最多的 / 数，有 ** 时不限
+};
+
+// 扫描得到的文件，路径按目录逐段存放，每个目录名只存一次
+class PathTree {
+public:
+    static const std::uint32_t ROOT = 0;
+
+    struct File {
+        std::uint32_t directory;
+        std::uint32_t nameOffset;
+        std::uint32_t nameLength;
+        std::uint64_t size;
+        std::int64_t mtime;     // 文件系统给出的修改时间计数，只和同一台机器上的旧值比较
+    };
+
+    PathTree();
+
+    std::uint32_t AddDirectory(std::uint32_t parent, std::string_view name);
+    void AddFile(std::uint32_t directory, std::string_view name, std::uint64_t size, std::int64_t mtime);
+
+    std::size_t FileCount() const { return files_.size(); }
+    const File& FileAt(std::size_t index) const { return files_[index]; }
+    // 把相对路径（a/b/c.mpq）写入 out
+    void GetPath(std::size_t file, std::string& out) const;
+    std::string GetDirectoryPath(std::uint32_t directory) const;
+    // 树本身占用的字节数
+    std::size_t MemoryUsage() const;
+
+private:
+    struct Directory {
+        std::uint32_t parent;
+        std::uint32_t nameOffset;
+        std::uint32_t nameLength;
+    };
+
+    void AppendDirectory(std::uint32_t directory, std::string& out) const;
+
+    std::vector<Directory> directories_;
+    std::vector<File> files_;
+    std::string names_;         // 目录名和文件名，都只存最后一段
+};
+
+// 用 threads 个线程并行扫描 root 下符合规则的文件，不跟随符号链接
+PathTree ScanDataTree(const std::filesystem::path& root, const FileRules& rules, std::size_t threads);
@@ -0,0 +1,99 @@
+#include "DiskIoPool.h"
+
+DiskIoPool::DiskIoPool(std::size_t threadCount, std::size_t maxQueueDepth)
+    : maxQueueDepth_(maxQueueDepth)
+    , stopping_(false)
+    , queueDepth_(0)
+    , peakQueueDepth_(0)
+    , completed_(0)
+    , rejected_(0)
+    , totalWaitMicros_(0)
+    , maxWaitMicros_(0)
+{
+    if (threadCount == 0) {
+        threadCount = 1;
+    }
+    for (std::size_t i = 0; i < threadCount; ++i) {
+        threads_.emplace_back([this]() { WorkerLoop(); });
+    }
+}
+
+DiskIoPool::~DiskIoPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_all();
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+bool DiskIoPool::Reserve() {
+    std::size_t depth = queueDepth_.load();
+    do {
+        if (maxQueueDepth_ != 0 && depth >= maxQueueDepth_) {
+            rejected_.fetch_add(1);
+            return false;
+        }
+    } while (!queueDepth_.compare_exchange_weak(depth, depth + 1));
+
+    ++depth;
+    std::size_t peak = peakQueueDepth_.load();
+    while (depth > peak && !peakQueueDepth_.compare_exchange_weak(peak, depth)) {
+    }
+    return true;
+}
+
+void DiskIoPool::Enqueue(std::unique_ptr<Job> job) {
+    job->enqueued = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.push_back(std::move(job));
+    }
+    condition_.notify_one();
+}
+
+void DiskIoPool::WorkerLoop() {
+    for (;;) {
+        std::unique_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [this]() { return stopping_ || !jobs_.empty(); });
+            if (stopping_) {
+                // 未执行的任务随队列一起销毁，其中持有的会话引用也随之释放
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        queueDepth_.fetch_sub(1);
+
+        auto waited = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - job->enqueued).count();
+        std::uint64_t waitMicros = waited > 0 ? static_cast<std::uint64_t>(waited) : 0;
+        totalWaitMicros_.fetch_add(waitMicros);
+        std::uint64_t maxWait = maxWaitMicros_.load();
+        while (waitMicros > maxWait && !maxWaitMicros_.compare_exchange_weak(maxWait, waitMicros)) {
+        }
+
+        job->Run();
+        completed_.fetch_add(1);
+    }
+}
+
+DiskIoStats DiskIoPool::GetStats() const {
+    DiskIoStats stats;
+    stats.threadCount = threads_.size();
+    stats.queueDepth = queueDepth_.load();
+    stats.peakQueueDepth = peakQueueDepth_.load();
+    stats.maxQueueDepth = maxQueueDepth_;
+    stats.rejected = rejected_.load();
+    stats.completed = completed_.load();
+    stats.averageWaitMs = stats.completed == 0 ? 0.0
+        : static_cast<double>(totalWaitMicros_.load()) / stats.completed / 1000.0;
+    stats.maxWaitMs = static_cast<double>(maxWaitMicros_.load()) / 1000.0;
+    return stats;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+// 标准库
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// 磁盘 I/O 队列的运行统计
+struct DiskIoStats {
+    std::size_t threadCount;
+    std::size_t queueDepth;        // 当前排队的任务数
+    std::size_t peakQueueDepth;    // 历史最大排队数
+    std::size_t maxQueueDepth;     // 排队上限，0 表示不限
+    std::uint64_t rejected;        // 队列满时被拒绝的任务数
+    std::uint64_t completed;       // 已执行的任务数
+    double averageWaitMs;          // 任务从入队到开始执行的平均等待
+    double maxWaitMs;              // 最长等待
+};
+
+// 专门执行阻塞磁盘操作（打开、取大小、读取）的线程池。
+// 网络线程只负责投递任务，完成回调由任务自己投递回会话的执行器，
+// 一次冷盘大读不会再卡住其他会话的握手。
+// 一个会话可能同时有正文读取和预读两个任务在排队，在线会话一多队列就会很长，
+// 所以排队数有上限：队列满时 Post 直接拒绝，由调用方报错，不会阻塞投递的网络线程。
+class DiskIoPool {
+public:
+    // maxQueueDepth 为 0 时不限排队数
+    explicit DiskIoPool(std::size_t threadCount, std::size_t maxQueueDepth = 0);
+    ~DiskIoPool();
+
+    DiskIoPool(const DiskIoPool&) = delete;
+    DiskIoPool& operator=(const DiskIoPool&) = delete;
+
+    // 投递任务，任务可以是只能移动的函数对象。
+    // 排队数已到上限时返回 false，function 不会被移走，调用方可以拿回其中的处理器报错
+    template <typename Function>
+    bool Post(Function&& function) {
+        if (!Reserve()) {
+            return false;
+        }
+        using Decayed = typename std::decay<Function>::type;
+        Enqueue(std::unique_ptr<Job>(new JobImpl<Decayed>(std::forward<Function>(function))));
+        return true;
+    }
+
+    DiskIoStats GetStats() const;
+
+private:
+    struct Job {
+        virtual ~Job() = default;
+        virtual void Run() = 0;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    template <typename Function>
+    struct JobImpl : Job {
+        explicit JobImpl(Function&& f) : function(std::move(f)) {}
+        explicit JobImpl(const Function& f) : function(f) {}
+        void Run() override { function(); }
+        Function function;
+    };
+
+    bool Reserve();
+    void Enqueue(std::unique_ptr<Job> job);
+    void WorkerLoop();
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<std::unique_ptr<Job>> jobs_;
+    std::vector<std::thread> threads_;
+    const std::size_t maxQueueDepth_;
+    bool stopping_;
+
+    std::atomic<std::size_t> queueDepth_;   // 占了位置的任务数，包括正在入队的
+    std::atomic<std::size_t> peakQueueDepth_;
+    std::atomic<std::uint64_t> completed_;
+    std::atomic<std::uint64_t> rejected_;
+    std::atomic<std::uint64_t> totalWaitMicros_;
+    std::atomic<std::uint64_t> maxWaitMicros_;
+};
@@ -0,0 +1,531 @@
+#include "EdgeMirror.h"
+#include "BinaryDiff.h"
+#include "BinaryManifest.h"
+#include "Protocol.h"
+
+#define ASIO_STANDALONE
+#define ASIO_NO_WIN32_LEAN_AND_MEAN
+#include <asio.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace {
+    const char* const END_OF_MESSAGE = "<END_OF_MESSAGE>";
+    const char* const START_CONTENT = "<START_CONTENT>|";
+    const char* const CONTENT_TAIL = "|<END_CONTENT>|<END_OF_MESSAGE>";
+    const std::size_t READ_BYTES = 64 * 1024;
+
+    // <代数><suffix> 形式的版本目录或清单文件名，不是时返回 0
+    std::uint64_t ParseGeneration(std::string_view name, std::string_view suffix) {
+        if (name.size() <= suffix.size() || name.substr(name.size() - suffix.size()) != suffix) {
+            return 0;
+        }
+        name.remove_suffix(suffix.size());
+        std::uint64_t generation = 0;
+        auto [ptr, ec] = std::from_chars(name.data(), name.data() + name.size(), generation);
+        return ec == std::errc() && ptr == name.data() + name.size() ? generation : 0;
+    }
+
+    // 源服务器给出的文件名只能是根目录下的相对路径
+    bool IsSafeName(std::string_view name) {
+        if (name.empty()) {
+            return false;
+        }
+        fs::path path{ std::string(name) };
+        if (path.has_root_name() || path.has_root_directory()) {
+            return false;
+        }
+        for (const auto& part : path) {
+            if (part == "..") {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool ReadWholeFile(const fs::path& path, std::string& data) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return !file.bad();
+    }
+
+    // 切出 '|' 之前的一段
+    std::string_view NextField(std::string_view& text) {
+        std::size_t end = text.find('|');
+        std::string_view field = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+        return field;
+    }
+
+    std::uint64_t ParseNumber(std::string_view text) {
+        std::uint64_t value = 0;
+        auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (ec != std::errc() || ptr != text.data() + text.size()) {
+            throw std::runtime_error("bad number from origin");
+        }
+        return value;
+    }
+
+    bool StartsWith(std::string_view text, const std::string& prefix) {
+        return text.substr(0, prefix.size()) == prefix;
+    }
+}
+
+// 到源服务器的阻塞连接，只在复制线程上收发；Abort 可以从其他线程调用，打断阻塞中的读写
+class EdgeMirror::Connection {
+public:
+    Connection() : socket_(io_), offset_(0) {}
+
+    void Connect(const std::string& host, short port) {
+        asio::ip::tcp::resolver resolver(io_);
+        asio::connect(socket_, resolver.resolve(host, std::to_string(static_cast<unsigned short>(port))));
+        socket_.set_option(asio::ip::tcp::no_delay(true));
+    }
+
+    void Abort() {
+        asio::error_code ignored;
+        socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ignored);
+    }
+
+    void Send(std::string_view data) {
+        asio::write(socket_, asio::buffer(data.data(), data.size()));
+    }
+
+    // 读下一条消息的头，去掉请求编号前缀。带内容的消息读到 <START_CONTENT>| 为止，返回 true，
+    // 之后要用 ReadContent 读走内容；不带内容的读到 <END_OF_MESSAGE> 为止
+    bool ReadHeader(std::string& header) {
+        for (;;) {
+            // 错误回复前面可能有 BOM，后面可能有换行
+            while (offset_ < buffer_.size() && (buffer_[offset_] == '\n' || buffer_[offset_] == '\r')) {
+                ++offset_;
+            }
+            if (buffer_.compare(offset_, 3, "\xEF\xBB\xBF") == 0) {
+                offset_ += 3;
+            }
+            std::size_t end = buffer_.find(END_OF_MESSAGE, offset_);
+            std::size_t content = buffer_.find(START_CONTENT, offset_);
+            if (content != std::string::npos && content < end) {
+                Take(header, content, std::strlen(START_CONTENT));
+                return true;
+            }
+            if (end != std::string::npos) {
+                Take(header, end, std::strlen(END_OF_MESSAGE));
+                return false;
+            }
+            Fill();
+        }
+    }
+
+    // 读 size 字节的内容，分段交给 sink，最后读掉包尾
+    template <typename Sink>
+    void ReadContent(std::uint64_t size, Sink&& sink) {
+        while (size > 0) {
+            if (offset_ == buffer_.size()) {
+                Fill();
+            }
+            std::size_t length = static_cast<std::size_t>(std::min<std::uint64_t>(size, buffer_.size() - offset_));
+            sink(buffer_.data() + offset_, length);
+            offset_ += length;
+            size -= length;
+        }
+        std::size_t tail = std::strlen(CONTENT_TAIL);
+        while (buffer_.size() - offset_ < tail) {
+            Fill();
+        }
+        if (buffer_.compare(offset_, tail, CONTENT_TAIL) != 0) {
+            throw std::runtime_error("bad content tail from origin");
+        }
+        offset_ += tail;
+    }
+
+private:
+    void Take(std::string& header, std::size_t end, std::size_t markerLength) {
+        header.assign(buffer_, offset_, end - offset_);
+        offset_ = end + markerLength;
+        // 同一时间只有一个请求，编号不用核对
+        if (StartsWith(header, Command::REQUEST)) {
+            std::size_t tagEnd = header.find('|', Command::REQUEST.size());
+            header.erase(0, tagEnd == std::string::npos ? header.size() : tagEnd + 1);
+        }
+    }
+
+    void Fill() {
+        buffer_.erase(0, offset_);
+        offset_ = 0;
+        std::size_t used = buffer_.size();
+        buffer_.resize(used + READ_BYTES);
+        std::size_t received = socket_.read_some(asio::buffer(&buffer_[used], READ_BYTES));
+        buffer_.resize(used + received);
+    }
+
+    asio::io_context io_;
+    asio::ip::tcp::socket socket_;
+    std::string buffer_;
+    std::size_t offset_;
+};
+
+EdgeMirror::EdgeMirror(EdgeOptions options)
+    : options_(std::move(options))
+    , stopping_(false)
+{
+    std::error_code error;
+    fs::create_directories(options_.root, error);
+    changelog_.Load(ChangelogPath(options_.root));
+    // 上次发布的版本，目录不全时当作从头开始
+    fs::path manifest = CurrentManifestPath(options_.root);
+    if (!manifest.empty()) {
+        current_ = ManifestSnapshot::Map(manifest);
+    }
+}
+
+EdgeMirror::~EdgeMirror() {
+    Stop();
+}
+
+fs::path EdgeMirror::ManifestPath(const fs::path& root, std::uint64_t generation) {
+    return root / (std::to_string(generation) + ".manifest");
+}
+
+fs::path EdgeMirror::CurrentManifestPath(const fs::path& root) {
+    std::error_code error;
+    std::uint64_t latest = 0;
+    for (const auto& item : fs::directory_iterator(root, error)) {
+        std::uint64_t generation = ParseGeneration(item.path().filename().string(), ".manifest");
+        if (generation > latest && fs::is_directory(VersionDirectory(root, generation), error)) {
+            latest = generation;
+        }
+    }
+    return latest == 0 ? fs::path() : ManifestPath(root, latest);
+}
+
+fs::path EdgeMirror::ChangelogPath(const fs::path& root) {
+    return root / "Edge.changelog";
+}
+
+fs::path EdgeMirror::VersionDirectory(const fs::path& root, std::uint64_t generation) {
+    return root / std::to_string(generation);
+}
+
+void EdgeMirror::Start() {
+    thread_ = std::thread([this]() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            lock.unlock();
+            ReplicateOnce();
+            lock.lock();
+            wakeup_.wait_for(lock, options_.pollInterval, [this]() { return stopping_; });
+        }
+    });
+}
+
+void EdgeMirror::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        if (active_) {
+            active_->Abort();
+        }
+    }
+    wakeup_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+EdgeMirrorStats EdgeMirror::GetStats() const {
+    return { rounds_.load(), failures_.load(), releases_.load(), fullFiles_.load(), patchedFiles_.load(),
+             receivedBytes_.load(), originVersion_.load() };
+}
+
+std::string EdgeMirror::Hello() const {
+    return Command::EDGE_HELLO + options_.advertiseIP + "|" + std::to_string(options_.advertisePort) + "|"
+        + options_.name + "|" + std::to_string(originVersion_.load()) + "|" + END_OF_MESSAGE;
+}
+
+bool EdgeMirror::ReplicateOnce() {
+    auto connection = std::make_shared<Connection>();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return false;
+        }
+        active_ = connection;
+    }
+
+    bool published = false;
+    try {
+        connection->Connect(options_.originHost, options_.originPort);
+        ++rounds_;
+        published = Replicate(*connection);
+    }
+    catch (const std::exception&) {
+        // 连不上、断线、回复不对或者文件校验失败，都等下一轮从头再来
+        ++failures_;
+    }
+    std::error_code error;
+    fs::remove_all(options_.root / "incoming", error);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    active_.reset();
+    return published;
+}
+
+bool EdgeMirror::Replicate(Connection& connection) {
+    std::string header;
+
+    // 1. 报到，顺便问源服务器的当前版本
+    connection.Send(Hello());
+    if (connection.ReadHeader(header) || !StartsWith(header, Command::EDGE_ACCEPTED)) {
+        throw std::runtime_error("origin rejected EDGE_HELLO");
+    }
+    std::string_view fields(header);
+    fields.remove_prefix(Command::EDGE_ACCEPTED.size());
+    std::uint64_t originVersion = ParseNumber(NextField(fields));
+    if (originVersion == 0 || (current_ && originVersion == originVersion_)) {
+        return false;
+    }
+
+    // 2. 源服务器的完整清单
+    connection.Send(Command::REQUEST + "1|" + Command::GET_MANIFEST + END_OF_MESSAGE);
+    std::string encoded;
+    for (;;) {
+        bool hasContent = connection.ReadHeader(header);
+        if (hasContent && StartsWith(header, Command::MANIFEST)) {
+            std::string_view size(header);
+            size.remove_prefix(Command::MANIFEST.size());
+            connection.ReadContent(ParseNumber(NextField(size)), [&](const char* data, std::size_t length) {
+                encoded.append(data, length);
+            });
+        }
+        else if (hasContent) {
+            throw std::runtime_error("unexpected content from origin");
+        }
+        else if (StartsWith(header, Command::REQUEST_DONE)) {
+            break;
+        }
+    }
+    BinaryManifestReader manifest;
+    if (encoded.empty() || !manifest.Parse(encoded)) {
+        throw std::runtime_error("bad manifest from origin");
+    }
+    std::unordered_map<std::string, std::size_t> originFiles;
+    originFiles.reserve(manifest.Count());
+    bool unchanged = current_ && current_->Count() == manifest.Count();
+    for (std::size_t i = 0; i < manifest.Count(); ++i) {
+        std::string_view name = manifest.Name(i);
+        if (!IsSafeName(name)) {
+            throw std::runtime_error("unsafe file name from origin");
+        }
+        std::size_t hash = static_cast<std::size_t>(manifest.Hash(i));
+        originFiles.emplace(std::string(name), hash);
+        if (unchanged) {
+            std::size_t index = current_->Find(name);
+            unchanged = index != ManifestSnapshot::npos && current_->At(index).hashed && current_->At(index).hash == hash;
+        }
+    }
+    if (unchanged) {
+        // 源服务器换了版本号但文件没变（比如重启后重新记录），只记下版本
+        originVersion_ = originVersion;
+        connection.Send(Hello());
+        return false;
+    }
+
+    // 3. 报告本地当前版本，只收变化的文件；补丁打不上的文件再要一次完整的
+    fs::path incoming = options_.root / "incoming";
+    fs::path source = current_ ? VersionDirectory(options_.root, current_->Generation()) : fs::path();
+    std::error_code error;
+    fs::remove_all(incoming, error);
+    fs::create_directories(incoming);
+
+    std::unordered_set<std::string> received;
+    std::vector<std::string> failedPatches;
+    connection.Send(Command::ENABLE_DIFFS + END_OF_MESSAGE);
+    for (int request = 2; ; ++request) {
+        std::string local;
+        if (request == 2) {
+            std::size_t count = 0;
+            for (std::size_t i = 0; current_ && i < current_->Count(); ++i) {
+                count += current_->At(i).hashed ? 1 : 0;
+            }
+            BinaryManifestWriter writer(local, count);
+            for (std::size_t i = 0; current_ && i < current_->Count(); ++i) {
+                ManifestSnapshot::Entry entry = current_->At(i);
+                if (entry.hashed) {
+                    writer.Add(entry.name, entry.hash);
+                }
+            }
+            writer.Finish();
+        }
+        else {
+            // 声称已经有了其余所有文件的新版本，源服务器只会整个发送补丁失败的那些
+            std::unordered_set<std::string_view> retry(failedPatches.begin(), failedPatches.end());
+            BinaryManifestWriter writer(local, manifest.Count() - retry.size());
+            for (std::size_t i = 0; i < manifest.Count(); ++i) {
+                if (retry.count(manifest.Name(i)) == 0) {
+                    writer.Add(manifest.Name(i), manifest.Hash(i));
+                }
+            }
+            writer.Finish();
+            failedPatches.clear();
+        }
+        connection.Send(Command::REQUEST + std::to_string(request) + "|" + Command::CHECK_PATCHES_BIN
+                        + std::to_string(local.size()) + "|" + END_OF_MESSAGE);
+        connection.Send(local);
+
+        for (;;) {
+            bool hasContent = connection.ReadHeader(header);
+            if (!hasContent) {
+                if (StartsWith(header, Command::REQUEST_DONE)) {
+                    break;
+                }
+                if (StartsWith(header, "ERROR|")) {
+                    throw std::runtime_error("origin returned an error");
+                }
+                // DIFFS_ENABLED、DELETE_FILES：新版本只由源服务器的清单决定，不用处理
+                continue;
+            }
+
+            bool patch = StartsWith(header, Command::PATCH_FILES);
+            if (!patch && !StartsWith(header, Command::UPDATE_FILES)) {
+                throw std::runtime_error("unexpected content from origin");
+            }
+            std::string_view fields(header);
+            fields.remove_prefix(patch ? Command::PATCH_FILES.size() : Command::UPDATE_FILES.size());
+            std::string name(NextField(fields));
+            std::uint64_t size = ParseNumber(NextField(fields));
+            if (originFiles.count(name) == 0) {
+                throw std::runtime_error("origin sent a file outside its manifest");
+            }
+            fs::path target = incoming / name;
+            fs::create_directories(target.parent_path());
+
+            if (!patch) {
+                std::ofstream file(target, std::ios::binary | std::ios::trunc);
+                connection.ReadContent(size, [&](const char* data, std::size_t length) {
+                    file.write(data, static_cast<std::streamsize>(length));
+                });
+                if (!file.flush()) {
+                    throw std::runtime_error("cannot write " + target.string());
+                }
+                ++fullFiles_;
+            }
+            else {
+                std::string diff;
+                connection.ReadContent(size, [&](const char* data, std::size_t length) {
+                    diff.append(data, length);
+                });
+                std::string old;
+                std::string patched;
+                if (source.empty() || !ReadWholeFile(source / name, old) || !ApplyBinaryDiff(old, diff, patched)) {
+                    failedPatches.push_back(name);
+                    continue;
+                }
+                std::ofstream file(target, std::ios::binary | std::ios::trunc);
+                if (!file.write(patched.data(), static_cast<std::streamsize>(patched.size()))) {
+                    throw std::runtime_error("cannot write " + target.string());
+                }
+                ++patchedFiles_;
+            }
+            receivedBytes_ += size;
+            received.insert(std::move(name));
+        }
+        if (failedPatches.empty()) {
+            break;
+        }
+    }
+
+    // 4. 没变的文件硬链接自当前版本，跨卷等链接不了时复制；所有文件都要和源服务器的哈希一致
+    std::vector<ManifestEntry> entries;
+    entries.reserve(manifest.Count());
+    for (std::size_t i = 0; i < manifest.Count(); ++i) {
+        ManifestEntry entry;
+        entry.name.assign(manifest.Name(i));
+        entry.hash = static_cast<std::size_t>(manifest.Hash(i));
+        entry.hashed = true;
+        fs::path target = incoming / entry.name;
+
+        if (received.count(entry.name) != 0) {
+            std::size_t hash = 0;
+            if (!HashDataFileContent(target, hash) || hash != entry.hash) {
+                throw std::runtime_error("hash mismatch for " + entry.name);
+            }
+        }
+        else {
+            std::size_t index = current_ ? current_->Find(entry.name) : ManifestSnapshot::npos;
+            if (index == ManifestSnapshot::npos || current_->At(index).hash != entry.hash) {
+                throw std::runtime_error("origin did not send " + entry.name);
+            }
+            fs::create_directories(target.parent_path());
+            fs::create_hard_link(source / entry.name, target, error);
+            if (error) {
+                fs::copy_file(source / entry.name, target, fs::copy_options::overwrite_existing);
+            }
+        }
+        entry.size = fs::file_size(target);
+        entries.push_back(std::move(entry));
+    }
+
+    Publish(std::move(entries), originVersion);
+    connection.Send(Hello());
+    return true;
+}
+
+void EdgeMirror::Publish(std::vector<ManifestEntry>&& entries, std::uint64_t originVersion) {
+    // 先写日志再发布清单，本机的 TcpServer 读到新清单时日志已经是新的
+    std::uint64_t generation = changelog_.Record(current_.get(), entries);
+    std::uint64_t previous = current_ ? current_->Generation() : 0;
+    if (generation == previous) {
+        originVersion_ = originVersion;
+        return;
+    }
+    fs::path directory = VersionDirectory(options_.root, generation);
+    fs::path manifest = ManifestPath(options_.root, generation);
+    std::error_code error;
+    fs::remove_all(directory, error);
+    fs::rename(options_.root / "incoming", directory, error);
+
+    // 新一代的清单换个文件名写出，不用替换 TcpServer 映射着的清单。
+    // 失败时撤掉这一代：日志里多记的版本和 current_ 对不上，下一轮记录时历史作废重新编号，
+    // 本机的 TcpServer 仍停在当前版本，SYNC 的客户端改做一次完整对比
+    std::shared_ptr<const ManifestSnapshot> snapshot;
+    if (!error) {
+        snapshot = ManifestSnapshot::Build(std::move(entries), generation);
+        if (!snapshot->Save(manifest)) {
+            snapshot.reset();
+        }
+    }
+    if (!snapshot) {
+        fs::remove(manifest, error);
+        fs::remove_all(directory, error);
+        throw std::runtime_error("cannot publish edge version " + std::to_string(generation));
+    }
+
+    // 保留新版本和刚换下的版本，换下的版本上还可能有排队中的传输。
+    // 还映射着的旧清单在 Windows 上可能删不掉，下次发布再试
+    std::vector<fs::path> stale;
+    for (const auto& item : fs::directory_iterator(options_.root, error)) {
+        std::string name = item.path().filename().string();
+        std::uint64_t version = item.is_directory(error) ? ParseGeneration(name, "") : ParseGeneration(name, ".manifest");
+        if (version != 0 && version != generation && version != previous) {
+            stale.push_back(item.path());
+        }
+    }
+    for (const auto& path : stale) {
+        fs::remove_all(path, error);
+    }
+
+    current_ = std::move(snapshot);
+    originVersion_ = originVersion;
+    ++releases_;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "ManifestFile.h"
+#include "ManifestChangelog.h"
+
+// 标准库
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 边缘模式的配置
+struct EdgeOptions {
+    std::string originHost = "127.0.0.1";
+    short originPort = 12345;
+    std::string advertiseIP;                        // 源服务器向玩家推荐本机时给出的地址和端口
+    short advertisePort = 12345;
+    std::string name;
+    std::filesystem::path root = "Edge";            // 各版本的目录和清单
+    std::chrono::seconds pollInterval{ 30 };
+};
+
+// 边缘复制的运行统计
+struct EdgeMirrorStats {
+    std::uint64_t rounds;           // 连上源服务器的轮数
+    std::uint64_t failures;         // 连接失败或中途出错的轮数
+    std::uint64_t releases;         // 换上的新版本数
+    std::uint64_t fullFiles;        // 整个收下的文件
+    std::uint64_t patchedFiles;     // 用补丁更新的文件
+    std::uint64_t receivedBytes;
+    std::uint64_t originVersion;    // 当前版本对应的源服务器版本，0 表示还没复制过
+};
+
+// 边缘服务器的复制端：作为一个特殊的客户端连到源服务器，把源服务器的数据文件复制到本地，
+// 本机的 TcpServer 以镜像方式从本地副本为玩家服务（见 WindowManager.h）。每一轮：
+//   1. EDGE_HELLO 报告本机地址和已经复制到的源版本，源服务器回复它的当前版本，没变就结束
+//   2. GET_MANIFEST 取源服务器的完整清单，和本地当前版本相同时只记下版本
+//   3. 开启 ENABLE_DIFFS 后用 CHECK_PATCHES_BIN 报告本地当前版本，只收变化的文件；
+//      本地是源服务器保留的旧版本时收到的是补丁（见 ReleaseStore.h）
+//   4. 在 <root>/incoming/ 下拼出新版本：没变的文件硬链接自当前版本目录，收到的文件直接写入。
+//      每个文件的哈希都和清单一致后记入本地变化日志，改名为 <root>/<代数>/，最后写出 <root>/<代数>.manifest
+// 每一代的清单各是一个文件：TcpServer 和本类都映射着当前清单，Windows 上映射着的文件不能被改名替换。
+// 本机的 TcpServer 在空闲清理时发现代数更大的清单后整体换上新版本，已经排队的文件仍从旧目录读取；
+// 更早的版本目录和清单在下一次发布时删除。任何一步失败都不发布，已经改好名的目录也撤掉，等下一轮重来。
+// 发布后再发一次 EDGE_HELLO，源服务器随即在 INIT_SERVER_INFO|EDGES| 的回复里推荐本机
+class EdgeMirror {
+public:
+    explicit EdgeMirror(EdgeOptions options);
+    ~EdgeMirror();
+    EdgeMirror(const EdgeMirror&) = delete;
+    EdgeMirror& operator=(const EdgeMirror&) = delete;
+
+    // 在后台线程上立即复制一轮，之后每隔 pollInterval 一轮
+    void Start();
+    void Stop();
+
+    // 在调用线程上复制一轮，发布了新版本时返回 true
+    bool ReplicateOnce();
+
+    EdgeMirrorStats GetStats() const;
+
+    // 本地清单、变化日志和各版本目录的位置，镜像方式的 TcpServer 也从这里找
+    static std::filesystem::path ManifestPath(const std::filesystem::path& root, std::uint64_t generation);
+    // 已发布的最新一代的清单，清单和版本目录都在才算；还没有时返回空路径
+    static std::filesystem::path CurrentManifestPath(const std::filesystem::path& root);
+    static std::filesystem::path ChangelogPath(const std::filesystem::path& root);
+    static std::filesystem::path VersionDirectory(const std::filesystem::path& root, std::uint64_t generation);
+
+private:
+    class Connection;
+
+    // 出错时抛出异常，已经收下的文件留在 incoming 里，由调用方清掉
+    bool Replicate(Connection& connection);
+    // incoming 已经完整并校验过，记入变化日志后换上
+    void Publish(std::vector<ManifestEntry>&& entries, std::uint64_t originVersion);
+    std::string Hello() const;
+
+    EdgeOptions options_;
+    std::shared_ptr<const ManifestSnapshot> current_;   // 本地当前版本，只在复制线程上使用
+    ManifestChangelog changelog_;
+    std::atomic<std::uint64_t> originVersion_{ 0 };
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    bool stopping_;
+    std::shared_ptr<Connection> active_;                // 正在用的连接，Stop 时关闭以打断阻塞的读取
+
+    std::atomic<std::uint64_t> rounds_{ 0 };
+    std::atomic<std::uint64_t> failures_{ 0 };
+    std::atomic<std::uint64_t> releases_{ 0 };
+    std::atomic<std::uint64_t> fullFiles_{ 0 };
+    std::atomic<std::uint64_t> patchedFiles_{ 0 };
+    std::atomic<std::uint64_t> receivedBytes_{ 0 };
+};
@@ -0,0 +1,140 @@
+#include "FileCache.h"
+
+#include <cstring>
+
+namespace {
+    // 记录“未命中过一次”的块数上限，超过后清空重新统计
+    const std::size_t MAX_SEEN_CHUNKS = 64 * 1024;
+}
+
+FileCache::FileCache(std::size_t budgetBytes)
+    : budgetBytes_(budgetBytes)
+    , residentBytes_(0)
+    , seenCount_(0)
+    , hits_(0)
+    , misses_(0)
+{
+}
+
+std::shared_ptr<const FileChunk> FileCache::Find(const std::string& path, std::size_t contentHash,
+                                                 std::uint64_t chunkIndex) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto fileIt = files_.find(path);
+    if (fileIt != files_.end() && fileIt->second->contentHash == contentHash) {
+        auto chunkIt = fileIt->second->chunks.find(chunkIndex);
+        if (chunkIt != fileIt->second->chunks.end()) {
+            // 移到 LRU 头部
+            lru_.splice(lru_.begin(), lru_, chunkIt->second);
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return chunkIt->second->chunk;
+        }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+bool FileCache::Contains(const std::string& path, std::size_t contentHash, std::uint64_t chunkIndex) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto fileIt = files_.find(path);
+    return fileIt != files_.end() && fileIt->second->contentHash == contentHash
+        && fileIt->second->chunks.count(chunkIndex) != 0;
+}
+
+std::shared_ptr<const FileChunk> FileCache::Admit(const std::string& path, std::size_t contentHash,
+                                                  std::uint64_t chunkIndex, const char* data, std::size_t size,
+                                                  bool hot) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (size == 0 || size > budgetBytes_) {
+        return nullptr;
+    }
+
+    FileEntry& file = GetFileEntry(path, contentHash);
+    auto existing = file.chunks.find(chunkIndex);
+    if (existing != file.chunks.end()) {
+        return existing->second->chunk;
+    }
+
+    // 第一次未命中只做记录
+    if (file.seen.erase(chunkIndex) != 0) {
+        --seenCount_;
+    }
+    else if (!hot) {
+        file.seen.insert(chunkIndex);
+        if (++seenCount_ > MAX_SEEN_CHUNKS) {
+            // 清空后没有缓存块的文件项也一起删掉，file 此后不再使用
+            for (auto it = files_.begin(); it != files_.end();) {
+                it->second->seen.clear();
+                it = it->second->chunks.empty() ? files_.erase(it) : std::next(it);
+            }
+            seenCount_ = 0;
+        }
+        return nullptr;
+    }
+
+    auto chunk = std::make_shared<FileChunk>();
+    chunk->data.reset(new char[size]);
+    chunk->size = size;
+    std::memcpy(chunk->data.get(), data, size);
+
+    lru_.push_front(LruItem{ &file, chunkIndex, chunk });
+    file.chunks[chunkIndex] = lru_.begin();
+    residentBytes_ += size;
+    EvictToBudget();
+    return chunk;
+}
+
+void FileCache::SetBudget(std::size_t budgetBytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    budgetBytes_ = budgetBytes;
+    EvictToBudget();
+}
+
+FileCacheStats FileCache::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    FileCacheStats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.residentBytes = residentBytes_;
+    stats.budgetBytes = budgetBytes_;
+    stats.chunkCount = lru_.size();
+    return stats;
+}
+
+FileCache::FileEntry& FileCache::GetFileEntry(const std::string& path, std::size_t contentHash) {
+    auto& entry = files_[path];
+    if (!entry) {
+        entry.reset(new FileEntry());
+        entry->path = path;
+        entry->contentHash = contentHash;
+    }
+    else if (entry->contentHash != contentHash) {
+        // 文件内容已经变化，旧块全部作废
+        DropChunks(*entry);
+        seenCount_ -= entry->seen.size();
+        entry->seen.clear();
+        entry->contentHash = contentHash;
+    }
+    return *entry;
+}
+
+void FileCache::DropChunks(FileEntry& file) {
+    for (auto& chunk : file.chunks) {
+        residentBytes_ -= chunk.second->chunk->size;
+        lru_.erase(chunk.second);
+    }
+    file.chunks.clear();
+}
+
+void FileCache::EvictToBudget() {
+    while (residentBytes_ > budgetBytes_ && !lru_.empty()) {
+        LruItem& victim = lru_.back();
+        FileEntry* file = victim.file;
+        residentBytes_ -= victim.chunk->size;
+        file->chunks.erase(victim.chunkIndex);
+        lru_.pop_back();
+        // 最后一块被淘汰、也没有待定的块时删掉文件项，换过很多版本的文件名不会一直留在表里
+        if (file->chunks.empty() && file->seen.empty()) {
+            files_.erase(files_.find(file->path));
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "BufferPool.h"
+
+// 标准库
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// 只读的文件数据块，可被多个会话同时发送。
+// 缓存里的块自带内存；读盘合并时直接接管领读者的缓冲池块，不再复制
+struct FileChunk {
+    std::unique_ptr<char[]> data;
+    PooledBuffer slab;
+    std::size_t size;
+
+    const char* Data() const { return data ? data.get() : slab.Data(); }
+};
+
+// 文件缓存的运行统计
+struct FileCacheStats {
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::size_t residentBytes;
+    std::size_t budgetBytes;
+    std::size_t chunkCount;
+};
+
+// 热点文件的块缓存，按 LRU 淘汰，总大小不超过字节预算。
+// 缓存项以文件路径 + 内容哈希 + 块序号为键，文件内容变化后旧块自然失效。
+// 一个块第二次未命中才会被放进缓存，一次性的大文件扫描不会把热数据冲掉。
+class FileCache {
+public:
+    explicit FileCache(std::size_t budgetBytes);
+
+    std::shared_ptr<const FileChunk> Find(const std::string& path, std::size_t contentHash,
+                                          std::uint64_t chunkIndex);
+
+    // 只查询是否已缓存，不计入命中统计，也不调整 LRU 顺序
+    bool Contains(const std::string& path, std::size_t contentHash, std::uint64_t chunkIndex) const;
+
+    // 未命中的块读盘完成后调用；决定缓存时返回共享块，否则返回空指针。
+    // hot 表示多个会话同时在要这一块，跳过“第二次未命中”的准入规则
+    std::shared_ptr<const FileChunk> Admit(const std::string& path, std::size_t contentHash,
+                                           std::uint64_t chunkIndex, const char* data, std::size_t size,
+                                           bool hot);
+
+    void SetBudget(std::size_t budgetBytes);
+    FileCacheStats GetStats() const;
+
+private:
+    struct FileEntry;
+
+    struct LruItem {
+        FileEntry* file;
+        std::uint64_t chunkIndex;
+        std::shared_ptr<const FileChunk> chunk;
+    };
+    using LruList = std::list<LruItem>;
+
+    struct FileEntry {
+        std::string path;
+        std::size_t contentHash;
+        std::unordered_map<std::uint64_t, LruList::iterator> chunks;
+        std::unordered_set<std::uint64_t> seen;   // 未命中过一次、尚未缓存的块
+    };
+
+    FileEntry& GetFileEntry(const std::string& path, std::size_t contentHash);  // 调用方需持有 mutex_
+    void DropChunks(FileEntry& file);                                           // 调用方需持有 mutex_
+    void EvictToBudget();                                                       // 调用方需持有 mutex_，可能删除文件项
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::unique_ptr<FileEntry>> files_;
+    LruList lru_;   // 头部最近使用
+    std::size_t budgetBytes_;
+    std::size_t residentBytes_;
+    std::size_t seenCount_;
+
+    std::atomic<std::uint64_t> hits_;
+    std::atomic<std::uint64_t> misses_;
+};
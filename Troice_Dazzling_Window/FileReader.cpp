@@ -0,0 +1,142 @@
+#include "FileReader.h"
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // 任一会话探测到异步文件后端不可用后，整个进程都改用缓冲读取
+    std::atomic<bool> g_asyncFileAvailable{ true };
+}
+
+FileReader::FileReader(const asio::any_io_executor& executor, DiskIoPool& diskPool)
+    : executor_(executor)
+    , diskPool_(diskPool)
+    , usingAsyncFile_(false)
+    , willNeedBytes_(0)
+    , cancelled_(false)
+{
+#if defined(ASIO_HAS_FILE)
+    if (AsyncFileAvailable()) {
+        try {
+            // io_uring 初始化失败时这里会抛出异常
+            file_.emplace(executor_);
+            usingAsyncFile_ = true;
+        }
+        catch (const std::exception&) {
+            DisableAsyncFile();
+        }
+    }
+#endif
+}
+
+bool FileReader::AsyncFileAvailable() {
+    return g_asyncFileAvailable.load(std::memory_order_relaxed);
+}
+
+const char* FileReader::AsyncFileBackendName() {
+#if defined(ASIO_HAS_IO_URING)
+    return "io_uring";
+#elif defined(ASIO_HAS_FILE) && defined(_WIN32)
+    return "IOCP";
+#else
+    return nullptr;
+#endif
+}
+
+void FileReader::DisableAsyncFile() {
+    g_asyncFileAvailable.store(false, std::memory_order_relaxed);
+}
+
+asio::error_code FileReader::Open(const std::string& path, std::uint64_t& size) {
+    Close();
+    path_ = path;
+
+#if defined(ASIO_HAS_FILE)
+    if (usingAsyncFile_ && AsyncFileAvailable()) {
+        asio::error_code ec;
+        file_->open(path, asio::random_access_file::read_only, ec);
+        if (!ec) {
+#if defined(ASIO_HAS_IO_URING)
+            // asio 按随机访问打开文件并关掉了预读，传输是从头到尾顺序读的，改回顺序预读
+            ::posix_fadvise(file_->native_handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+            size = file_->size(ec);
+            if (!ec) {
+                return ec;
+            }
+            asio::error_code ignored;
+            file_->close(ignored);
+        }
+        return ec;
+    }
+    usingAsyncFile_ = false;
+#endif
+
+    stream_.open(path, std::ios::binary);
+    if (!stream_.is_open()) {
+        stream_.clear();
+        return asio::error::make_error_code(asio::error::not_found);
+    }
+
+    // 获取文件大小
+    stream_.seekg(0, std::ios::end);
+    size = static_cast<std::uint64_t>(stream_.tellg());
+    stream_.seekg(0, std::ios::beg);
+    return asio::error_code();
+}
+
+void FileReader::Close() {
+#if defined(ASIO_HAS_FILE)
+    if (file_ && file_->is_open()) {
+        asio::error_code ec;
+        file_->close(ec);
+    }
+#endif
+    if (stream_.is_open()) {
+        stream_.close();
+    }
+    stream_.clear();
+}
+
+asio::error_code FileReader::ReadBuffered(std::uint64_t offset, char* data, std::size_t length) {
+    if (!stream_.is_open()) {
+        // 从异步后端切换过来时文件还没有用流打开
+        stream_.open(path_, std::ios::binary);
+        if (!stream_.is_open()) {
+            stream_.clear();
+            return asio::error::make_error_code(asio::error::not_found);
+        }
+    }
+
+    stream_.clear();
+    stream_.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+    stream_.read(data, static_cast<std::streamsize>(length));
+    if (static_cast<std::size_t>(stream_.gcount()) < length) {
+        // 文件在发送途中被截断或替换，补出来的内容会带着旧哈希发出去，不如直接失败
+        return asio::error::make_error_code(asio::error::eof);
+    }
+    return asio::error_code();
+}
+
+void FileReader::AdviseWillNeed(const std::string& path, std::uint64_t size) {
+#if defined(__linux__)
+    if (willNeedBytes_ == 0) {
+        return;
+    }
+    // 页缓存按文件共享，单独打开一次发提示即可，不影响两种读取后端
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        std::uint64_t length = std::min(size, willNeedBytes_);
+        ::posix_fadvise(fd, 0, static_cast<off_t>(length), POSIX_FADV_WILLNEED);
+        ::close(fd);
+    }
+#else
+    (void)path;
+    (void)size;
+#endif
+}
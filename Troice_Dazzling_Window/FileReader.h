@@ -0,0 +1,190 @@
+#pragma once
+
+// ASIO 相关定义
+#define ASIO_STANDALONE
+#define ASIO_NO_WIN32_LEAN_AND_MEAN
+#include <asio.hpp>
+#include "DiskIoPool.h"
+
+// 标准库
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+
+// 文件读取后端
+enum class FileReadBackend {
+    Buffered,     // std::ifstream 阻塞读取，在磁盘线程上执行
+    AsyncFile     // asio::random_access_file：Windows 上是 IOCP，Linux 上是 io_uring
+};
+
+// 按偏移异步读取单个文件，供文件传输使用。
+// asio 支持文件 I/O（ASIO_HAS_FILE）时使用 random_access_file，读请求交给内核，网络线程不会阻塞。
+// Windows 上 asio 默认开启 ASIO_HAS_FILE，走 IOCP；Linux 上 CMake 找到 liburing 时定义 ASIO_HAS_IO_URING，走 io_uring。
+// io_uring 的读请求先放进提交队列，网络线程这一轮处理器都跑完后才一次 io_uring_enter 提交，
+// 所以同一轮里各个会话发起的读取（每个活跃传输各一块）是一起提交给内核的。
+// 没有 liburing 的构建、内核不支持 io_uring 或后端初始化失败时走磁盘线程上的缓冲读取；
+// 提交队列满时只有这一次读取改走缓冲读取。
+// 打开、取大小以及缓冲读取都在 DiskIoPool 上执行，完成回调回到构造时给定的执行器。
+// 调用方需保证同一时刻只有一个未完成的操作。
+// 处理器关联了取消槽时操作可以取消：异步文件读取交给 asio 取消，
+// 排在磁盘线程上的任务在执行前检查取消标记，直接以 operation_aborted 完成。
+// 取消标记置上后不再清除，之后交给磁盘线程的操作都直接失败。
+class FileReader {
+public:
+    FileReader(const asio::any_io_executor& executor, DiskIoPool& diskPool);
+
+    // 打开文件并取得大小，完成后调用 handler(error, size)
+    template <typename Handler>
+    void AsyncOpen(const std::string& path, Handler handler);
+    void Close();
+
+    // 之后打开文件时提示内核预读开头的 bytes 字节（Linux 上为 posix_fadvise WILLNEED），
+    // 0 表示不提示。Windows 没有对应的提示，靠调用方自己预读数据块
+    void SetWillNeedHint(std::uint64_t bytes) { willNeedBytes_ = bytes; }
+
+    // 从 offset 读取 length 字节到 data。文件在发送途中被截断、读不满 length 时以 asio::error::eof 失败，
+    // 剩下的部分已经无法和包头里的大小、清单里的哈希对上，调用方应放弃这次传输。
+    // 完成后在构造时给定的执行器上调用 handler(error)，并保留 handler 关联的分配器。
+    template <typename Handler>
+    void AsyncRead(std::uint64_t offset, char* data, std::size_t length, Handler handler);
+
+    FileReadBackend Backend() const {
+        return usingAsyncFile_ ? FileReadBackend::AsyncFile : FileReadBackend::Buffered;
+    }
+
+    // 进程内是否仍允许使用异步文件后端
+    static bool AsyncFileAvailable();
+
+    // 这次构建编进来的异步文件后端名称，没有时为 nullptr
+    static const char* AsyncFileBackendName();
+
+private:
+    static void DisableAsyncFile();
+    asio::error_code Open(const std::string& path, std::uint64_t& size);
+    asio::error_code ReadBuffered(std::uint64_t offset, char* data, std::size_t length);
+    void AdviseWillNeed(const std::string& path, std::uint64_t size);
+
+    // 在磁盘线程上执行 work()，再把结果投递回执行器交给 handler。
+    // 已经取消时不执行 work()，改用 aborted 作为结果；磁盘队列已满时同样用 aborted，错误换成 no_buffer_space
+    template <typename Work, typename Result, typename Handler>
+    void RunOnDiskPool(Work work, Result aborted, Handler handler);
+
+    asio::any_io_executor executor_;
+    DiskIoPool& diskPool_;
+#if defined(ASIO_HAS_FILE)
+    std::optional<asio::random_access_file> file_;
+#endif
+    std::ifstream stream_;
+    std::string path_;
+    bool usingAsyncFile_;
+    std::uint64_t willNeedBytes_;
+    std::atomic<bool> cancelled_;
+};
+
+template <typename Work, typename Result, typename Handler>
+void FileReader::RunOnDiskPool(Work work, Result aborted, Handler handler) {
+    // 取消槽的回调在会话的执行器上调用，这里只置标记，由磁盘线程在执行前检查
+    auto slot = asio::get_associated_cancellation_slot(handler);
+    if (slot.is_connected()) {
+        slot.assign([this](asio::cancellation_type) { cancelled_.store(true); });
+    }
+
+    // 磁盘线程上执行的任务。队列满时 Post 不会移走它，处理器留在这里以 no_buffer_space 回调
+    struct Task {
+        FileReader* reader;
+        asio::any_io_executor executor;
+        Work work;
+        Result result;
+        Handler handler;
+
+        void operator()() {
+            if (!reader->cancelled_.load()) {
+                result = work();
+            }
+            Complete();
+        }
+
+        void Complete() {
+            auto allocator = asio::get_associated_allocator(handler);
+            asio::post(executor, asio::bind_allocator(allocator,
+                [handler = std::move(handler), result = std::move(result)]() mutable {
+                    auto slot = asio::get_associated_cancellation_slot(handler);
+                    if (slot.is_connected()) {
+                        slot.clear();
+                    }
+                    std::apply(handler, std::move(result));
+                }));
+        }
+    };
+
+    Task task{ this, executor_, std::move(work), std::move(aborted), std::move(handler) };
+    if (!diskPool_.Post(std::move(task))) {
+        std::get<0>(task.result) = asio::error::no_buffer_space;
+        task.Complete();
+    }
+}
+
+template <typename Handler>
+void FileReader::AsyncOpen(const std::string& path, Handler handler) {
+    RunOnDiskPool(
+        [this, path]() {
+            std::uint64_t size = 0;
+            asio::error_code error = Open(path, size);
+            if (!error) {
+                AdviseWillNeed(path, size);
+            }
+            return std::make_tuple(error, size);
+        },
+        std::make_tuple(asio::error_code(asio::error::operation_aborted), std::uint64_t(0)),
+        std::move(handler));
+}
+
+template <typename Handler>
+void FileReader::AsyncRead(std::uint64_t offset, char* data, std::size_t length, Handler handler) {
+#if defined(ASIO_HAS_FILE)
+    if (usingAsyncFile_) {
+        // 把处理器的分配器和取消槽都转给内部的读取操作
+        auto allocator = asio::get_associated_allocator(handler);
+        auto slot = asio::get_associated_cancellation_slot(handler);
+        asio::async_read_at(*file_, offset, asio::buffer(data, length),
+            asio::bind_cancellation_slot(slot, asio::bind_allocator(allocator,
+                [this, offset, data, length, handler = std::move(handler)](
+                    const asio::error_code& error, std::size_t count) mutable {
+                    if (error == asio::error::operation_not_supported) {
+                        // 内核的 io_uring 不支持读操作，改用缓冲读取重试
+                        DisableAsyncFile();
+                        usingAsyncFile_ = false;
+                        AsyncRead(offset, data, length, std::move(handler));
+                        return;
+                    }
+                    if (error == asio::error::no_buffer_space) {
+                        // io_uring 提交队列满，这一块交给磁盘线程，下一块再试异步读取
+                        RunOnDiskPool(
+                            [this, offset, data, length]() {
+                                return std::make_tuple(ReadBuffered(offset, data, length));
+                            },
+                            std::make_tuple(asio::error_code(asio::error::operation_aborted)),
+                            std::move(handler));
+                        return;
+                    }
+                    if (!error && count < length) {
+                        handler(asio::error_code(asio::error::eof));
+                        return;
+                    }
+                    handler(error);
+                })));
+        return;
+    }
+#endif
+
+    RunOnDiskPool(
+        [this, offset, data, length]() {
+            return std::make_tuple(ReadBuffered(offset, data, length));
+        },
+        std::make_tuple(asio::error_code(asio::error::operation_aborted)),
+        std::move(handler));
+}
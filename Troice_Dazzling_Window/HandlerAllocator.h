@@ -0,0 +1,128 @@
+#pragma once
+
+// ASIO 相关定义
+#define ASIO_STANDALONE
+#define ASIO_NO_WIN32_LEAN_AND_MEAN
+#include <asio.hpp>
+
+// 标准库
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// 每个会话为一条异步操作链保留的处理器内存。
+// 同一时刻一条链上只有一个未完成的操作，所以一块固定大小的存储就能反复使用，
+// 稳态下读写回调不再走堆分配；放不下或已被占用时退回到 operator new。
+// 存储在第一次使用时才分配，长时间空闲的会话可以用 Trim 交还。
+class HandlerMemory {
+public:
+    static const std::size_t DEFAULT_SIZE = 1024;
+
+    HandlerMemory() : HandlerMemory(DEFAULT_SIZE) {}
+    explicit HandlerMemory(std::size_t size) : size_(size), inUse_(false) {}
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    void* Allocate(std::size_t size) {
+        if (!inUse_ && size <= size_) {
+            if (!storage_) {
+                storage_.reset(new Block[(size_ + sizeof(Block) - 1) / sizeof(Block)]);
+            }
+            inUse_ = true;
+            return storage_.get();
+        }
+        return ::operator new(size);
+    }
+
+    void Deallocate(void* pointer) {
+        if (pointer == storage_.get()) {
+            inUse_ = false;
+        }
+        else {
+            ::operator delete(pointer);
+        }
+    }
+
+    // 没有操作在用时释放存储，下次使用时重新分配
+    void Trim() {
+        if (!inUse_) {
+            storage_.reset();
+        }
+    }
+
+    // 当前占用的堆内存
+    std::size_t AllocatedBytes() const { return storage_ ? size_ : 0; }
+
+private:
+    using Block = typename std::aligned_storage<16, alignof(std::max_align_t)>::type;
+
+    std::unique_ptr<Block[]> storage_;
+    std::size_t size_;
+    bool inUse_;
+};
+
+// 满足标准 Allocator 要求的适配器，把分配请求转交给 HandlerMemory
+template <typename T>
+class HandlerAllocator {
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory& memory) : memory_(memory) {}
+
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept : memory_(other.memory_) {}
+
+    bool operator==(const HandlerAllocator& other) const noexcept {
+        return &memory_ == &other.memory_;
+    }
+
+    bool operator!=(const HandlerAllocator& other) const noexcept {
+        return &memory_ != &other.memory_;
+    }
+
+    T* allocate(std::size_t n) const {
+        return static_cast<T*>(memory_.Allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* pointer, std::size_t /*n*/) const {
+        return memory_.Deallocate(pointer);
+    }
+
+private:
+    template <typename> friend class HandlerAllocator;
+
+    HandlerMemory& memory_;
+};
+
+// 包装完成处理器，通过 asio 的 associated_allocator 钩子暴露自定义分配器
+template <typename Handler>
+class CustomAllocHandler {
+public:
+    using allocator_type = HandlerAllocator<Handler>;
+
+    CustomAllocHandler(HandlerMemory& memory, Handler handler)
+        : memory_(memory)
+        , handler_(std::move(handler))
+    {
+    }
+
+    allocator_type get_allocator() const noexcept {
+        return allocator_type(memory_);
+    }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        handler_(std::forward<Args>(args)...);
+    }
+
+private:
+    HandlerMemory& memory_;
+    Handler handler_;
+};
+
+template <typename Handler>
+inline CustomAllocHandler<Handler> MakeCustomAllocHandler(HandlerMemory& memory, Handler handler) {
+    return CustomAllocHandler<Handler>(memory, std::move(handler));
+}
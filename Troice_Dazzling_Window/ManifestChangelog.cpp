@@ -0,0 +1,216 @@
+#include "ManifestChangelog.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+
+const char* const MANIFEST_CHANGELOG_PATH = "Data.changelog";
+
+namespace {
+    const char RESET_MARK = 'R';
+
+    bool ParseVersion(std::string_view text, std::uint64_t& version) {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), version);
+        return result.ec == std::errc() && result.ptr == text.data() + text.size();
+    }
+
+    void WriteLine(std::string& out, std::uint64_t version, char kind, std::string_view name) {
+        out += std::to_string(version);
+        out += '|';
+        out += kind;
+        out += '|';
+        out.append(name);
+        out += '\n';
+    }
+}
+
+ManifestChangelog::ManifestChangelog(std::size_t maxChanges)
+    : maxChanges_(maxChanges)
+    , oldestVersion_(0)
+    , currentVersion_(0)
+{
+}
+
+void ManifestChangelog::Load(const std::filesystem::path& path) {
+    path_ = path;
+    changes_.clear();
+    oldestVersion_ = 0;
+    currentVersion_ = 0;
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return;
+    }
+
+    bool started = false;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        std::size_t first = line.find('|');
+        if (first == std::string::npos || first + 2 >= line.size() || line[first + 2] != '|') {
+            continue;
+        }
+        std::uint64_t version = 0;
+        if (!ParseVersion(std::string_view(line).substr(0, first), version) || version < currentVersion_) {
+            continue;
+        }
+        char kind = line[first + 1];
+        if (kind == RESET_MARK) {
+            changes_.clear();
+            oldestVersion_ = version;
+            currentVersion_ = version;
+            started = true;
+            continue;
+        }
+        if (kind != static_cast<char>(ChangeKind::Add) && kind != static_cast<char>(ChangeKind::Modify)
+            && kind != static_cast<char>(ChangeKind::Delete)) {
+            continue;
+        }
+        changes_.push_back(Change{ version, static_cast<ChangeKind>(kind), line.substr(first + 3) });
+        currentVersion_ = version;
+    }
+
+    // 没有起点的日志不知道从哪个版本开始是完整的，只当作当前版本
+    if (!started) {
+        changes_.clear();
+        oldestVersion_ = currentVersion_;
+    }
+}
+
+std::uint64_t ManifestChangelog::Record(const ManifestSnapshot* previous, const std::vector<ManifestEntry>& current) {
+    if (previous == nullptr || currentVersion_ == 0 || previous->Generation() != currentVersion_) {
+        // 首次启动、日志丢失或快照和日志对不上：从当前时间起重新编号，
+        // 重建后的版本号不会和之前发出去的重复
+        std::uint64_t seconds = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+        return Reset(std::max(currentVersion_ + 1, seconds));
+    }
+
+    std::vector<std::string_view> names;
+    names.reserve(current.size());
+    for (const auto& entry : current) {
+        names.push_back(entry.name);
+    }
+    std::sort(names.begin(), names.end());
+
+    std::uint64_t version = currentVersion_ + 1;
+    std::size_t firstChange = changes_.size();
+    for (const auto& entry : current) {
+        std::size_t index = previous->Find(entry.name);
+        if (index == ManifestSnapshot::npos) {
+            changes_.push_back(Change{ version, ChangeKind::Add, entry.name });
+            continue;
+        }
+        ManifestSnapshot::Entry old = previous->At(index);
+        if (old.size != entry.size || old.mtime != entry.mtime
+            || (old.hashed && entry.hashed && old.hash != entry.hash)) {
+            changes_.push_back(Change{ version, ChangeKind::Modify, entry.name });
+        }
+    }
+    for (std::size_t i = 0; i < previous->Count(); ++i) {
+        std::string_view name = previous->At(i).name;
+        if (!std::binary_search(names.begin(), names.end(), name)) {
+            changes_.push_back(Change{ version, ChangeKind::Delete, std::string(name) });
+        }
+    }
+    if (changes_.size() == firstChange) {
+        return currentVersion_;
+    }
+
+    std::string lines;
+    for (std::size_t i = firstChange; i < changes_.size(); ++i) {
+        WriteLine(lines, version, static_cast<char>(changes_[i].kind), changes_[i].name);
+    }
+    {
+        std::ofstream file(path_, std::ios::binary | std::ios::app);
+        file.write(lines.data(), static_cast<std::streamsize>(lines.size()));
+    }
+    currentVersion_ = version;
+    Prune();
+    return version;
+}
+
+bool ManifestChangelog::GetDelta(std::uint64_t since, std::uint64_t until, Delta& delta) const {
+    delta.updated.clear();
+    delta.deleted.clear();
+    // 0 表示客户端从未同步过
+    if (since == 0 || since < oldestVersion_ || since > until || until > currentVersion_) {
+        return false;
+    }
+
+    // 只看 (since, until] 之间的记录，开销和变化的数量成正比，与文件总数无关
+    auto begin = std::upper_bound(changes_.begin(), changes_.end(), since,
+        [](std::uint64_t version, const Change& change) { return version < change.version; });
+    auto end = std::upper_bound(begin, changes_.end(), until,
+        [](std::uint64_t version, const Change& change) { return version < change.version; });
+
+    std::vector<const Change*> range;
+    range.reserve(static_cast<std::size_t>(end - begin));
+    for (auto it = begin; it != end; ++it) {
+        range.push_back(&*it);
+    }
+    // 同名的记录排在一起且保持版本顺序，每组只取最后一条
+    std::stable_sort(range.begin(), range.end(),
+        [](const Change* a, const Change* b) { return a->name < b->name; });
+    for (std::size_t i = 0; i < range.size(); ++i) {
+        if (i + 1 < range.size() && range[i + 1]->name == range[i]->name) {
+            continue;
+        }
+        if (range[i]->kind == ChangeKind::Delete) {
+            delta.deleted.push_back(range[i]->name);
+        }
+        else {
+            delta.updated.push_back(range[i]->name);
+        }
+    }
+    return true;
+}
+
+std::uint64_t ManifestChangelog::Reset(std::uint64_t version) {
+    changes_.clear();
+    oldestVersion_ = version;
+    currentVersion_ = version;
+    Rewrite();
+    return version;
+}
+
+void ManifestChangelog::Prune() {
+    if (changes_.size() <= maxChanges_) {
+        return;
+    }
+    // 整个版本一起裁掉，保留下来的每个版本都是完整的
+    std::size_t cut = changes_.size() - maxChanges_;
+    while (cut < changes_.size() && changes_[cut].version == changes_[cut - 1].version) {
+        ++cut;
+    }
+    oldestVersion_ = changes_[cut - 1].version;
+    changes_.erase(changes_.begin(), changes_.begin() + static_cast<std::ptrdiff_t>(cut));
+    Rewrite();
+}
+
+bool ManifestChangelog::Rewrite() const {
+    std::string lines;
+    WriteLine(lines, oldestVersion_, RESET_MARK, std::string_view());
+    for (const auto& change : changes_) {
+        WriteLine(lines, change.version, static_cast<char>(change.kind), change.name);
+    }
+
+    std::filesystem::path temporary = path_;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file.write(lines.data(), static_cast<std::streamsize>(lines.size()));
+        if (!file) {
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path_, error);
+    return !error;
+}
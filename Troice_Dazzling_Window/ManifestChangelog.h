@@ -0,0 +1,70 @@
+#pragma once
+
+#include "ManifestFile.h"
+
+// 标准库
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 服务器和多进程监督进程共用的日志文件
+extern const char* const MANIFEST_CHANGELOG_PATH;
+
+// 清单的版本历史。每次文件列表有变化就记一个新版本，版本号同时写进快照的代数。
+// 日志只追加，每行一条：<版本>|A/M/D|<文件名>（新增、修改、删除）；
+// <版本>|R| 表示之前的历史作废，从这个版本开始重新记录。
+// 条数超过上限时裁掉最早的版本，报告的版本早于保留范围的客户端需要完整对比。
+// 只在一个线程上使用
+class ManifestChangelog {
+public:
+    enum class ChangeKind : char {
+        Add = 'A',
+        Modify = 'M',
+        Delete = 'D'
+    };
+
+    struct Change {
+        std::uint64_t version;
+        ChangeKind kind;
+        std::string name;
+    };
+
+    // 一段时间内的净变化：每个文件只看最后一次操作
+    struct Delta {
+        std::vector<std::string_view> updated;    // 新增或修改，需要重新发送
+        std::vector<std::string_view> deleted;
+    };
+
+    static const std::size_t DEFAULT_MAX_CHANGES = 100000;
+
+    explicit ManifestChangelog(std::size_t maxChanges = DEFAULT_MAX_CHANGES);
+
+    // 读取日志文件，不存在时为空，之后的记录追加到同一个文件
+    void Load(const std::filesystem::path& path);
+
+    std::uint64_t CurrentVersion() const { return currentVersion_; }
+    // 能增量同步的最早版本
+    std::uint64_t OldestVersion() const { return oldestVersion_; }
+
+    // 对比上一版快照和新的文件列表，有变化时记为新版本并写入日志，返回新的当前版本。
+    // 大小、修改时间或（两边都有时）哈希不同算作修改。
+    // previous 为空或它的代数不是当前版本时无法对比，历史作废，从新版本重新开始
+    std::uint64_t Record(const ManifestSnapshot* previous, const std::vector<ManifestEntry>& current);
+
+    // 从 since 到 until 之间的净变化；since 为 0、已被裁掉或不在范围内时返回 false
+    bool GetDelta(std::uint64_t since, std::uint64_t until, Delta& delta) const;
+
+private:
+    std::uint64_t Reset(std::uint64_t version);
+    void Prune();
+    bool Rewrite() const;
+
+    std::filesystem::path path_;
+    std::size_t maxChanges_;
+    std::vector<Change> changes_;       // 按版本排序
+    std::uint64_t oldestVersion_;
+    std::uint64_t currentVersion_;
+};
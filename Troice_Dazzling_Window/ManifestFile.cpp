@@ -0,0 +1,534 @@
+#include "ManifestFile.h"
+#include "DataScanner.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // 文件哈希的分块大小，每块单独算哈希后异或
+    const std::size_t HASH_BLOCK_SIZE = 8192;
+    const std::uint64_t FNV_OFFSET = 0xCBF29CE484222325ULL;
+    const std::uint64_t FNV_PRIME = 0x100000001B3ULL;
+
+    // 逐字节的 64 位 FNV-1a，和 MSVC 的 std::hash<std::string_view> 结果相同。
+    // 不用 std::hash：各家标准库的算法不同，Linux 上编译的服务器会和 Windows 客户端算得不一样
+    std::uint64_t HashDataBlock(std::string_view block) {
+        std::uint64_t hash = FNV_OFFSET;
+        for (unsigned char c : block) {
+            hash = (hash ^ c) * FNV_PRIME;
+        }
+        return hash;
+    }
+
+    const char SNAPSHOT_MAGIC[4] = { 'T', 'D', 'W', 'M' };
+    // 版本 3 起哈希固定为 FNV-1a，之前非 MSVC 编译的服务器写下的哈希不能沿用
+    const std::uint32_t SNAPSHOT_VERSION = 3;
+    const std::uint16_t RECORD_HASHED = 1;
+
+    // 快照在内存和文件中的布局：文件头，记录，桶种子，槽位表，字符串区。
+    // 字段都按自然对齐排列，映射后可以直接访问
+    struct SnapshotHeader {
+        char magic[4];
+        std::uint32_t version;
+        std::uint64_t generation;
+        std::uint32_t count;
+        std::uint32_t bucketCount;
+        std::uint32_t stringBytes;
+        std::uint32_t salt;            // 建索引时换过的哈希盐
+    };
+
+    struct SnapshotRecord {
+        std::uint32_t nameOffset;      // 相对字符串区开头
+        std::uint16_t nameLength;
+        std::uint16_t flags;
+        std::uint64_t hash;
+        std::uint64_t size;
+        std::int64_t mtime;
+    };
+
+    static_assert(sizeof(SnapshotHeader) == 32, "快照文件头布局不能变");
+    static_assert(sizeof(SnapshotRecord) == 32, "快照记录布局不能变");
+
+    struct SnapshotLayout {
+        std::uint64_t records;
+        std::uint64_t seeds;
+        std::uint64_t slots;
+        std::uint64_t strings;
+        std::uint64_t total;
+    };
+
+    SnapshotLayout LayoutOf(std::uint64_t count, std::uint64_t bucketCount, std::uint64_t stringBytes) {
+        SnapshotLayout layout;
+        layout.records = sizeof(SnapshotHeader);
+        layout.seeds = layout.records + count * sizeof(SnapshotRecord);
+        layout.slots = layout.seeds + bucketCount * sizeof(std::uint32_t);
+        layout.strings = layout.slots + count * sizeof(std::uint32_t);
+        layout.total = layout.strings + stringBytes;
+        return layout;
+    }
+
+    // 平均每个桶放几个名字，越大索引越小、建索引越慢
+    const std::uint32_t NAMES_PER_BUCKET = 4;
+
+    std::uint64_t Mix(std::uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xBF58476D1CE4E5B9ull;
+        x ^= x >> 27;
+        x *= 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    // 名字每次取 8 字节混合，尾部不足 8 字节时连同长度一起混入。
+    // 按本机字节序读取，快照只在同一类机器之间使用
+    std::uint64_t HashName(std::string_view name, std::uint32_t salt) {
+        const std::uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+        std::uint64_t hash = 14695981039346656037ull ^ (salt * multiplier);
+        const char* p = name.data();
+        std::size_t remaining = name.size();
+        while (remaining >= 8) {
+            std::uint64_t word;
+            std::memcpy(&word, p, 8);
+            hash = (hash ^ word) * multiplier;
+            hash ^= hash >> 29;
+            p += 8;
+            remaining -= 8;
+        }
+        std::uint64_t tail = 0;
+        std::memcpy(&tail, p, remaining);
+        hash = (hash ^ tail ^ (static_cast<std::uint64_t>(name.size()) << 56)) * multiplier;
+        return Mix(hash);
+    }
+
+    // 用乘法把 32 位哈希映射到 [0, n)，比取模快
+    std::uint32_t Reduce(std::uint64_t hash, std::uint32_t n) {
+        return static_cast<std::uint32_t>(((hash >> 32) * n) >> 32);
+    }
+
+    std::uint32_t BucketOf(std::uint64_t hash, std::uint32_t bucketCount) {
+        return Reduce(hash, bucketCount);
+    }
+
+    std::uint32_t SlotOf(std::uint64_t hash, std::uint32_t seed, std::uint32_t count) {
+        return Reduce(Mix(hash ^ (seed * 0xC2B2AE3D27D4EB4Full)), count);
+    }
+
+    // 先放大桶，每个桶找一个让所有成员落到空槽位的种子；某个桶找不到时换盐重来
+    bool BuildIndex(const std::vector<std::string_view>& names, std::uint32_t salt, std::uint32_t bucketCount,
+                    std::uint32_t* seeds, std::uint32_t* slots) {
+        std::uint32_t count = static_cast<std::uint32_t>(names.size());
+        std::vector<std::uint64_t> hashes(count);
+        std::vector<std::uint32_t> bucketStart(bucketCount + 1, 0);
+        for (std::uint32_t i = 0; i < count; ++i) {
+            hashes[i] = HashName(names[i], salt);
+            ++bucketStart[BucketOf(hashes[i], bucketCount) + 1];
+        }
+        for (std::uint32_t b = 0; b < bucketCount; ++b) {
+            bucketStart[b + 1] += bucketStart[b];
+        }
+        std::vector<std::uint32_t> members(count);
+        std::vector<std::uint32_t> fill(bucketStart.begin(), bucketStart.end() - 1);
+        for (std::uint32_t i = 0; i < count; ++i) {
+            members[fill[BucketOf(hashes[i], bucketCount)]++] = i;
+        }
+
+        std::vector<std::uint32_t> order(bucketCount);
+        for (std::uint32_t b = 0; b < bucketCount; ++b) {
+            order[b] = b;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+            return bucketStart[a + 1] - bucketStart[a] > bucketStart[b + 1] - bucketStart[b];
+        });
+
+        std::fill(seeds, seeds + bucketCount, 0u);
+        std::vector<bool> taken(count, false);
+        std::vector<std::uint32_t> positions;
+        const std::uint32_t maxSeed = count * 32 + 1024;
+        for (std::uint32_t bucket : order) {
+            std::uint32_t begin = bucketStart[bucket];
+            std::uint32_t end = bucketStart[bucket + 1];
+            if (begin == end) {
+                break;     // 剩下的都是空桶，种子保持 0
+            }
+            std::uint32_t seed = 1;
+            for (; seed <= maxSeed; ++seed) {
+                positions.clear();
+                bool fits = true;
+                for (std::uint32_t m = begin; m < end && fits; ++m) {
+                    std::uint32_t slot = SlotOf(hashes[members[m]], seed, count);
+                    fits = !taken[slot] && std::find(positions.begin(), positions.end(), slot) == positions.end();
+                    positions.push_back(slot);
+                }
+                if (fits) {
+                    break;
+                }
+            }
+            if (seed > maxSeed) {
+                return false;
+            }
+            seeds[bucket] = seed;
+            for (std::uint32_t m = begin; m < end; ++m) {
+                std::uint32_t slot = positions[m - begin];
+                taken[slot] = true;
+                slots[slot] = members[m];
+            }
+        }
+        return true;
+    }
+
+    const SnapshotHeader* HeaderOf(const char* data) {
+        return reinterpret_cast<const SnapshotHeader*>(data);
+    }
+
+    bool IsValidHeader(const SnapshotHeader& header) {
+        return std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0
+            && header.version == SNAPSHOT_VERSION;
+    }
+
+    // 校验所有偏移都落在快照内，之后访问不再检查
+    bool IsValidSnapshot(const char* data, std::size_t size) {
+        if (size < sizeof(SnapshotHeader)) {
+            return false;
+        }
+        const SnapshotHeader& header = *HeaderOf(data);
+        if (!IsValidHeader(header) || (header.count != 0 && header.bucketCount == 0)) {
+            return false;
+        }
+        SnapshotLayout layout = LayoutOf(header.count, header.bucketCount, header.stringBytes);
+        if (layout.total > size) {
+            return false;
+        }
+        const SnapshotRecord* records = reinterpret_cast<const SnapshotRecord*>(data + layout.records);
+        const std::uint32_t* slots = reinterpret_cast<const std::uint32_t*>(data + layout.slots);
+        for (std::uint32_t i = 0; i < header.count; ++i) {
+            if (static_cast<std::uint64_t>(records[i].nameOffset) + records[i].nameLength > header.stringBytes
+                || slots[i] >= header.count) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+bool HashDataFileContent(const std::filesystem::path& path, std::size_t& hash,
+                         const std::atomic<bool>* stop, std::atomic<std::uint64_t>* hashedBytes) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    // 使用缓冲区读取文件，提高性能
+    const size_t buffer_size = HASH_BLOCK_SIZE;  // 8KB 缓冲区
+    std::vector<char> buffer(buffer_size);
+    std::uint64_t crc = 0;
+    std::uint64_t hashed = 0;
+
+    while (file && !(stop && *stop)) {
+        file.read(buffer.data(), buffer_size);
+        std::streamsize count = file.gcount();
+        if (count > 0) {
+            // 只计算实际读取的数据
+            crc ^= HashDataBlock(std::string_view(buffer.data(), static_cast<std::size_t>(count)));
+            hashed += static_cast<std::uint64_t>(count);
+            if (hashedBytes) {
+                hashedBytes->store(hashed, std::memory_order_relaxed);
+            }
+        }
+    }
+    hash = static_cast<std::size_t>(crc);
+    return !(stop && *stop);
+}
+
+std::size_t HashDataContent(std::string_view data) {
+    // 和按 8KB 读文件时的分块一致
+    std::uint64_t crc = 0;
+    for (std::size_t offset = 0; offset < data.size(); offset += HASH_BLOCK_SIZE) {
+        crc ^= HashDataBlock(data.substr(offset, HASH_BLOCK_SIZE));
+    }
+    return static_cast<std::size_t>(crc);
+}
+
+std::vector<ManifestEntry> ScanDataFiles(const std::filesystem::path& directory, const FileRules& rules,
+                                         std::size_t threads, const ManifestSnapshot* previous) {
+    PathTree tree = ScanDataTree(directory, rules, threads);
+
+    std::vector<ManifestEntry> entries(tree.FileCount());
+    for (std::size_t i = 0; i < tree.FileCount(); ++i) {
+        const PathTree::File& file = tree.FileAt(i);
+        ManifestEntry& entry = entries[i];
+        tree.GetPath(i, entry.name);
+        entry.size = file.size;
+        entry.mtime = file.mtime;
+
+        std::size_t index = previous ? previous->Find(entry.name) : ManifestSnapshot::npos;
+        if (index != ManifestSnapshot::npos) {
+            ManifestSnapshot::Entry old = previous->At(index);
+            if (old.hashed && old.size == entry.size && old.mtime == entry.mtime) {
+                entry.hash = old.hash;
+                entry.hashed = true;
+            }
+        }
+    }
+
+    // 变化了的文件分给多个线程计算哈希
+    std::atomic<std::size_t> next{ 0 };
+    std::vector<char> failed(entries.size(), 0);
+    auto work = [&]() {
+        for (std::size_t i = next++; i < entries.size(); i = next++) {
+            ManifestEntry& entry = entries[i];
+            if (!entry.hashed) {
+                entry.hashed = HashDataFileContent(directory / entry.name, entry.hash);
+                failed[i] = !entry.hashed;
+            }
+        }
+    };
+    std::vector<std::thread> helpers;
+    for (std::size_t i = 1; i < threads; ++i) {
+        helpers.emplace_back(work);
+    }
+    work();
+    for (auto& helper : helpers) {
+        helper.join();
+    }
+
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        if (!failed[i]) {
+            if (kept != i) {
+                entries[kept] = std::move(entries[i]);
+            }
+            ++kept;
+        }
+    }
+    entries.resize(kept);
+    return entries;
+}
+
+// ManifestSnapshot 实现
+ManifestSnapshot::ManifestSnapshot()
+    : data_(nullptr)
+    , size_(0)
+    , records_(nullptr)
+    , seeds_(nullptr)
+    , slots_(nullptr)
+    , strings_(nullptr)
+    , count_(0)
+    , bucketCount_(0)
+    , salt_(0)
+    , mapped_(false)
+#ifdef _WIN32
+    , mapping_(nullptr)
+#endif
+{
+}
+
+ManifestSnapshot::~ManifestSnapshot() {
+    if (!mapped_) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+#else
+    munmap(const_cast<char*>(data_), size_);
+#endif
+}
+
+void ManifestSnapshot::Attach(const char* data, std::size_t size) {
+    const SnapshotHeader& header = *HeaderOf(data);
+    SnapshotLayout layout = LayoutOf(header.count, header.bucketCount, header.stringBytes);
+    data_ = data;
+    size_ = size;
+    records_ = data + layout.records;
+    seeds_ = reinterpret_cast<const std::uint32_t*>(data + layout.seeds);
+    slots_ = reinterpret_cast<const std::uint32_t*>(data + layout.slots);
+    strings_ = data + layout.strings;
+    count_ = header.count;
+    bucketCount_ = header.bucketCount;
+    salt_ = header.salt;
+}
+
+std::shared_ptr<const ManifestSnapshot> ManifestSnapshot::Build(std::vector<ManifestEntry> entries,
+                                                                std::uint64_t generation) {
+    std::sort(entries.begin(), entries.end(),
+        [](const ManifestEntry& a, const ManifestEntry& b) { return a.name < b.name; });
+
+    std::uint32_t count = static_cast<std::uint32_t>(entries.size());
+    std::uint32_t bucketCount = count == 0 ? 0 : count / NAMES_PER_BUCKET + 1;
+    std::uint64_t stringBytes = 0;
+    for (const auto& entry : entries) {
+        stringBytes += entry.name.size();
+    }
+    SnapshotLayout layout = LayoutOf(count, bucketCount, stringBytes);
+
+    std::shared_ptr<ManifestSnapshot> snapshot(new ManifestSnapshot());
+    std::vector<char>& image = snapshot->owned_;
+    image.assign(static_cast<std::size_t>(layout.total), 0);
+
+    SnapshotHeader* header = reinterpret_cast<SnapshotHeader*>(image.data());
+    std::memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header->version = SNAPSHOT_VERSION;
+    header->generation = generation;
+    header->count = count;
+    header->bucketCount = bucketCount;
+    header->stringBytes = static_cast<std::uint32_t>(stringBytes);
+
+    // 名字依次拷进字符串区，索引直接引用这里的名字
+    SnapshotRecord* records = reinterpret_cast<SnapshotRecord*>(image.data() + layout.records);
+    char* strings = image.data() + layout.strings;
+    std::vector<std::string_view> names;
+    names.reserve(count);
+    std::uint32_t offset = 0;
+    for (std::uint32_t i = 0; i < count; ++i) {
+        const ManifestEntry& entry = entries[i];
+        records[i].nameOffset = offset;
+        records[i].nameLength = static_cast<std::uint16_t>(entry.name.size());
+        records[i].flags = entry.hashed ? RECORD_HASHED : 0;
+        records[i].hash = entry.hash;
+        records[i].size = entry.size;
+        records[i].mtime = entry.mtime;
+        std::memcpy(strings + offset, entry.name.data(), entry.name.size());
+        names.emplace_back(strings + offset, entry.name.size());
+        offset += static_cast<std::uint32_t>(entry.name.size());
+    }
+
+    if (count != 0) {
+        std::uint32_t* seeds = reinterpret_cast<std::uint32_t*>(image.data() + layout.seeds);
+        std::uint32_t* slots = reinterpret_cast<std::uint32_t*>(image.data() + layout.slots);
+        // 名字互不相同时总能找到，换盐只为避开极少见的哈希全等
+        std::uint32_t salt = 0;
+        while (!BuildIndex(names, salt, bucketCount, seeds, slots)) {
+            ++salt;
+        }
+        header->salt = salt;
+    }
+
+    snapshot->Attach(image.data(), image.size());
+    return snapshot;
+}
+
+std::shared_ptr<const ManifestSnapshot> ManifestSnapshot::Map(const std::filesystem::path& path) {
+    std::shared_ptr<ManifestSnapshot> snapshot(new ManifestSnapshot());
+
+#ifdef _WIN32
+    // 允许别的进程在映射期间用新文件替换它
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    CloseHandle(file);
+    if (mapping == nullptr) {
+        return nullptr;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        CloseHandle(mapping);
+        return nullptr;
+    }
+    snapshot->mapping_ = mapping;
+    snapshot->data_ = static_cast<const char*>(view);
+    snapshot->size_ = static_cast<std::size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat info;
+    void* view = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        view = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    // 映射建立后文件描述符就不需要了
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        return nullptr;
+    }
+    snapshot->data_ = static_cast<const char*>(view);
+    snapshot->size_ = static_cast<std::size_t>(info.st_size);
+#endif
+    snapshot->mapped_ = true;
+
+    if (!IsValidSnapshot(snapshot->data_, snapshot->size_)) {
+        return nullptr;
+    }
+    snapshot->Attach(snapshot->data_, snapshot->size_);
+    return snapshot;
+}
+
+std::uint64_t ManifestSnapshot::PeekGeneration(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    SnapshotHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || !IsValidHeader(header)) {
+        return 0;
+    }
+    return header.generation;
+}
+
+bool ManifestSnapshot::Save(const std::filesystem::path& path) const {
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file.write(data_, static_cast<std::streamsize>(size_));
+        if (!file.flush()) {
+            return false;
+        }
+    }
+
+    // 改名是原子的，读方要么看到旧的一代，要么看到新的一代
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    return !error;
+}
+
+std::uint64_t ManifestSnapshot::Generation() const {
+    return HeaderOf(data_)->generation;
+}
+
+std::size_t ManifestSnapshot::Count() const {
+    return count_;
+}
+
+ManifestSnapshot::Entry ManifestSnapshot::At(std::size_t index) const {
+    const SnapshotRecord& record = reinterpret_cast<const SnapshotRecord*>(records_)[index];
+    return { std::string_view(strings_ + record.nameOffset, record.nameLength),
+             static_cast<std::size_t>(record.hash), record.size, record.mtime,
+             (record.flags & RECORD_HASHED) != 0 };
+}
+
+std::size_t ManifestSnapshot::Find(std::string_view name) const {
+    if (count_ == 0) {
+        return npos;
+    }
+    std::uint64_t hash = HashName(name, salt_);
+    std::uint32_t seed = seeds_[BucketOf(hash, bucketCount_)];
+    if (seed == 0) {
+        return npos;
+    }
+    std::uint32_t index = slots_[SlotOf(hash, seed, count_)];
+    const SnapshotRecord& record = reinterpret_cast<const SnapshotRecord*>(records_)[index];
+    if (std::string_view(strings_ + record.nameOffset, record.nameLength) != name) {
+        return npos;
+    }
+    return index;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+// 标准库
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 清单中的一个数据文件。mtime 是文件系统给出的修改时间计数，只用来和同一台机器上的旧快照比较
+struct ManifestEntry {
+    std::string name;
+    std::size_t hash = 0;
+    std::uint64_t size = 0;
+    std::int64_t mtime = 0;
+    bool hashed = false;           // hash 是否有效
+};
+
+class ManifestSnapshot;
+class FileRules;
+
+// 计算数据文件的内容哈希，和客户端的算法一致：每 8KB 一块做 64 位 FNV-1a，各块结果异或。
+// stop 置位时中途放弃并返回 false；hashedBytes 不为空时随读取更新进度
+bool HashDataFileContent(const std::filesystem::path& path, std::size_t& hash,
+                         const std::atomic<bool>* stop = nullptr,
+                         std::atomic<std::uint64_t>* hashedBytes = nullptr);
+
+// 内存中数据的内容哈希，和 HashDataFileContent 对同样内容的结果相同
+std::size_t HashDataContent(std::string_view data);
+
+// 按规则扫描目录并用 threads 个线程计算哈希，读不出来的文件跳过。
+// previous 中大小和修改时间都没变的文件直接沿用旧哈希
+std::vector<ManifestEntry> ScanDataFiles(const std::filesystem::path& directory, const FileRules& rules,
+                                         std::size_t threads, const ManifestSnapshot* previous = nullptr);
+
+// 不可变的数据文件清单快照。
+// 整个快照是一块连续内存：文件头，按名字排序的定长记录 {名字偏移, 哈希, 大小, 修改时间}，
+// 最小完美哈希的桶种子和槽位表，最后是所有文件名挤在一起的字符串区。
+// 里面只有相对偏移，可以原样写盘，也可以由别的进程只读映射后直接使用（见 Prefork.h），
+// 多个进程映射同一个文件时共享同一份物理页。
+// 查找时先按名字哈希到桶，用桶的种子算出槽位，再读一次记录和名字比较；
+// 索引每个文件只占 4 字节多一点，常驻缓存，一次查找通常只有记录和名字两次缓存未命中。
+// 发布后不再修改，任意线程都可以同时读
+class ManifestSnapshot {
+public:
+    static const std::size_t npos = static_cast<std::size_t>(-1);
+
+    struct Entry {
+        std::string_view name;
+        std::size_t hash;
+        std::uint64_t size;
+        std::int64_t mtime;
+        bool hashed;
+    };
+
+    // 按名字排序后建立快照和索引，名字不能重复，长度不超过 64KB
+    static std::shared_ptr<const ManifestSnapshot> Build(std::vector<ManifestEntry> entries,
+                                                         std::uint64_t generation);
+    // 只读映射磁盘上的快照，文件不存在或格式不对时返回空
+    static std::shared_ptr<const ManifestSnapshot> Map(const std::filesystem::path& path);
+    // 只读文件头里的代数，用来判断是否有新一代；文件不存在或无效时返回 0
+    static std::uint64_t PeekGeneration(const std::filesystem::path& path);
+
+    ~ManifestSnapshot();
+    ManifestSnapshot(const ManifestSnapshot&) = delete;
+    ManifestSnapshot& operator=(const ManifestSnapshot&) = delete;
+
+    // 先写临时文件再改名替换，已经映射旧文件的进程不受影响，新打开的总是完整的一代
+    bool Save(const std::filesystem::path& path) const;
+
+    std::uint64_t Generation() const;
+    std::size_t Count() const;
+    Entry At(std::size_t index) const;
+    // 返回记录下标，不存在时返回 npos
+    std::size_t Find(std::string_view name) const;
+    // 快照整体占用的字节数
+    std::size_t Bytes() const { return size_; }
+
+private:
+    ManifestSnapshot();
+    // 按文件头算出各区的位置，查找时不再重复计算
+    void Attach(const char* data, std::size_t size);
+
+    std::vector<char> owned_;      // Build 得到的快照
+    const char* data_;
+    std::size_t size_;
+    const char* records_;
+    const std::uint32_t* seeds_;
+    const std::uint32_t* slots_;
+    const char* strings_;
+    std::uint32_t count_;
+    std::uint32_t bucketCount_;
+    std::uint32_t salt_;
+    bool mapped_;
+#ifdef _WIN32
+    void* mapping_;
+#endif
+};
@@ -0,0 +1,210 @@
+#include "MpqArchive.h"
+
+#include <array>
+
+namespace {
+    const std::uint32_t HEADER_MAGIC = 0x1A51504D;       // "MPQ\x1A"
+    const std::uint32_t USER_DATA_MAGIC = 0x1B51504D;    // "MPQ\x1B"
+    const std::size_t HEADER_SIZE_V1 = 32;
+    const std::size_t HEADER_SIZE_V2 = 44;
+    // 文件头只会出现在 512 字节对齐的位置
+    const std::size_t HEADER_ALIGN = 0x200;
+    const std::uint32_t HASH_TYPE_FILE_KEY = 3;
+    // 扇区最大 32MB，更大的值只会是损坏的文件头
+    const std::uint16_t MAX_SECTOR_SHIFT = 16;
+
+    std::uint32_t ReadUint32(const unsigned char* p) {
+        return static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8)
+             | (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+    }
+
+    std::uint16_t ReadUint16(const unsigned char* p) {
+        return static_cast<std::uint16_t>(p[0] | (p[1] << 8));
+    }
+
+    // Storm 的加密表，哈希和解密共用
+    const std::array<std::uint32_t, 0x500>& CryptTable() {
+        static const std::array<std::uint32_t, 0x500> table = []() {
+            std::array<std::uint32_t, 0x500> result{};
+            std::uint32_t seed = 0x00100001;
+            for (std::uint32_t index1 = 0; index1 < 0x100; ++index1) {
+                std::uint32_t index2 = index1;
+                for (int i = 0; i < 5; ++i, index2 += 0x100) {
+                    seed = (seed * 125 + 3) % 0x2AAAAB;
+                    std::uint32_t high = (seed & 0xFFFF) << 0x10;
+                    seed = (seed * 125 + 3) % 0x2AAAAB;
+                    result[index2] = high | (seed & 0xFFFF);
+                }
+            }
+            return result;
+        }();
+        return table;
+    }
+
+    std::uint32_t HashString(std::string_view text, std::uint32_t type) {
+        const auto& table = CryptTable();
+        std::uint32_t seed1 = 0x7FED7FED;
+        std::uint32_t seed2 = 0xEEEEEEEE;
+        for (unsigned char c : text) {
+            if (c >= 'a' && c <= 'z') {
+                c = static_cast<unsigned char>(c - 'a' + 'A');
+            }
+            seed1 = table[type * 0x100 + c] ^ (seed1 + seed2);
+            seed2 = c + seed1 + seed2 + (seed2 << 5) + 3;
+        }
+        return seed1;
+    }
+
+    // 读出并解密一张表，count 是 32 位整数的个数
+    bool ReadTable(std::string_view data, std::uint64_t offset, std::size_t count, std::uint32_t key,
+                   std::vector<std::uint32_t>& words) {
+        if (offset > data.size() || count > (data.size() - offset) / 4) {
+            return false;
+        }
+        const auto& table = CryptTable();
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data()) + offset;
+        words.resize(count);
+        std::uint32_t seed = 0xEEEEEEEE;
+        for (std::size_t i = 0; i < count; ++i) {
+            seed += table[0x400 + (key & 0xFF)];
+            std::uint32_t value = ReadUint32(p + i * 4) ^ (key + seed);
+            key = ((~key << 0x15) + 0x11111111) | (key >> 0x0B);
+            seed = value + seed + (seed << 5) + 3;
+            words[i] = value;
+        }
+        return true;
+    }
+}
+
+MpqArchive::MpqArchive()
+    : archiveOffset_(0)
+    , dataSize_(0)
+    , sectorSize_(0)
+{
+}
+
+bool MpqArchive::Parse(std::string_view data) {
+    blocks_.clear();
+    hashes_.clear();
+    dataSize_ = data.size();
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data.data());
+
+    // 找到文件头：用户数据头直接给出文件头的位置，否则在对齐的位置上找
+    std::size_t header = std::string_view::npos;
+    for (std::size_t offset = 0; offset + HEADER_SIZE_V1 <= data.size(); offset += HEADER_ALIGN) {
+        std::uint32_t magic = ReadUint32(bytes + offset);
+        if (magic == USER_DATA_MAGIC) {
+            std::uint64_t target = static_cast<std::uint64_t>(offset) + ReadUint32(bytes + offset + 8);
+            if (target + HEADER_SIZE_V1 <= data.size() && ReadUint32(bytes + target) == HEADER_MAGIC) {
+                header = static_cast<std::size_t>(target);
+                break;
+            }
+        }
+        else if (magic == HEADER_MAGIC) {
+            header = offset;
+            break;
+        }
+    }
+    if (header == std::string_view::npos) {
+        return false;
+    }
+
+    const unsigned char* p = bytes + header;
+    std::uint32_t headerSize = ReadUint32(p + 4);
+    std::uint16_t formatVersion = ReadUint16(p + 12);
+    std::uint64_t hashTablePos = ReadUint32(p + 16);
+    std::uint64_t blockTablePos = ReadUint32(p + 20);
+    std::uint32_t hashTableSize = ReadUint32(p + 24);
+    std::uint32_t blockTableSize = ReadUint32(p + 28);
+    std::uint16_t sectorShift = ReadUint16(p + 14);
+    if (formatVersion > 1 || headerSize < HEADER_SIZE_V1 || sectorShift > MAX_SECTOR_SHIFT) {
+        return false;
+    }
+    if (formatVersion == 1) {
+        if (headerSize < HEADER_SIZE_V2 || header + HEADER_SIZE_V2 > data.size()) {
+            return false;
+        }
+        std::uint64_t hiBlockTablePos = static_cast<std::uint64_t>(ReadUint32(p + 32))
+                                      | (static_cast<std::uint64_t>(ReadUint32(p + 36)) << 32);
+        if (hiBlockTablePos != 0) {
+            return false;
+        }
+        hashTablePos |= static_cast<std::uint64_t>(ReadUint16(p + 40)) << 32;
+        blockTablePos |= static_cast<std::uint64_t>(ReadUint16(p + 42)) << 32;
+    }
+    archiveOffset_ = header;
+    sectorSize_ = 512u << sectorShift;
+
+    std::vector<std::uint32_t> words;
+    if (!ReadTable(data, archiveOffset_ + hashTablePos, static_cast<std::size_t>(hashTableSize) * 4,
+                   HashString("(hash table)", HASH_TYPE_FILE_KEY), words)) {
+        return false;
+    }
+    hashes_.reserve(hashTableSize);
+    for (std::size_t i = 0; i < hashTableSize; ++i) {
+        const std::uint32_t* entry = &words[i * 4];
+        hashes_.push_back({ entry[0], entry[1], static_cast<std::uint16_t>(entry[2] & 0xFFFF),
+                            static_cast<std::uint16_t>(entry[2] >> 16), entry[3] });
+    }
+
+    if (!ReadTable(data, archiveOffset_ + blockTablePos, static_cast<std::size_t>(blockTableSize) * 4,
+                   HashString("(block table)", HASH_TYPE_FILE_KEY), words)) {
+        hashes_.clear();
+        return false;
+    }
+    blocks_.reserve(blockTableSize);
+    for (std::size_t i = 0; i < blockTableSize; ++i) {
+        const std::uint32_t* entry = &words[i * 4];
+        blocks_.push_back({ archiveOffset_ + entry[0], entry[1], entry[2], entry[3] });
+    }
+    return true;
+}
+
+bool MpqArchive::IsValidBlock(std::size_t index) const {
+    if (index >= blocks_.size()) {
+        return false;
+    }
+    const Block& block = blocks_[index];
+    return (block.flags & FILE_EXISTS) != 0 && block.compressedSize != 0
+        && block.offset <= dataSize_ && block.compressedSize <= dataSize_ - block.offset;
+}
+
+bool MpqArchive::SectorOffsets(std::string_view data, std::size_t index, std::vector<std::uint32_t>& offsets) const {
+    offsets.clear();
+    if (!IsValidBlock(index)) {
+        return false;
+    }
+    const Block& block = blocks_[index];
+    if ((block.flags & (FILE_SINGLE_UNIT | FILE_ENCRYPTED)) != 0 || block.fileSize == 0) {
+        return false;
+    }
+    std::size_t sectors = (static_cast<std::size_t>(block.fileSize) + sectorSize_ - 1) / sectorSize_;
+
+    if ((block.flags & (FILE_COMPRESS | FILE_IMPLODE)) == 0) {
+        if (block.compressedSize != block.fileSize) {
+            return false;
+        }
+        for (std::size_t i = 0; i < sectors; ++i) {
+            offsets.push_back(static_cast<std::uint32_t>(i * sectorSize_));
+        }
+        offsets.push_back(block.fileSize);
+        return true;
+    }
+
+    // 偏移表之后可能还有一项指向扇区校验值，它也按一个扇区处理
+    std::size_t entries = sectors + 1 + ((block.flags & FILE_SECTOR_CRC) != 0 ? 1 : 0);
+    if (entries > block.compressedSize / 4) {
+        return false;
+    }
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data.data()) + block.offset;
+    offsets.reserve(entries);
+    for (std::size_t i = 0; i < entries; ++i) {
+        std::uint32_t value = ReadUint32(p + i * 4);
+        if (value > block.compressedSize || (i == 0 ? value < entries * 4 : value < offsets.back())) {
+            offsets.clear();
+            return false;
+        }
+        offsets.push_back(value);
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+// 标准库
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// 只读解析 MPQ 归档的结构：文件头、哈希表和块表（两张表都是加密存放的，解析时解密）。
+// 不解压、不解密文件内容，只给出每个内部文件在归档里的位置，以及分扇区存储时每个扇区的范围，
+// 供按结构对齐的补丁使用（见 MpqDiff.h）。
+// 支持 1、2 版文件头（魔兽世界 3.3.5 客户端用的格式），前面带用户数据头的归档也能找到真正的文件头；
+// 超过 4GB 的扩展块表和 3、4 版的 HET/BET 表不支持，Parse 返回 false
+class MpqArchive {
+public:
+    // 块表中的一项，offset 是相对整个数据的位置
+    struct Block {
+        std::uint64_t offset;
+        std::uint32_t compressedSize;
+        std::uint32_t fileSize;
+        std::uint32_t flags;
+    };
+
+    // 哈希表中的一项，两个名字哈希加上语言区分同名文件
+    struct HashEntry {
+        std::uint32_t name1;
+        std::uint32_t name2;
+        std::uint16_t locale;
+        std::uint16_t platform;
+        std::uint32_t blockIndex;
+    };
+
+    static const std::uint32_t FILE_IMPLODE = 0x00000100;
+    static const std::uint32_t FILE_COMPRESS = 0x00000200;
+    static const std::uint32_t FILE_ENCRYPTED = 0x00010000;
+    static const std::uint32_t FILE_SINGLE_UNIT = 0x01000000;
+    static const std::uint32_t FILE_SECTOR_CRC = 0x04000000;
+    static const std::uint32_t FILE_EXISTS = 0x80000000;
+    // 哈希表中的空位和已删除的位置
+    static const std::uint32_t HASH_FREE = 0xFFFFFFFF;
+    static const std::uint32_t HASH_DELETED = 0xFFFFFFFE;
+
+    MpqArchive();
+
+    // 不是 MPQ、格式不支持或表超出数据范围时返回 false；data 只在调用期间使用
+    bool Parse(std::string_view data);
+
+    std::uint64_t ArchiveOffset() const { return archiveOffset_; }
+    std::uint32_t SectorSize() const { return sectorSize_; }
+    const std::vector<Block>& Blocks() const { return blocks_; }
+    const std::vector<HashEntry>& Hashes() const { return hashes_; }
+
+    // 内容完整落在数据范围内、标记为存在的块
+    bool IsValidBlock(std::size_t index) const;
+
+    // 分扇区存储的块每个扇区的起止位置（相对块的起点，共 扇区数 + 1 个）。
+    // 压缩的块从开头的扇区偏移表读出，偏移表本身是 [0, offsets[0])；不压缩的块按扇区大小切分。
+    // 单块存储、加密或偏移表不合理时返回 false
+    bool SectorOffsets(std::string_view data, std::size_t index, std::vector<std::uint32_t>& offsets) const;
+
+private:
+    std::uint64_t archiveOffset_;
+    std::uint64_t dataSize_;
+    std::uint32_t sectorSize_;
+    std::vector<Block> blocks_;
+    std::vector<HashEntry> hashes_;
+};
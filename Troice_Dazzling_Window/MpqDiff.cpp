@@ -0,0 +1,183 @@
+#include "MpqDiff.h"
+#include "BinaryDiff.h"
+#include "MpqArchive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+    // 同一个内部文件在两个版本的哈希表里名字哈希和语言都相同
+    using NameKey = std::tuple<std::uint32_t, std::uint32_t, std::uint16_t>;
+
+    // 按内容查找旧归档中完全相同的一段（整个块或一个扇区）
+    class ContentIndex {
+    public:
+        explicit ContentIndex(std::string_view source)
+            : source_(source)
+        {
+        }
+
+        void Add(std::uint64_t offset, std::size_t length) {
+            items_.emplace(Key(source_.substr(static_cast<std::size_t>(offset), length)), offset);
+        }
+
+        bool Find(std::string_view piece, std::uint64_t& offset) const {
+            auto range = items_.equal_range(Key(piece));
+            for (auto it = range.first; it != range.second; ++it) {
+                if (source_.compare(static_cast<std::size_t>(it->second), piece.size(), piece) == 0) {
+                    offset = it->second;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        static std::size_t Key(std::string_view piece) {
+            return std::hash<std::string_view>()(piece) ^ piece.size();
+        }
+
+        std::string_view source_;
+        std::unordered_multimap<std::size_t, std::uint64_t> items_;
+    };
+
+    std::map<NameKey, std::size_t> BlocksByName(const MpqArchive& archive) {
+        std::map<NameKey, std::size_t> names;
+        for (const auto& entry : archive.Hashes()) {
+            if (entry.blockIndex != MpqArchive::HASH_FREE && entry.blockIndex != MpqArchive::HASH_DELETED
+                && archive.IsValidBlock(entry.blockIndex)) {
+                names.emplace(NameKey(entry.name1, entry.name2, entry.locale), entry.blockIndex);
+            }
+        }
+        return names;
+    }
+}
+
+bool MakeMpqDiff(std::string_view source, std::string_view target, std::string& out) {
+    MpqArchive from;
+    MpqArchive to;
+    if (!from.Parse(source) || !to.Parse(target)) {
+        return false;
+    }
+
+    // 旧归档的每个块和每个扇区按内容建立索引
+    ContentIndex blocks(source);
+    ContentIndex sectors(source);
+    std::vector<std::uint32_t> offsets;
+    for (std::size_t i = 0; i < from.Blocks().size(); ++i) {
+        if (!from.IsValidBlock(i)) {
+            continue;
+        }
+        const MpqArchive::Block& block = from.Blocks()[i];
+        blocks.Add(block.offset, block.compressedSize);
+        if (!from.SectorOffsets(source, i, offsets)) {
+            continue;
+        }
+        for (std::size_t s = 0; s + 1 < offsets.size(); ++s) {
+            if (offsets[s + 1] - offsets[s] >= BinaryDiff::MIN_MATCH) {
+                sectors.Add(block.offset + offsets[s], offsets[s + 1] - offsets[s]);
+            }
+        }
+    }
+    std::map<NameKey, std::size_t> sourceNames = BlocksByName(from);
+
+    // 旧归档中块之前（文件头）和块之后（通常是两张表）的范围
+    std::size_t sourceHeadEnd = source.size();
+    std::size_t sourceTailBegin = 0;
+    for (std::size_t i = 0; i < from.Blocks().size(); ++i) {
+        if (from.IsValidBlock(i)) {
+            const MpqArchive::Block& block = from.Blocks()[i];
+            sourceHeadEnd = std::min(sourceHeadEnd, static_cast<std::size_t>(block.offset));
+            sourceTailBegin = std::max(sourceTailBegin, static_cast<std::size_t>(block.offset + block.compressedSize));
+        }
+    }
+    if (sourceHeadEnd > sourceTailBegin) {
+        sourceHeadEnd = 0;
+        sourceTailBegin = 0;
+    }
+
+    // 新归档中每个块对应的旧版本同名文件
+    std::vector<const MpqArchive::Block*> previous(to.Blocks().size(), nullptr);
+    for (const auto& [name, index] : BlocksByName(to)) {
+        auto found = sourceNames.find(name);
+        if (found != sourceNames.end() && previous[index] == nullptr) {
+            previous[index] = &from.Blocks()[found->second];
+        }
+    }
+
+    std::vector<std::size_t> order;
+    for (std::size_t i = 0; i < to.Blocks().size(); ++i) {
+        if (to.IsValidBlock(i)) {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        return to.Blocks()[a].offset < to.Blocks()[b].offset;
+    });
+
+    BinaryDiffEncoder encoder(source, target, out);
+    std::size_t cursor = 0;
+    for (std::size_t index : order) {
+        const MpqArchive::Block& block = to.Blocks()[index];
+        std::size_t begin = static_cast<std::size_t>(block.offset);
+        std::size_t end = begin + block.compressedSize;
+        if (begin < cursor) {
+            continue;               // 和前一个块重叠的块已经处理过
+        }
+        // 第一个块之前是文件头，只和旧的文件头比较；块之间的空隙很少见，在整个旧归档里找
+        if (cursor == 0) {
+            encoder.Match(0, begin, 0, sourceHeadEnd);
+        }
+        else {
+            encoder.Match(cursor, begin);
+        }
+        cursor = end;
+
+        std::uint64_t offset = 0;
+        if (blocks.Find(target.substr(begin, block.compressedSize), offset)) {
+            encoder.Copy(begin, block.compressedSize, static_cast<std::size_t>(offset));
+            continue;
+        }
+
+        // 没有相同的扇区时在旧版本同一个文件里找，新文件在整个旧归档里找
+        const MpqArchive::Block* old = previous[index];
+        auto matchRun = [&](std::size_t runBegin, std::size_t runEnd) {
+            if (runBegin >= runEnd) {
+                return;
+            }
+            if (old != nullptr) {
+                encoder.Match(runBegin, runEnd, static_cast<std::size_t>(old->offset),
+                              static_cast<std::size_t>(old->offset + old->compressedSize));
+            }
+            else {
+                encoder.Match(runBegin, runEnd);
+            }
+        };
+        if (!to.SectorOffsets(target, index, offsets)) {
+            matchRun(begin, end);
+            continue;
+        }
+        // 连续几个找不到相同内容的扇区合成一段再查找，偏移表也在其中
+        std::size_t run = begin;
+        for (std::size_t s = 0; s + 1 < offsets.size(); ++s) {
+            std::size_t sectorBegin = begin + offsets[s];
+            std::size_t sectorLength = offsets[s + 1] - offsets[s];
+            if (sectorLength >= BinaryDiff::MIN_MATCH && sectors.Find(target.substr(sectorBegin, sectorLength), offset)) {
+                matchRun(run, sectorBegin);
+                encoder.Copy(sectorBegin, sectorLength, static_cast<std::size_t>(offset));
+                run = sectorBegin + sectorLength;
+            }
+        }
+        matchRun(run, end);
+    }
+    // 最后一个块之后是重写过的两张表。加密从表头开始逐项滚动，
+    // 第一处改动之前的内容和旧表相同，之后的部分几乎找不到相同内容
+    encoder.Match(cursor, target.size(), sourceTailBegin, source.size());
+    encoder.Finish();
+    return true;
+}
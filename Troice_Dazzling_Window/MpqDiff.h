@@ -0,0 +1,14 @@
+#pragma once
+
+// 标准库
+#include <string>
+#include <string_view>
+
+// 按 MPQ 结构对齐的补丁，输出和 MakeBinaryDiff 完全相同的格式，客户端照常用 ApplyBinaryDiff 打补丁。
+// 重新打包一个归档时，没改动的内部文件内容不变但位置整体移动，改动的文件里多数扇区也不变：
+//   - 新归档的每个块先按内容在旧归档里找完全相同的块，找到就整块复制
+//   - 找不到时按名字哈希找到旧版本的同一个文件，分扇区存储的逐个扇区对比，
+//     相同内容的扇区整段复制，其余的只在旧版本这个文件的范围内找相同片段
+//   - 新增的文件、文件头和重写过的哈希表、块表在整个旧归档里查找
+// 两个版本都能解析成 MPQ 时返回 true，否则返回 false，由调用方改用 MakeBinaryDiff
+bool MakeMpqDiff(std::string_view source, std::string_view target, std::string& out);
@@ -0,0 +1,44 @@
+#include "PrefetchBudget.h"
+
+PrefetchBudget& PrefetchBudget::Instance() {
+    static PrefetchBudget instance;
+    return instance;
+}
+
+PrefetchBudget::PrefetchBudget()
+    : budgetBytes_(DEFAULT_BUDGET_BYTES)
+    , usedBytes_(0)
+    , prefetchedBytes_(0)
+    , handoffs_(0)
+{
+}
+
+bool PrefetchBudget::TryReserve(std::size_t bytes) {
+    std::size_t used = usedBytes_.load(std::memory_order_relaxed);
+    do {
+        if (used + bytes > Budget()) {
+            return false;
+        }
+    } while (!usedBytes_.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+    return true;
+}
+
+void PrefetchBudget::Release(std::size_t bytes) {
+    if (bytes != 0) {
+        usedBytes_.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+}
+
+void PrefetchBudget::RecordHandoff(std::size_t bytes) {
+    prefetchedBytes_.fetch_add(bytes, std::memory_order_relaxed);
+    handoffs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+PrefetchStats PrefetchBudget::GetStats() const {
+    PrefetchStats stats;
+    stats.usedBytes = usedBytes_.load(std::memory_order_relaxed);
+    stats.budgetBytes = Budget();
+    stats.prefetchedBytes = prefetchedBytes_.load(std::memory_order_relaxed);
+    stats.handoffs = handoffs_.load(std::memory_order_relaxed);
+    return stats;
+}
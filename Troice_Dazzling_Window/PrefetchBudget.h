@@ -0,0 +1,45 @@
+#pragma once
+
+// 标准库
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// 预读的运行统计
+struct PrefetchStats {
+    std::size_t usedBytes;         // 当前预读占用的内存
+    std::size_t budgetBytes;
+    std::uint64_t prefetchedBytes; // 累计预读的字节数
+    std::uint64_t handoffs;        // 直接接上预读结果的文件数
+};
+
+// 全进程共享的预读内存预算。
+// 各会话预读下一个文件时先在这里登记字节数，数据交给发送队列或会话销毁时归还，
+// 预读再多也不会超过这个总量。会话可能比 TcpServer 活得久，所以做成进程内单例。
+class PrefetchBudget {
+public:
+    static const std::size_t DEFAULT_BUDGET_BYTES = 64 * 1024 * 1024;
+
+    static PrefetchBudget& Instance();
+
+    void SetBudget(std::size_t budgetBytes) { budgetBytes_.store(budgetBytes, std::memory_order_relaxed); }
+    std::size_t Budget() const { return budgetBytes_.load(std::memory_order_relaxed); }
+
+    bool TryReserve(std::size_t bytes);
+    void Release(std::size_t bytes);
+
+    // 预读结果被使用时记录
+    void RecordHandoff(std::size_t bytes);
+
+    PrefetchStats GetStats() const;
+
+private:
+    PrefetchBudget();
+    PrefetchBudget(const PrefetchBudget&) = delete;
+    PrefetchBudget& operator=(const PrefetchBudget&) = delete;
+
+    std::atomic<std::size_t> budgetBytes_;
+    std::atomic<std::size_t> usedBytes_;
+    std::atomic<std::uint64_t> prefetchedBytes_;
+    std::atomic<std::uint64_t> handoffs_;
+};
@@ -0,0 +1,231 @@
+#include "Prefork.h"
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+    // 启动后这么快就退出的工作进程（比如端口绑定失败）要等一会儿再补，避免反复 fork
+    const std::chrono::seconds WORKER_RESTART_BACKOFF(1);
+
+    struct WorkerSlot {
+        pid_t pid = -1;
+        std::chrono::steady_clock::time_point started;
+    };
+
+    // 扫描 Data 写出新一代清单，没变的文件沿用上一代的哈希。
+    // 和上一代对比的变化先写进日志，代数就是日志的版本号，文件没有变化时代数不变
+    bool PublishManifest(const std::filesystem::path& path, ManifestChangelog& changelog,
+                         std::shared_ptr<const ManifestSnapshot>& published) {
+        FileRules rules;
+        rules.Load("Files.txt");
+        std::size_t threads = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+        std::vector<ManifestEntry> entries = ScanDataFiles("Data", rules, threads, published.get());
+        std::uint64_t generation = changelog.Record(published.get(), entries);
+        std::shared_ptr<const ManifestSnapshot> snapshot = ManifestSnapshot::Build(std::move(entries), generation);
+        if (!snapshot->Save(path)) {
+            std::fprintf(stderr, "无法写出清单文件 %s\n", path.string().c_str());
+            return false;
+        }
+        std::fprintf(stderr, "清单第 %llu 代：%zu 个文件\n",
+                     static_cast<unsigned long long>(generation), snapshot->Count());
+        published = std::move(snapshot);
+        return true;
+    }
+
+    // 补丁进程收到 SIGTERM 时置位，ReleaseStore 放弃这一轮，不改动索引
+    std::atomic<bool> g_stopReleases{ false };
+
+    void StopReleases(int) {
+        g_stopReleases.store(true);
+    }
+
+    // 在单独的子进程里算补丁，监督进程的信号循环不被挡住，照样补上退出的工作进程、响应 SIGTERM。
+    // 工作进程照常服务，补丁索引换好后才会用上。不需要算补丁时返回 -1
+    pid_t SpawnReleaseUpdate(const PreforkOptions& options, const sigset_t& signalMask,
+                             const ManifestSnapshot& published) {
+        if (options.releaseHistory == 0 && !options.chunkTransfers) {
+            return -1;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            std::signal(SIGHUP, SIG_IGN);
+            std::signal(SIGINT, SIG_IGN);
+            std::signal(SIGTERM, StopReleases);
+            sigprocmask(SIG_SETMASK, &signalMask, nullptr);
+            ReleaseStore store(RELEASE_STORE_PATH, options.releaseHistory);
+            store.Update("Data", published, &g_stopReleases);
+            _exit(0);
+        }
+        if (pid < 0) {
+            std::perror("fork");
+        }
+        return pid;
+    }
+
+    // 工作进程的入口，不返回
+    [[noreturn]] void RunWorker(const PreforkOptions& options, const sigset_t& signalMask) {
+        // 恢复 fork 前的信号屏蔽，SIGHUP 只给监督进程用
+        sigprocmask(SIG_SETMASK, &signalMask, nullptr);
+        std::signal(SIGHUP, SIG_IGN);
+
+        int code = 0;
+        try {
+            asio::io_context io;
+            AcceptOptions acceptOptions = options.acceptOptions;
+            acceptOptions.reusePort = true;
+            TcpServer server(io, options.port, acceptOptions, options.manifestPath);
+            server.SetServerConfig(options.serverIP, options.port, options.serverName);
+
+            asio::signal_set stopSignals(io, SIGTERM, SIGINT);
+            stopSignals.async_wait([&](const asio::error_code& error, int) {
+                if (!error) {
+                    server.Stop();
+                    io.stop();
+                }
+            });
+
+            server.Start();
+            io.run();
+        }
+        catch (const std::exception& e) {
+            std::fprintf(stderr, "工作进程 %d 退出: %s\n", static_cast<int>(getpid()), e.what());
+            code = 1;
+        }
+        // 不执行监督进程留下的静态对象析构
+        _exit(code);
+    }
+
+    void SpawnWorker(const PreforkOptions& options, const sigset_t& signalMask, WorkerSlot& slot) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            RunWorker(options, signalMask);
+        }
+        if (pid < 0) {
+            std::perror("fork");
+            return;
+        }
+        slot.pid = pid;
+        slot.started = std::chrono::steady_clock::now();
+    }
+}
+
+int RunPreforkSupervisor(const PreforkOptions& options) {
+    // 信号都由 sigwait 同步处理，fork 出的工作进程再恢复原来的屏蔽
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    sigset_t previousMask;
+    sigprocmask(SIG_BLOCK, &signals, &previousMask);
+
+    // 接着上一次运行的版本往后编号，工作进程不会把新清单误认成旧的；上一次的哈希也能沿用
+    std::shared_ptr<const ManifestSnapshot> published = ManifestSnapshot::Map(options.manifestPath);
+    ManifestChangelog changelog;
+    changelog.Load(MANIFEST_CHANGELOG_PATH);
+    if (!PublishManifest(options.manifestPath, changelog, published)) {
+        sigprocmask(SIG_SETMASK, &previousMask, nullptr);
+        return 1;
+    }
+
+    std::vector<WorkerSlot> workers(std::max<std::size_t>(options.workers, 1));
+    for (auto& slot : workers) {
+        SpawnWorker(options, previousMask, slot);
+    }
+    // 同一时刻只有一个补丁进程；算的途中又发布了新清单时让它放弃，退出后按最新的清单重算
+    pid_t releasePid = SpawnReleaseUpdate(options, previousMask, *published);
+    bool releasePending = false;
+
+    bool stopping = false;
+    for (;;) {
+        int signal = 0;
+        if (sigwait(&signals, &signal) != 0) {
+            continue;
+        }
+
+        if (signal == SIGHUP) {
+            if (!stopping && PublishManifest(options.manifestPath, changelog, published)) {
+                if (releasePid > 0) {
+                    kill(releasePid, SIGTERM);
+                    releasePending = true;
+                }
+                else {
+                    releasePid = SpawnReleaseUpdate(options, previousMask, *published);
+                }
+            }
+            continue;
+        }
+
+        if (signal == SIGTERM || signal == SIGINT) {
+            stopping = true;
+            for (const auto& slot : workers) {
+                if (slot.pid > 0) {
+                    kill(slot.pid, SIGTERM);
+                }
+            }
+            if (releasePid > 0) {
+                kill(releasePid, SIGTERM);
+            }
+        }
+
+        // 回收所有已经退出的子进程，没在停止时补上新的工作进程
+        int status = 0;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            if (pid == releasePid) {
+                releasePid = -1;
+                if (releasePending && !stopping) {
+                    releasePending = false;
+                    releasePid = SpawnReleaseUpdate(options, previousMask, *published);
+                }
+                continue;
+            }
+            for (auto& slot : workers) {
+                if (slot.pid != pid) {
+                    continue;
+                }
+                slot.pid = -1;
+                if (stopping) {
+                    break;
+                }
+                if (WIFSIGNALED(status)) {
+                    std::fprintf(stderr, "工作进程 %d 被信号 %d 终止，重新启动\n",
+                                 static_cast<int>(pid), WTERMSIG(status));
+                }
+                if (std::chrono::steady_clock::now() - slot.started < WORKER_RESTART_BACKOFF) {
+                    std::this_thread::sleep_for(WORKER_RESTART_BACKOFF);
+                }
+                SpawnWorker(options, previousMask, slot);
+                break;
+            }
+        }
+
+        if (stopping) {
+            bool anyAlive = releasePid > 0;
+            for (const auto& slot : workers) {
+                anyAlive = anyAlive || slot.pid > 0;
+            }
+            if (!anyAlive) {
+                break;
+            }
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &previousMask, nullptr);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "WindowManager.h"
+
+// 标准库
+#include <cstddef>
+#include <filesystem>
+#include <string>
+
+// 多进程模式的配置
+struct PreforkOptions {
+    short port = 12345;
+    std::size_t workers = 4;
+    AcceptOptions acceptOptions;                          // 工作进程总是打开 reusePort
+    std::filesystem::path manifestPath = "Data.manifest";
+    std::string serverIP = "127.0.0.1";
+    std::string serverName;
+    std::size_t releaseHistory = 0;                       // 见 ReleaseStore.h，0 表示不保存历史版本
+    bool chunkTransfers = false;                          // 没有历史版本时也保存当前版本的块，用于按块传输
+};
+
+#ifndef _WIN32
+// 多进程模式（仅 POSIX，Windows 没有 fork 和 SO_REUSEPORT）。
+// 监督进程扫描 Data、算好哈希后写出清单文件（见 ManifestFile.h），再 fork 出 workers 个工作进程。
+// 每个工作进程各自运行一个 TcpServer 和事件循环，用 SO_REUSEPORT 监听同一个端口，由内核分配新连接；
+// 它们只映射清单，不再各自哈希，清单在内存里只有一份。
+// 监督进程收到 SIGHUP 时重新扫描，有变化就记入变化日志（见 ManifestChangelog.h）并写出新一代清单，
+// 工作进程在空闲清理时发现代数变化后整体换上。
+// 保存历史版本时，监督进程每次发布后 fork 一个补丁进程算补丁，工作进程在空闲清理时读到新的补丁索引；
+// 算补丁期间监督进程照常补上退出的工作进程、响应 SIGTERM，途中再次发布时补丁进程放弃并按新清单重算。
+// 工作进程异常退出只断开它自己的连接，监督进程随即补上一个新的；
+// 收到 SIGTERM 或 SIGINT 时通知所有工作进程退出并等它们结束。
+// 必须在创建任何线程和 io_context 之前调用，返回进程退出码。
+// 不带界面的入口在 ServerMain.cpp，由仓库根目录的 CMakeLists.txt 构建
+int RunPreforkSupervisor(const PreforkOptions& options);
+#endif
@@ -32,4 +32,88 @@ namespace Command {
     const std::string CHECK_PATCHES = "CHECK_PATCHES|";        // 校验补丁
     const std::string DELETE_FILES = "DELETE_FILES|";          // 删除文件命令
     const std::string UPDATE_FILES = "UPDATE_FILES|";          // 更新文件命令
+
+    // 可选的请求编号前缀：客户端发送 REQ|<编号>|<命令>，该请求的每条响应都带上同样的前缀，
+    // 全部响应发完后再回一条 REQ|<编号>|REQUEST_DONE|。不带前缀的命令行为不变
+    const std::string REQUEST = "REQ|";
+    const std::string REQUEST_DONE = "REQUEST_DONE|";
+
+    // 开启分帧多路复用：服务器回 STREAMS_ENABLED|<单帧最大负载>|，这是最后一条不分帧的消息。
+    // 带上初始窗口 ENABLE_STREAMS|<字节数>| 时同时开启流量控制，回复为 STREAMS_ENABLED|<单帧最大负载>|<窗口>|
+    const std::string ENABLE_STREAMS = "ENABLE_STREAMS|";
+    const std::string STREAMS_ENABLED = "STREAMS_ENABLED|";
+    // 流量控制下客户端追加接收窗口：WINDOW_UPDATE|<字节数>|，没有回复
+    const std::string WINDOW_UPDATE = "WINDOW_UPDATE|";
+
+    // 增量同步：SYNC|<上次同步到的版本>|。版本还在服务器的变化日志里时先回
+    // SYNC_VERSION|<新版本>|<要发送的文件数>|，再按 CHECK_PATCHES 的格式发这之后变化的
+    // DELETE_FILES 和 UPDATE_FILES，文件收齐后客户端记下新版本。
+    // 版本太旧已被裁掉或无法识别时回 SYNC_FULL|<当前版本>|，客户端改用 CHECK_PATCHES 完整对比，
+    // 完成后记下这个版本。从未同步过的客户端发 SYNC|0|
+    const std::string SYNC = "SYNC|";
+    const std::string SYNC_VERSION = "SYNC_VERSION|";
+    const std::string SYNC_FULL = "SYNC_FULL|";
+
+    // 二进制清单（格式见 BinaryManifest.h）。CHECK_PATCHES_BIN|<字节数>|<END_OF_MESSAGE> 后面
+    // 紧跟这么多字节的清单，不再有结束标记；回复和 CHECK_PATCHES 完全一样
+    const std::string CHECK_PATCHES_BIN = "CHECK_PATCHES_BIN|";
+    // 向客户端推送服务器的清单：GET_MANIFEST| 的回复为
+    // MANIFEST|<字节数>|<START_CONTENT>|<二进制清单>|<END_CONTENT>|<END_OF_MESSAGE>，
+    // 全部哈希算完后才发出，哈希失败的文件不在其中
+    const std::string GET_MANIFEST = "GET_MANIFEST|";
+    const std::string MANIFEST = "MANIFEST|";
+
+    // 客户端能处理补丁时发 ENABLE_DIFFS|，服务器回 DIFFS_ENABLED|。之后对比发现客户端的文件是
+    // 服务器保留的旧版本时，可能用 PATCH_FILES|<文件名>|<补丁大小>|<START_CONTENT>|<补丁>|<END_CONTENT>|<END_OF_MESSAGE>
+    // 代替 UPDATE_FILES（补丁格式见 BinaryDiff.h）。补丁打不上时客户端删掉本地文件重新对比即可拿到完整文件
+    const std::string ENABLE_DIFFS = "ENABLE_DIFFS|";
+    const std::string DIFFS_ENABLED = "DIFFS_ENABLED|";
+    const std::string PATCH_FILES = "PATCH_FILES|";
+
+    // 按块传输（切块规则和块编号见 ChunkStore.h）。客户端把本地文件切块后发
+    // HAVE_CHUNKS|<字节数>|<END_OF_MESSAGE>，后面紧跟这么多字节的块编号（每个 8 字节小端，来自哪个文件都可以），
+    // 服务器回 CHUNKS_ACCEPTED|<编号个数>|。之后要整个发送的文件在服务器上存有块时，改为先发
+    // FILE_CHUNKS|<文件名>|<文件大小>|<块数>|<块编号>|<块长>|...|<END_OF_MESSAGE>（编号是 16 位十六进制），
+    // 再把客户端没报告过、本连接也还没发过的块逐个用
+    // CHUNK_DATA|<块编号>|<块长>|<START_CONTENT>|<内容>|<END_CONTENT>|<END_OF_MESSAGE> 发出。
+    // 客户端按列表顺序拼出文件；拼出的文件哈希不对时删掉本地文件重新对比即可拿到完整文件
+    const std::string HAVE_CHUNKS = "HAVE_CHUNKS|";
+    const std::string CHUNKS_ACCEPTED = "CHUNKS_ACCEPTED|";
+    const std::string FILE_CHUNKS = "FILE_CHUNKS|";
+    const std::string CHUNK_DATA = "CHUNK_DATA|";
+
+    // 小文件打包。客户端发 ENABLE_BUNDLES|，服务器回 BUNDLES_ENABLED|<单个文件上限>|<每包上限>|。
+    // 之后整个发送的文件里不超过上限的小文件，连续几个合成一条
+    // BUNDLE_FILES|<文件数>|<总字节数>|<文件名>|<大小>|...|<START_CONTENT>|<各文件内容依次相连>|<END_CONTENT>|<END_OF_MESSAGE>，
+    // 目录在内容之前，客户端收到多少就可以按目录切出多少个文件写盘，不必等整个包收完。
+    // 目录里只有服务器读出来的文件，缺了的文件客户端下次对比时会再要。分帧模式下一个包占一个流
+    const std::string ENABLE_BUNDLES = "ENABLE_BUNDLES|";
+    const std::string BUNDLES_ENABLED = "BUNDLES_ENABLED|";
+    const std::string BUNDLE_FILES = "BUNDLE_FILES|";
+
+    // 边缘服务器（见 EdgeMirror.h）向源服务器报到：EDGE_HELLO|<IP>|<端口>|<名称>|<已复制到的源版本>|，
+    // 回复 EDGE_ACCEPTED|<源服务器当前版本>|。边缘服务器每轮复制都报到一次，太久没报到的不再推荐。
+    // 源服务器只接受 Edges.txt 里列出的连接来源地址，推荐给玩家的就是那里配置的地址，
+    // 报到里的 IP 可以留空，填了就必须和它一致；否则回 ERROR|Edge not allowed 或 ERROR|Edge address mismatch。
+    // 客户端发 INIT_SERVER_INFO|EDGES| 时，在 SERVER_INFO 之后多回一条
+    // EDGE_SERVERS|<个数>|<IP>|<端口>|<名称>|...|，只列出已复制到当前版本的边缘服务器；
+    // 不带 EDGES 的 INIT_SERVER_INFO 回复不变。多进程模式下各工作进程只知道向自己报到过的边缘服务器
+    const std::string EDGE_HELLO = "EDGE_HELLO|";
+    const std::string EDGE_ACCEPTED = "EDGE_ACCEPTED|";
+    const std::string EDGE_SERVERS = "EDGE_SERVERS|";
+}
+
+// 分帧模式下服务器发出的每一帧：9 字节帧头 + 负载。
+// 帧头依次为流编号（uint32 小端）、标志（uint8）、负载长度（uint32 小端）。
+// 流 0 是控制流，承载 SERVER_INFO、DELETE_FILES、REQUEST_DONE 等普通消息；
+// 每个文件单独占一个流，负载按顺序拼起来就是原来完整的 UPDATE_FILES 消息，最后一帧带 FIN。
+// 控制帧总是优先发送，文件之间小文件优先，因此控制消息最多等一批数据帧。
+// 传输请求的 REQUEST_DONE 在文件没发完时排在所有数据帧之后，单独占一个带 FIN 的流。
+// 开启流量控制后，文件内容帧的负载总量不超过客户端授予的窗口，额度不够时帧会被切短；
+// 控制帧和文件流里的 UPDATE_FILES 包头、包尾不占窗口。
+namespace Stream {
+    const uint32_t FRAME_HEADER_SIZE = 9;
+    const uint32_t MAX_FRAME_PAYLOAD = 64 * 1024;
+    const uint32_t CONTROL_STREAM = 0;
+    const uint8_t FLAG_FIN = 1;
 }
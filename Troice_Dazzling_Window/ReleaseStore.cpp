@@ -0,0 +1,405 @@
+#include "ReleaseStore.h"
+#include "BinaryDiff.h"
+#include "MpqDiff.h"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <map>
+#include <set>
+
+const char* const RELEASE_STORE_PATH = "Releases";
+
+namespace {
+    const char* const INDEX_FILE = "index.txt";
+
+    struct Version {
+        std::size_t hash;
+        std::uint64_t size;
+    };
+
+    struct PatchRecord {
+        std::size_t fromHash;
+        std::size_t toHash;
+        std::uint64_t size;
+    };
+
+    struct Index {
+        std::map<std::string, std::vector<Version>> versions;
+        std::map<std::string, std::vector<PatchRecord>> patches;
+    };
+
+    std::string Hex(std::uint64_t value) {
+        static const char digits[] = "0123456789abcdef";
+        std::string text(16, '0');
+        for (int i = 15; i >= 0; --i) {
+            text[i] = digits[value & 0xF];
+            value >>= 4;
+        }
+        return text;
+    }
+
+    // 文件名的稳定哈希（FNV-1a），不随编译器变化，存下来的文件换了程序版本也能找到
+    std::string NameKey(std::string_view name) {
+        std::uint64_t hash = 0xCBF29CE484222325ULL;
+        for (unsigned char c : name) {
+            hash = (hash ^ c) * 0x100000001B3ULL;
+        }
+        return Hex(hash);
+    }
+
+    std::filesystem::path RecipePath(const std::filesystem::path& root, std::string_view name, std::size_t hash) {
+        return root / "recipes" / (NameKey(name) + '-' + Hex(hash));
+    }
+
+    std::filesystem::path PatchPath(const std::filesystem::path& root, std::string_view name,
+                                    std::size_t fromHash, std::size_t toHash) {
+        return root / "patches" / (NameKey(name) + '-' + Hex(fromHash) + '-' + Hex(toHash) + ".diff");
+    }
+
+    // 依次取出 | 分隔的数字字段，剩下的部分是文件名
+    bool TakeNumber(std::string_view& line, std::uint64_t& value) {
+        std::size_t end = line.find('|');
+        if (end == std::string_view::npos) {
+            return false;
+        }
+        auto result = std::from_chars(line.data(), line.data() + end, value);
+        line.remove_prefix(end + 1);
+        return result.ec == std::errc() && result.ptr == line.data() - 1;
+    }
+
+    Index ReadIndex(const std::filesystem::path& path) {
+        Index index;
+        std::ifstream file(path);
+        std::string text;
+        while (std::getline(file, text)) {
+            std::string_view line(text);
+            if (line.size() < 2 || line[1] != '|') {
+                continue;
+            }
+            char kind = line[0];
+            line.remove_prefix(2);
+            std::uint64_t a = 0;
+            std::uint64_t b = 0;
+            std::uint64_t c = 0;
+            if (kind == 'V' && TakeNumber(line, a) && TakeNumber(line, b) && !line.empty()) {
+                index.versions[std::string(line)].push_back({ static_cast<std::size_t>(a), b });
+            }
+            else if (kind == 'P' && TakeNumber(line, a) && TakeNumber(line, b) && TakeNumber(line, c) && !line.empty()) {
+                index.patches[std::string(line)].push_back({ static_cast<std::size_t>(a), static_cast<std::size_t>(b), c });
+            }
+        }
+        return index;
+    }
+
+    bool WriteAtomically(const std::filesystem::path& path, const std::string& data) {
+        std::filesystem::path temporary = path;
+        temporary += ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) {
+                return false;
+            }
+            file.write(data.data(), static_cast<std::streamsize>(data.size()));
+            if (!file) {
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+        return !error;
+    }
+
+    // 块列表每行一个块：<十六进制编号> <块长>
+    bool WriteRecipe(const std::filesystem::path& path, const std::vector<ChunkRef>& chunks) {
+        std::string text;
+        text.reserve(chunks.size() * 28);
+        for (const auto& chunk : chunks) {
+            text += ChunkStore::ChunkName(chunk.id);
+            text += ' ';
+            text += std::to_string(chunk.size);
+            text += '\n';
+        }
+        return WriteAtomically(path, text);
+    }
+
+    bool ReadRecipe(const std::filesystem::path& path, std::vector<ChunkRef>& chunks) {
+        chunks.clear();
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            return false;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            std::uint64_t id = 0;
+            std::uint32_t size = 0;
+            const char* end = line.data() + line.size();
+            auto first = std::from_chars(line.data(), end, id, 16);
+            if (first.ec != std::errc() || first.ptr == end || *first.ptr != ' ') {
+                return false;
+            }
+            auto second = std::from_chars(first.ptr + 1, end, size);
+            if (second.ec != std::errc() || second.ptr != end) {
+                return false;
+            }
+            chunks.push_back({ id, size });
+        }
+        return true;
+    }
+}
+
+// Catalog 实现
+const ReleaseStore::Patch* ReleaseStore::Catalog::FindPatch(std::string_view name, std::size_t fromHash,
+                                                            std::size_t toHash) const {
+    auto it = std::lower_bound(patches_.begin(), patches_.end(), std::make_pair(name, fromHash),
+        [](const PatchItem& item, const std::pair<std::string_view, std::size_t>& key) {
+            int order = std::string_view(item.name).compare(key.first);
+            return order != 0 ? order < 0 : item.fromHash < key.second;
+        });
+    for (; it != patches_.end() && it->name == name && it->fromHash == fromHash; ++it) {
+        if (it->toHash == toHash) {
+            return &it->patch;
+        }
+    }
+    return nullptr;
+}
+
+const std::vector<const ReleaseStore::Chunk*>* ReleaseStore::Catalog::FindChunks(std::string_view name,
+                                                                                 std::size_t hash) const {
+    auto it = std::lower_bound(files_.begin(), files_.end(), name,
+        [](const ChunkList& item, std::string_view key) { return std::string_view(item.name) < key; });
+    if (it == files_.end() || it->name != name || it->hash != hash) {
+        return nullptr;
+    }
+    return &it->chunks;
+}
+
+// ReleaseStore 实现
+ReleaseStore::ReleaseStore(std::filesystem::path root, std::size_t history)
+    : root_(std::move(root))
+    , history_(history)
+{
+}
+
+void ReleaseStore::Update(const std::filesystem::path& dataDirectory, const ManifestSnapshot& current,
+                          const std::atomic<bool>* stop) {
+    namespace fs = std::filesystem;
+    std::error_code error;
+    fs::create_directories(root_ / "recipes", error);
+    fs::create_directories(root_ / "patches", error);
+    ChunkStore chunkStore(root_ / "chunks");
+
+    Index previous = ReadIndex(root_ / INDEX_FILE);
+    Index next;
+    std::vector<std::uint64_t> referenced;
+    std::vector<ChunkRef> chunks;
+    std::vector<std::vector<ChunkRef>> recipes;
+    std::string source;
+    std::string target;
+    std::string diff;
+    std::string check;
+
+    for (std::size_t i = 0; i < current.Count(); ++i) {
+        if (stop && *stop) {
+            return;
+        }
+        ManifestSnapshot::Entry entry = current.At(i);
+        if (!entry.hashed) {
+            continue;
+        }
+        std::string name(entry.name);
+        std::vector<Version> versions;
+        auto known = previous.versions.find(name);
+        if (known != previous.versions.end()) {
+            versions = known->second;
+        }
+
+        // 块列表读不出来的版本当作没有保存
+        recipes.resize(versions.size());
+        std::size_t kept = 0;
+        for (std::size_t v = 0; v < versions.size(); ++v) {
+            if (ReadRecipe(RecipePath(root_, name, versions[v].hash), recipes[kept])) {
+                versions[kept++] = versions[v];
+            }
+        }
+        versions.resize(kept);
+        recipes.resize(kept);
+
+        // 当前内容不是最后一个版本时先存下来；回滚到旧版本时把它移到最后
+        bool stored = !versions.empty() && versions.back().hash == entry.hash;
+        if (!stored) {
+            for (std::size_t v = versions.size(); v-- > 0;) {
+                if (versions[v].hash == entry.hash) {
+                    versions.erase(versions.begin() + static_cast<std::ptrdiff_t>(v));
+                    recipes.erase(recipes.begin() + static_cast<std::ptrdiff_t>(v));
+                }
+            }
+            stored = chunkStore.StoreFile(dataDirectory / name, entry.hash, chunks, stop)
+                  && WriteRecipe(RecipePath(root_, name, entry.hash), chunks);
+            if (stop && *stop) {
+                return;
+            }
+            if (stored) {
+                versions.push_back({ entry.hash, entry.size });
+                recipes.push_back(chunks);
+            }
+        }
+        if (versions.size() > history_ + 1) {
+            std::ptrdiff_t extra = static_cast<std::ptrdiff_t>(versions.size() - history_ - 1);
+            versions.erase(versions.begin(), versions.begin() + extra);
+            recipes.erase(recipes.begin(), recipes.begin() + extra);
+        }
+        if (versions.empty()) {
+            continue;
+        }
+        for (const auto& recipe : recipes) {
+            for (const auto& chunk : recipe) {
+                referenced.push_back(chunk.id);
+            }
+        }
+        next.versions[name] = versions;
+        if (!stored) {
+            continue;
+        }
+
+        // 每个旧版本直接到当前版本的补丁，已经算过的沿用
+        std::vector<PatchRecord> patches;
+        const std::vector<PatchRecord>* done = nullptr;
+        auto found = previous.patches.find(name);
+        if (found != previous.patches.end()) {
+            done = &found->second;
+        }
+        target.clear();
+        for (std::size_t v = 0; v + 1 < versions.size(); ++v) {
+            const Version& old = versions[v];
+            bool reused = false;
+            if (done != nullptr) {
+                for (const auto& record : *done) {
+                    if (record.fromHash == old.hash && record.toHash == entry.hash) {
+                        patches.push_back(record);
+                        reused = true;
+                        break;
+                    }
+                }
+            }
+            if (reused || old.size > MAX_DIFF_BYTES || entry.size > MAX_DIFF_BYTES) {
+                continue;
+            }
+            if (target.empty() && !chunkStore.Assemble(recipes.back(), target)) {
+                break;
+            }
+            if (!chunkStore.Assemble(recipes[v], source)) {
+                continue;
+            }
+            // 两个版本都是 MPQ 时按归档结构对齐，其他文件按字节查找
+            if (!MakeMpqDiff(source, target, diff)) {
+                MakeBinaryDiff(source, target, diff);
+            }
+            // 先自己打一遍确认无误；比整个文件还大的补丁没有意义
+            if (diff.size() >= target.size() || !ApplyBinaryDiff(source, diff, check) || check != target) {
+                continue;
+            }
+            if (WriteAtomically(PatchPath(root_, name, old.hash, entry.hash), diff)) {
+                patches.push_back({ old.hash, entry.hash, diff.size() });
+            }
+            if (stop && *stop) {
+                return;
+            }
+        }
+        if (!patches.empty()) {
+            next.patches[name] = std::move(patches);
+        }
+    }
+
+    std::string text = "# 由服务器生成，不要手动修改\n";
+    std::set<std::string> recipeFiles;
+    std::set<std::string> patchFiles;
+    for (const auto& [name, versions] : next.versions) {
+        for (const auto& version : versions) {
+            text += "V|" + std::to_string(version.hash) + '|' + std::to_string(version.size) + '|' + name + '\n';
+            recipeFiles.insert(RecipePath(root_, name, version.hash).filename().string());
+        }
+    }
+    for (const auto& [name, patches] : next.patches) {
+        for (const auto& patch : patches) {
+            text += "P|" + std::to_string(patch.fromHash) + '|' + std::to_string(patch.toHash) + '|'
+                  + std::to_string(patch.size) + '|' + name + '\n';
+            patchFiles.insert(PatchPath(root_, name, patch.fromHash, patch.toHash).filename().string());
+        }
+    }
+    if (!WriteAtomically(root_ / INDEX_FILE, text)) {
+        return;
+    }
+
+    // 正在用的补丁表和块列表是按上一份索引建的（本进程要等后台任务回到网络线程，
+    // 多进程时工作进程要等下一次空闲清理才换），换掉之前排队的传输还会打开上一代的补丁和块。
+    // 所以上一份索引引用的文件多留一轮，到下次 Update 时再删
+    for (const auto& [name, versions] : previous.versions) {
+        for (const auto& version : versions) {
+            recipeFiles.insert(RecipePath(root_, name, version.hash).filename().string());
+        }
+        if (ReadRecipe(RecipePath(root_, name, versions.back().hash), chunks)) {
+            for (const auto& chunk : chunks) {
+                referenced.push_back(chunk.id);
+            }
+        }
+    }
+    for (const auto& [name, patches] : previous.patches) {
+        for (const auto& patch : patches) {
+            patchFiles.insert(PatchPath(root_, name, patch.fromHash, patch.toHash).filename().string());
+        }
+    }
+
+    // 索引换好后再删掉两份索引都不再引用的版本、补丁和块
+    auto removeUnreferenced = [&](const fs::path& directory, const std::set<std::string>& keep) {
+        for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+            if (keep.count(it->path().filename().string()) == 0) {
+                std::error_code ignored;
+                fs::remove(it->path(), ignored);
+            }
+        }
+    };
+    removeUnreferenced(root_ / "recipes", recipeFiles);
+    removeUnreferenced(root_ / "patches", patchFiles);
+    std::sort(referenced.begin(), referenced.end());
+    referenced.erase(std::unique(referenced.begin(), referenced.end()), referenced.end());
+    chunkStore.RemoveUnreferenced(referenced);
+    // 早先按整个文件保存的版本
+    fs::remove_all(root_ / "objects", error);
+}
+
+std::shared_ptr<const ReleaseStore::Catalog> ReleaseStore::LoadCatalog(const std::filesystem::path& root) {
+    auto catalog = std::make_shared<Catalog>();
+    Index index = ReadIndex(root / INDEX_FILE);
+    for (const auto& [name, patches] : index.patches) {
+        for (const auto& patch : patches) {
+            catalog->patches_.push_back({ name, patch.fromHash, patch.toHash,
+                                          Patch{ PatchPath(root, name, patch.fromHash, patch.toHash).string(), patch.size } });
+        }
+    }
+    std::sort(catalog->patches_.begin(), catalog->patches_.end(), [](const Catalog::PatchItem& a, const Catalog::PatchItem& b) {
+        return a.name != b.name ? a.name < b.name : a.fromHash < b.fromHash;
+    });
+
+    // 每个文件当前版本的块，名字已经按顺序排好
+    ChunkStore chunkStore(root / "chunks");
+    std::vector<ChunkRef> recipe;
+    for (const auto& [name, versions] : index.versions) {
+        std::size_t hash = versions.back().hash;
+        if (!ReadRecipe(RecipePath(root, name, hash), recipe)) {
+            continue;
+        }
+        Catalog::ChunkList list{ name, hash, {} };
+        list.chunks.reserve(recipe.size());
+        for (const auto& chunk : recipe) {
+            auto it = catalog->chunks_.find(chunk.id);
+            if (it == catalog->chunks_.end()) {
+                it = catalog->chunks_.emplace(chunk.id, Chunk{ chunk.id, chunk.size, ChunkStore::ChunkName(chunk.id),
+                                                               chunkStore.ChunkPath(chunk.id).string() }).first;
+            }
+            list.chunks.push_back(&it->second);
+        }
+        catalog->files_.push_back(std::move(list));
+    }
+    return catalog;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "ManifestFile.h"
+#include "ChunkStore.h"
+
+// 标准库
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// 服务器和多进程监督进程共用的目录
+extern const char* const RELEASE_STORE_PATH;
+
+// 每个数据文件保留的历史版本，以及从这些旧版本直接到当前版本的二进制补丁（见 BinaryDiff.h，MPQ 归档按结构对齐，见 MpqDiff.h）。
+// 全部放在一个目录里：
+//   index.txt          V|<哈希>|<大小>|<文件名>  保留的版本，同名文件从旧到新，最后一个是当前版本
+//                      P|<旧哈希>|<新哈希>|<补丁大小>|<文件名>  可用的补丁
+//   recipes/           每个保留版本的块列表，每行 <块编号> <块长>
+//   chunks/            所有版本共用的块（见 ChunkStore.h），不同版本、不同文件里相同的块只存一份
+//   patches/           补丁文件
+// 发布新版本后由后台任务调用一次 Update：把当前内容切块存下，为每个旧版本算出到当前版本的补丁，
+// 多出来的旧版本、指向旧目标的补丁和不再用到的块删掉；上一份索引还引用的文件多留一轮，
+// 正在用旧补丁表的服务器换上新表之前照样能打开它们。差异只在发布时算一次，之后每个客户端直接发送算好的补丁，
+// 落后几个版本的客户端也只收一个补丁。
+// history 为 0 时只存当前版本的块，用于按块传输；超过 MAX_DIFF_BYTES 的文件不算补丁
+class ReleaseStore {
+public:
+    static const std::uint64_t MAX_DIFF_BYTES = 256ULL * 1024 * 1024;
+
+    struct Patch {
+        std::string path;
+        std::uint64_t size;
+    };
+
+    struct Chunk {
+        std::uint64_t id;
+        std::uint32_t size;
+        std::string name;           // 十六进制编号，也是 CHUNK_DATA 中的名字
+        std::string path;
+    };
+
+    // 只读的补丁表和当前版本的块列表，发布后任意线程都可以同时查
+    class Catalog {
+    public:
+        // name 从 fromHash 升级到 toHash 的补丁，没有时返回空
+        const Patch* FindPatch(std::string_view name, std::size_t fromHash, std::size_t toHash) const;
+        // name 的内容哈希为 hash 的版本按顺序的块，没有时返回空
+        const std::vector<const Chunk*>* FindChunks(std::string_view name, std::size_t hash) const;
+        std::size_t PatchCount() const { return patches_.size(); }
+        std::size_t ChunkCount() const { return chunks_.size(); }
+
+    private:
+        friend class ReleaseStore;
+        struct PatchItem {
+            std::string name;
+            std::size_t fromHash;
+            std::size_t toHash;
+            Patch patch;
+        };
+        struct ChunkList {
+            std::string name;
+            std::size_t hash;
+            std::vector<const Chunk*> chunks;
+        };
+        std::vector<PatchItem> patches_;                    // 按名字和旧哈希排序
+        std::vector<ChunkList> files_;                      // 按名字排序
+        std::unordered_map<std::uint64_t, Chunk> chunks_;   // 节点地址不变，列表直接指向它们
+    };
+
+    // history 为每个文件在当前版本之外保留的旧版本数
+    ReleaseStore(std::filesystem::path root, std::size_t history);
+
+    std::size_t History() const { return history_; }
+    const std::filesystem::path& Root() const { return root_; }
+
+    // 在后台线程调用，current 中的文件从 dataDirectory 读取。stop 置位时放弃，不改动索引
+    void Update(const std::filesystem::path& dataDirectory, const ManifestSnapshot& current,
+                const std::atomic<bool>* stop);
+
+    // 读取 root 下的索引，没有索引时返回空表
+    static std::shared_ptr<const Catalog> LoadCatalog(const std::filesystem::path& root);
+
+private:
+    std::filesystem::path root_;
+    std::size_t history_;
+};
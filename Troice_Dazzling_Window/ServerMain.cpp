@@ -0,0 +1,69 @@
+// 不带界面的 POSIX 服务端入口（CMake 构建，Windows 用 Main.cpp 的图形界面）。
+// 在服务器目录（Data、G.txt、Files.txt 等所在的目录）下运行：
+//   launcher_server [--port 端口] [--workers 工作进程数] [--history 历史版本数] [--chunks]
+//                   [--shards 监听套接字数] [--ip 地址] [--name 名称]
+// 以多进程模式运行（见 Prefork.h）：SIGHUP 让监督进程重新扫描发布，SIGTERM 或 SIGINT 退出
+#ifndef _WIN32
+
+#include "Prefork.h"
+
+// 标准库
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+    void PrintUsage(const char* program) {
+        std::fprintf(stderr,
+            "用法: %s [--port 端口] [--workers 工作进程数] [--history 历史版本数] [--chunks]\n"
+            "          [--shards 监听套接字数] [--ip 地址] [--name 名称]\n", program);
+    }
+}
+
+int main(int argc, char** argv) {
+    PreforkOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--chunks") {
+            options.chunkTransfers = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            PrintUsage(argv[0]);
+            return 2;
+        }
+        const char* value = argv[++i];
+        if (option == "--port") {
+            options.port = static_cast<short>(std::atoi(value));
+        }
+        else if (option == "--workers") {
+            options.workers = std::strtoul(value, nullptr, 10);
+        }
+        else if (option == "--history") {
+            options.releaseHistory = std::strtoul(value, nullptr, 10);
+        }
+        else if (option == "--shards") {
+            options.acceptOptions.reusePortShards = std::strtoul(value, nullptr, 10);
+        }
+        else if (option == "--ip") {
+            options.serverIP = value;
+        }
+        else if (option == "--name") {
+            options.serverName = value;
+        }
+        else {
+            PrintUsage(argv[0]);
+            return 2;
+        }
+    }
+
+    try {
+        return RunPreforkSupervisor(options);
+    }
+    catch (const std::exception& e) {
+        std::fprintf(stderr, "监督进程退出: %s\n", e.what());
+        return 1;
+    }
+}
+
+#endif
@@ -0,0 +1,110 @@
+#include "TransferPlanner.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <stdexcept>
+#include <fstream>
+
+namespace {
+    std::string ToLower(std::string_view text) {
+        std::string lower(text);
+        for (char& c : lower) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        return lower;
+    }
+
+    std::string Trim(const std::string& text) {
+        std::size_t begin = text.find_first_not_of(" \t\r\n");
+        if (begin == std::string::npos) {
+            return std::string();
+        }
+        std::size_t end = text.find_last_not_of(" \t\r\n");
+        return text.substr(begin, end - begin + 1);
+    }
+}
+
+TransferPlanner::TransferPlanner()
+    : policy_(TransferPolicy::CriticalFirst)
+    , criticalPatterns_{ "realmlist" }
+{
+}
+
+void TransferPlanner::LoadPriorities(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        line = Trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            continue;
+        }
+        std::string key = ToLower(Trim(line.substr(0, equals)));
+        std::string value = Trim(line.substr(equals + 1));
+        if (key.empty() || value.empty()) {
+            continue;
+        }
+        if (key == "critical") {
+            criticalPatterns_.push_back(ToLower(value));
+            continue;
+        }
+        try {
+            priorities_[key] = std::stoi(value);
+        }
+        catch (const std::exception&) {
+            // 写错的优先级忽略，文件按未列出处理
+        }
+    }
+}
+
+void TransferPlanner::Order(std::vector<ClientSession::TransferRequest>& files) const {
+    TransferPolicy policy = Policy();
+    if (policy == TransferPolicy::Manifest || files.size() < 2) {
+        return;
+    }
+
+    // 先算出每个文件的级别，排序时不再反复查表
+    struct Ranked {
+        int rank;
+        ClientSession::TransferRequest file;
+    };
+    std::vector<Ranked> ranked;
+    ranked.reserve(files.size());
+    for (const auto& file : files) {
+        int rank = 0;
+        if (policy != TransferPolicy::SmallestFirst) {
+            std::string lowerName = ToLower(file.name);
+            rank = policy == TransferPolicy::CriticalFirst ? (IsCritical(lowerName) ? 0 : 1) : PriorityOf(lowerName);
+        }
+        ranked.push_back(Ranked{ rank, file });
+    }
+
+    std::stable_sort(ranked.begin(), ranked.end(), [](const Ranked& a, const Ranked& b) {
+        return a.rank != b.rank ? a.rank < b.rank : a.file.size < b.file.size;
+    });
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        files[i] = ranked[i].file;
+    }
+}
+
+bool TransferPlanner::IsCritical(const std::string& lowerName) const {
+    for (const auto& pattern : criticalPatterns_) {
+        if (lowerName.find(pattern) != std::string::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int TransferPlanner::PriorityOf(const std::string& lowerName) const {
+    auto it = priorities_.find(lowerName);
+    return it != priorities_.end() ? it->second : INT_MAX;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "ClientSession.h"
+
+// 标准库
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 一个会话内待发送文件的排序方式
+enum class TransferPolicy {
+    Manifest,        // 保持对比清单得到的顺序
+    SmallestFirst,   // 小文件优先，客户端尽早拿到能用的文件
+    CriticalFirst,   // 关键文件（如 realmlist）优先，其余小文件优先
+    PriorityTags     // 按服务器配置的优先级，相同优先级小文件优先
+};
+
+// 决定每个会话的文件发送顺序。
+// 关键文件和优先级从 Priority.txt 读取，每行一项：
+//   critical=<文件名片段>    名字中包含该片段的文件视为关键文件
+//   <文件名>=<优先级>        数字越小越先发送，未列出的文件排在所有已列出的文件之后
+// 以 # 开头的行是注释，文件名不区分大小写。
+// 只在网络线程上排序，界面线程只修改策略。
+class TransferPlanner {
+public:
+    TransferPlanner();
+
+    void SetPolicy(TransferPolicy policy) { policy_.store(policy, std::memory_order_relaxed); }
+    TransferPolicy Policy() const { return policy_.load(std::memory_order_relaxed); }
+
+    // 只能在服务开始接受连接之前调用
+    void LoadPriorities(const std::string& path);
+
+    // 按当前策略原地排序
+    void Order(std::vector<ClientSession::TransferRequest>& files) const;
+
+private:
+    bool IsCritical(const std::string& lowerName) const;
+    int PriorityOf(const std::string& lowerName) const;
+
+    std::atomic<TransferPolicy> policy_;
+    std::vector<std::string> criticalPatterns_;
+    std::unordered_map<std::string, int> priorities_;
+};
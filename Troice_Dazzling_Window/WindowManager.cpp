@@ -1,21 +1,106 @@
 #include "WindowManager.h"
+#ifdef _WIN32
 #include "main.h"
+#endif
 #include <filesystem>
 #include <unordered_map>
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
 
 
+// 服务器读取的配置，界面里可以修改
+static int fileCacheMB = 512;                // 热点文件缓存大小（MB）
+static int transferPolicy = static_cast<int>(TransferPolicy::CriticalFirst);   // 文件发送顺序
+static int releaseHistory = 0;               // 每个文件保留的历史版本数，0 表示不保存也不算补丁
+static bool chunkTransfers = false;          // 保存当前版本的块，客户端报告已有的块后只发缺少的块
+
+#ifdef _WIN32
 // 全局变量
 static std::unique_ptr<asio::io_context> g_io_context;
 static std::unique_ptr<TcpServer> g_server;
 static std::unique_ptr<std::thread> g_io_thread;
+static std::unique_ptr<EdgeMirror> g_edge;     // 边缘模式下的复制线程
 static bool g_serverRunning = false;
 
-// 服务器配置
+// 只有界面用到的配置
 static char serverIP[256] = "127.0.0.1";     // IP地址输入缓冲区
 static int serverPort = 12345;               // 端口号
 static char serverName[256] = "";            // 服务器名称
+static int prefetchMB = 64;                  // 所有会话预读内存的总预算（MB）
+static int transferBufferMB = static_cast<int>(BufferPool::DEFAULT_MAX_OUTSTANDING_BYTES / (1024 * 1024));   // 传输缓冲池借出上限（MB）
+static int hugePageMode = static_cast<int>(HugePageMode::Transparent);   // 传输缓冲池的大页方式，第一次启动服务时生效
+static int pendingAccepts = 16;              // 每个监听套接字同时挂着的 accept 数
+static int listenBacklog = 0;                // 监听队列长度，0 表示系统上限
+static int reusePortShards = 1;              // SO_REUSEPORT 监听套接字数（仅 Linux）
+static bool edgeMode = false;                // 作为边缘服务器，从源服务器复制数据文件
+static char originHost[256] = "127.0.0.1";   // 源服务器地址
+static int originPort = 12345;
+// 边缘模式下复制来的各版本数据文件所在的目录
+static const char* EDGE_ROOT = "Edge";
+#endif
+
+// 磁盘 I/O 线程数和排队上限，排满后新的读取直接失败，会话随之断开
+static const std::size_t DISK_IO_THREADS = 4;
+static const std::size_t DISK_IO_QUEUE_LIMIT = 4096;
+// 热点小文件包的缓存大小
+static const std::size_t BUNDLE_CACHE_BYTES = 64 * 1024 * 1024;
+// 后台哈希线程数，和传输用的磁盘线程分开，启动时的哈希不会挡住文件发送
+static const std::size_t HASH_THREADS = 2;
+// 空闲清理的检查间隔，以及会话多久没有收发后交还内存
+static const std::chrono::seconds IDLE_SWEEP_INTERVAL(5);
+static const std::chrono::seconds IDLE_TRIM_AFTER(30);
+// accept 出错后重新挂上的延迟
+static const std::chrono::milliseconds ACCEPT_RETRY_DELAY(100);
+// 扫描 Data 目录树的线程数
+static const std::size_t SCAN_THREADS = 4;
+// 上次算好的快照，大小和修改时间没变的文件启动时不再重新哈希
+static const char* WARM_SNAPSHOT_PATH = "Data.snapshot";
+// 边缘服务器多久没报到就不再推荐，约为默认复制间隔的三倍
+static const std::chrono::seconds EDGE_EXPIRY(90);
+// 允许报到的边缘服务器，以及同时记录的边缘服务器数和名称长度的上限
+static const char* EDGE_ALLOW_LIST_PATH = "Edges.txt";
+static const std::size_t MAX_EDGES = 64;
+static const std::size_t MAX_EDGE_NAME = 64;
+
+// 统一地址的写法，IPv4 映射的 IPv6 地址按 IPv4 处理；不是合法地址时返回空串
+static std::string NormalizeAddress(std::string_view text) {
+    asio::error_code error;
+    asio::ip::address address = asio::ip::make_address(std::string(text), error);
+    if (error) {
+        return std::string();
+    }
+    if (address.is_v6() && address.to_v6().is_v4_mapped()) {
+        address = asio::ip::make_address_v4(asio::ip::v4_mapped, address.to_v6());
+    }
+    return address.to_string();
+}
 
+// 版本索引的修改时间和 known 不同时读取补丁表和块列表，time 为读到的修改时间。
+// 没有变化或没有索引时返回空。只读文件，在哈希线程上调用（服务启动前除外）
+static std::shared_ptr<const ReleaseStore::Catalog> ReadCatalogIfChanged(std::filesystem::file_time_type known,
+                                                                         std::filesystem::file_time_type& time) {
+    std::error_code error;
+    time = std::filesystem::last_write_time(std::filesystem::path(RELEASE_STORE_PATH) / "index.txt", error);
+    if (error || time == known) {
+        return nullptr;
+    }
+    return ReleaseStore::LoadCatalog(RELEASE_STORE_PATH);
+}
 
+// 提示错误（UTF-8）；不带界面的 POSIX 构建（见 ServerMain.cpp）没有对话框，写到标准错误
+static void ShowErrorMessage(const std::string& message) {
+#ifdef _WIN32
+    int wlen = MultiByteToWideChar(CP_UTF8, 0, message.c_str(), -1, NULL, 0);
+    std::wstring wstr(wlen, 0);
+    MultiByteToWideChar(CP_UTF8, 0, message.c_str(), -1, &wstr[0], wlen);
+    MessageBoxW(NULL, wstr.c_str(), L"错误", MB_OK);
+#else
+    std::fprintf(stderr, "%s\n", message.c_str());
+#endif
+}
+
+#ifdef _WIN32
 void ConvertAndShowMessage(const std::string& cmdContent) 
 {
 	int wlen = MultiByteToWideChar(CP_UTF8, 0, cmdContent.c_str(), -1, NULL, 0);
@@ -35,296 +120,877 @@ void InitializeServerName() {
         WideCharToMultiByte(CP_UTF8, 0, defaultName, -1, serverName, sizeof(serverName), nullptr, nullptr);
     }
 }
+#endif
 
 // TcpServer实现
-TcpServer::TcpServer(asio::io_context& io_context, short port)
-    : acceptor_(io_context, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port))
+TcpServer::TcpServer(asio::io_context& io_context, short port, const AcceptOptions& acceptOptions,
+                     const std::filesystem::path& manifestPath, const std::filesystem::path& mirrorRoot)
+    : ioContext_(io_context)
+    , accepted_(0)
+    , acceptErrors_(0)
+    , peakAcceptsPerSecond_(0)
+    , acceptsInWindow_(0)
+    , acceptRetryTimer_(io_context)
+    , bundleCache_(BUNDLE_CACHE_BYTES)
+    , diskPool_(DISK_IO_THREADS, DISK_IO_QUEUE_LIMIT)
+    , fileCache_(static_cast<std::size_t>(fileCacheMB) * 1024 * 1024)
+    , cancelledSessions_(0)
+    , avoidedBytes_(0)
+    , idleSweepTimer_(io_context)
+    , idleSweepHandlerMemory_(std::make_shared<HandlerMemory>())
+    , sessionCount_(0)
+    , idleSessionCount_(0)
+    , sessionBytes_(0)
+    , idleSessionBytes_(0)
     , isRunning(false)
+    , m_serverPort(port)
+    , unhashedFiles_(0)
+    , stopHashing(false)
+    , manifestPath_(manifestPath)
+    , mirrorRoot_(mirrorRoot)
+    , changelogPath_(mirrorRoot.empty() ? std::filesystem::path(MANIFEST_CHANGELOG_PATH) : EdgeMirror::ChangelogPath(mirrorRoot))
+    , dataDirectory_("Data/")
+    , manifestGeneration_(0)
+    , releaseStore_(RELEASE_STORE_PATH, static_cast<std::size_t>(releaseHistory))
+    , chunkTransfers_(chunkTransfers)
+    , catalog_(std::make_shared<ReleaseStore::Catalog>())
+    , manifestReloading_(false)
+    , catalogReloading_(false)
+    , edgeCount_(0)
+    , currentEdgeCount_(0)
+    , hashPool_(HASH_THREADS)
 {
+    OpenAcceptors(port, acceptOptions);
     LoadNotice();  // 加载通知
-    LoadDataFiles();  // 加载数据文件
+    planner_.SetPolicy(static_cast<TransferPolicy>(transferPolicy));
+    planner_.LoadPriorities("Priority.txt");  // 关键文件和优先级
+    fileRules_.Load("Files.txt");             // 包含和排除的文件
+    LoadEdgeAllowList();
+    if (!mirrorRoot_.empty()) {
+        manifestPath_ = EdgeMirror::CurrentManifestPath(mirrorRoot_);
+    }
+    if (manifestPath_.empty() && mirrorRoot_.empty()) {
+        LoadDataFiles();  // 只列出数据文件，哈希在后台进行，不耽误监听
+    }
+    else {
+        // 还没开始服务，直接在这里读
+        std::unique_ptr<LoadedManifest> manifest;
+        if (!manifestPath_.empty()) {
+            manifest = ReadManifest(manifestPath_, changelogPath_);
+        }
+        if (manifest) {
+            InstallManifest(*manifest);
+        }
+        else {
+            snapshot_ = ManifestSnapshot::Build({}, 0);   // 清单还没写好，之后的空闲清理会再试
+        }
+    }
+    // 上次算好的补丁和块马上可用
+    std::filesystem::file_time_type indexTime;
+    if (auto catalog = ReadCatalogIfChanged(catalogIndexTime_, indexTime)) {
+        catalog_ = std::move(catalog);
+        catalogIndexTime_ = indexTime;
+    }
+}
+
+TcpServer::~TcpServer() {
+    // 让正在哈希的大文件尽快退出，hashPool_ 析构时等待线程结束
+    stopHashing = true;
+}
+
+void TcpServer::OpenAcceptors(short port, const AcceptOptions& options) {
+    asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), port);
+    int backlog = options.backlog > 0 ? options.backlog : asio::socket_base::max_listen_connections;
+    std::size_t shards = std::max<std::size_t>(options.reusePortShards, 1);
+#ifndef SO_REUSEPORT
+    shards = 1;
+#endif
+
+    acceptors_.reserve(shards);
+    for (std::size_t i = 0; i < shards; ++i) {
+        asio::ip::tcp::acceptor acceptor(ioContext_);
+        acceptor.open(endpoint.protocol());
+        acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+        if (shards > 1 || options.reusePort) {
+            acceptor.set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+        }
+#endif
+        acceptor.bind(endpoint);
+        acceptor.listen(backlog);
+        acceptors_.push_back(std::move(acceptor));
+    }
+
+    std::size_t pending = std::max<std::size_t>(options.pendingAccepts, 1);
+    for (auto& acceptor : acceptors_) {
+        for (std::size_t i = 0; i < pending; ++i) {
+            auto slot = std::make_shared<AcceptSlot>();
+            slot->acceptor = &acceptor;
+            acceptSlots_.push_back(std::move(slot));
+        }
+    }
 }
 
 void TcpServer::Start() {
     isRunning = true;
-    StartAccept();
+    acceptWindowStart_ = std::chrono::steady_clock::now();
+    for (auto& slot : acceptSlots_) {
+        StartAccept(slot);
+    }
+    StartIdleSweep();
 }
 
 void TcpServer::Stop() {
     isRunning = false;
-    acceptor_.close();
+    for (auto& acceptor : acceptors_) {
+        asio::error_code ec;
+        acceptor.close(ec);
+    }
+    acceptRetryTimer_.cancel();
+    idleSweepTimer_.cancel();
 
     // 关闭所有客户端连接
     std::lock_guard<std::mutex> lock(clientsMutex);
-    for (auto& socket : clients) {
-        if (socket->is_open()) {
-            asio::error_code ec;
-            socket->shutdown(asio::ip::tcp::socket::shutdown_both, ec);
-            socket->close(ec);
-        }
+    for (auto& session : clients) {
+        session->Close();
     }
     clients.clear();
 }
 
-void TcpServer::StartAccept() {
-    auto socket = std::make_shared<asio::ip::tcp::socket>(acceptor_.get_executor());
-    acceptor_.async_accept(*socket,
-        std::bind(&TcpServer::HandleAccept, this, socket,
-            std::placeholders::_1));
+void TcpServer::StartAccept(const std::shared_ptr<AcceptSlot>& slot) {
+    slot->acceptor->async_accept(
+        MakeCustomAllocHandler(slot->memory,
+            [this, slot](const asio::error_code& error, asio::ip::tcp::socket socket) {
+                HandleAccept(slot, error, std::move(socket));
+            }));
 }
 
-void TcpServer::HandleAccept(std::shared_ptr<asio::ip::tcp::socket> socket,
-                           const asio::error_code& error) {
-    if (!error && isRunning) {
+void TcpServer::HandleAccept(const std::shared_ptr<AcceptSlot>& slot, const asio::error_code& error,
+                             asio::ip::tcp::socket socket) {
+    if (error) {
+        if (error != asio::error::operation_aborted) {
+            ++acceptErrors_;
+            RetryAcceptLater(slot);
+        }
+        return;
+    }
+    // 先把这个 accept 重新挂上，建会话期间内核里排队的连接可以继续被接受
+    if (isRunning) {
+        StartAccept(slot);
+    }
+
+    if (isRunning) {
+        CountAccept();
         try {
-            // 获取客户端连接信
-            asio::ip::tcp::endpoint remote_ep = socket->remote_endpoint();
-            std::string client_ip = remote_ep.address().to_string();
-            unsigned short client_port = remote_ep.port();
+            auto session = std::make_shared<ClientSession>(*this, std::move(socket));
 
             // 存储客户端连接
             {
                 std::lock_guard<std::mutex> lock(clientsMutex);
-                clients.push_back(socket);
+                clients.push_back(session);
             }
 
             //// 显示连接信息
             //std::wstring msg = L"新客户端连接\n"
             //                  L"IP: " + std::wstring(client_ip.begin(), client_ip.end()) + 
-            //                  L"\n端口: " + std::to_wstring(client_port) +
             //                  L"\n当前连接数: " + std::to_wstring(clients.size());
             //MessageBoxW(NULL, msg.c_str(), L"连接信息", MB_OK);
 
-            auto buffer = std::make_shared<asio::streambuf>();
-            
-            // 先读取所有可用数据
-            asio::async_read_until(*socket, *buffer, "<END_OF_MESSAGE>",
-                [this, socket, buffer](const asio::error_code& error, std::size_t bytes_transferred) 
-                {
-                    HandleRead(socket, buffer, error, bytes_transferred);
-                });
+            session->Start();
         }
         catch (const std::exception& e) {
             // 如果获取户端信息失败，显示错误
-            std::string error_msg = "获取客户端信息失败: " + std::string(e.what());
-            int wlen = MultiByteToWideChar(CP_UTF8, 0, error_msg.c_str(), -1, NULL, 0);
-            std::wstring wstr(wlen, 0);
-            MultiByteToWideChar(CP_UTF8, 0, error_msg.c_str(), -1, &wstr[0], wlen);
-            MessageBoxW(NULL, wstr.c_str(), L"错误", MB_OK);
+            ShowErrorMessage("获取客户端信息失败: " + std::string(e.what()));
+        }
+    }
+}
+
+void TcpServer::RetryAcceptLater(const std::shared_ptr<AcceptSlot>& slot) {
+    if (!isRunning) {
+        return;
+    }
+    acceptRetrySlots_.push_back(slot);
+    if (acceptRetrySlots_.size() > 1) {
+        // 定时器已经在等
+        return;
+    }
+    acceptRetryTimer_.expires_after(ACCEPT_RETRY_DELAY);
+    acceptRetryTimer_.async_wait([this](const asio::error_code& error) {
+        if (error || !isRunning) {
+            return;
+        }
+        std::vector<std::shared_ptr<AcceptSlot>> slots;
+        slots.swap(acceptRetrySlots_);
+        for (auto& slot : slots) {
+            StartAccept(slot);
         }
+    });
+}
+
+void TcpServer::CountAccept() {
+    ++accepted_;
+    // 每满一秒按实际经过的时间折算一次速率
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - acceptWindowStart_).count();
+    if (elapsed >= 1000) {
+        std::uint64_t rate = acceptsInWindow_ * 1000 / static_cast<std::uint64_t>(elapsed);
+        if (rate > peakAcceptsPerSecond_) {
+            peakAcceptsPerSecond_ = rate;
+        }
+        acceptsInWindow_ = 0;
+        acceptWindowStart_ = now;
+    }
+    ++acceptsInWindow_;
+}
 
-        StartAccept();
+void TcpServer::StartIdleSweep() {
+    idleSweepTimer_.expires_after(IDLE_SWEEP_INTERVAL);
+    idleSweepTimer_.async_wait(
+        MakeCustomAllocHandler(*idleSweepHandlerMemory_,
+            [this, memory = idleSweepHandlerMemory_](const asio::error_code& error) {
+                if (!error && isRunning) {
+                    SweepIdleSessions();
+                    ReloadManifestIfChanged();
+                    ReloadCatalogIfChanged();
+                    ExpireEdges();
+                    StartIdleSweep();
+                }
+            }));
+}
+
+void TcpServer::SweepIdleSessions() {
+    auto trimBefore = std::chrono::steady_clock::now() - IDLE_TRIM_AFTER;
+    std::size_t idleSessions = 0;
+    std::size_t totalBytes = 0;
+    std::size_t idleBytes = 0;
+
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    for (auto& session : clients) {
+        bool idle = session->LastActivity() < trimBefore && session->IsIdle();
+        if (idle) {
+            session->TrimIdleMemory();
+        }
+        std::size_t bytes = session->MemoryUsage();
+        totalBytes += bytes;
+        if (idle) {
+            ++idleSessions;
+            idleBytes += bytes;
+        }
     }
+    sessionCount_ = clients.size();
+    idleSessionCount_ = idleSessions;
+    sessionBytes_ = totalBytes;
+    idleSessionBytes_ = idleBytes;
 }
 
-void TcpServer::HandleRead(std::shared_ptr<asio::ip::tcp::socket> socket,
-                         std::shared_ptr<asio::streambuf> buffer,
-                         const asio::error_code& error,
-                         std::size_t bytes_transferred) {
-    if (!error) {
-        // 从buffer中提取所有数据
-        std::string data{
-            asio::buffers_begin(buffer->data()),
-            asio::buffers_begin(buffer->data()) + bytes_transferred
-        };
-        buffer->consume(bytes_transferred);  // 清空缓冲区
+void TcpServer::RemoveSession(const std::shared_ptr<ClientSession>& session) {
+    // 处理错误，如客户端断开连接
+    try {
+#ifdef _WIN32
+        asio::ip::tcp::endpoint remote_ep = session->Socket().remote_endpoint();
+        std::string client_ip = remote_ep.address().to_string();
+        unsigned short client_port = remote_ep.port();
+#endif
 
-        // 查找消息结束标记
-        size_t endPos = data.find("<END_OF_MESSAGE>");
-        if (endPos != std::string::npos) {
-            // 提取有效消息内容
-            std::string command = data.substr(0, endPos);
-            // 处理命令
-            HandleCommand(socket, command);
+        // 从容器中移除断开的客户端
+        {
+            std::lock_guard<std::mutex> lock(clientsMutex);
+            clients.erase(std::remove(clients.begin(), clients.end(), session), clients.end());
         }
 
-        // 继续读下一个消息
-        asio::async_read_until(*socket, *buffer, "<END_OF_MESSAGE>",
-            [this, socket, buffer](const asio::error_code& error, std::size_t bytes_transferred) {
-                HandleRead(socket, buffer, error, bytes_transferred);
-            });
+#ifdef _WIN32
+        // 显示断开连接信息
+        std::wstring msg = L"客户端断开连接\n"
+                          L"IP: " + std::wstring(client_ip.begin(), client_ip.end()) + 
+                          L"\n端口: " + std::to_wstring(client_port) +
+                          L"\n当前连接数: " + std::to_wstring(clients.size());
+        MessageBoxW(NULL, msg.c_str(), L"连接信息", MB_OK);
+#endif
+    }
+    catch (...) {
+        // 如果获取客户端信息失败，直接移除socket
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        clients.erase(std::remove(clients.begin(), clients.end(), session), clients.end());
     }
-    else {
-        // 处理错误，如客户端断开连接
-        try {
-            asio::ip::tcp::endpoint remote_ep = socket->remote_endpoint();
-            std::string client_ip = remote_ep.address().to_string();
-            unsigned short client_port = remote_ep.port();
 
-            // 从容器中移除断开的客户端
-            {
-                std::lock_guard<std::mutex> lock(clientsMutex);
-                clients.erase(std::remove_if(clients.begin(), clients.end(),
-                    [&socket](const auto& s) { return s == socket; }), clients.end());
-            }
+    session->Close();
+    RecycleReceiveBuffer(session->ReleaseReceiveBuffer());
+}
 
-            // 显示断开连接信息
-            std::wstring msg = L"客户端断开连接\n"
-                              L"IP: " + std::wstring(client_ip.begin(), client_ip.end()) + 
-                              L"\n端口: " + std::to_wstring(client_port) +
-                              L"\n当前连接数: " + std::to_wstring(clients.size());
-            MessageBoxW(NULL, msg.c_str(), L"连接信息", MB_OK);
+std::unique_ptr<asio::streambuf> TcpServer::AcquireReceiveBuffer() {
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    if (spareReceiveBuffers.empty()) {
+        return std::make_unique<asio::streambuf>();
+    }
+    auto buffer = std::move(spareReceiveBuffers.back());
+    spareReceiveBuffers.pop_back();
+    return buffer;
+}
+
+void TcpServer::RecycleReceiveBuffer(std::unique_ptr<asio::streambuf> buffer) {
+    // 只回收容量不大的缓冲区，收过大清单的缓冲区直接释放
+    const std::size_t maxRecycledCapacity = 64 * 1024;
+    const std::size_t maxSpareBuffers = 64;
+
+    if (!buffer || buffer->capacity() > maxRecycledCapacity) {
+        return;
+    }
+    buffer->consume(buffer->size());
+
+    std::lock_guard<std::mutex> lock(clientsMutex);
+    if (spareReceiveBuffers.size() < maxSpareBuffers) {
+        spareReceiveBuffers.push_back(std::move(buffer));
+    }
+}
+
+void TcpServer::BuildServerInfoResponse() {
+    // 构造服务器信息和通知的组合响应
+    std::string processedContent = noticeContent;
+
+    // 处理通知内容中的换行符，将其替换为特殊标记
+    std::string::size_type pos = 0;
+    while ((pos = processedContent.find('\n', pos)) != std::string::npos) {
+        processedContent.replace(pos, 1, "\\n");  // 使用 "\\n" 替换 "\n"
+        pos += 2;  // 的字符
+    }
+
+    // 构造组合响应：SERVER_INFO|IP|端口|服务器名称|通知内容
+    serverInfoResponse =
+                         "SERVER_INFO|" + 
+                         m_serverIP + "|" + 
+                         std::to_string(m_serverPort) + "|" + 
+                         m_serverName + "|" + 
+                         processedContent +
+                         "<END_OF_MESSAGE>";
+}
+
+void TcpServer::LoadEdgeAllowList()
+{
+    // 每行一个边缘服务器的连接来源地址；推荐给玩家的地址不同时（比如隔着 NAT）写成 <来源地址>=<推荐地址>
+    edgeAllowList_.clear();
+    std::ifstream file(EDGE_ALLOW_LIST_PATH);
+    std::string line;
+    while (std::getline(file, line)) {
+        line.erase(0, line.find_first_not_of(" \t"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.empty() || line[0] == '#') {
+            continue;
         }
-        catch (...) {
-            // 如果获取客户端信息失败，直接移除socket
-            std::lock_guard<std::mutex> lock(clientsMutex);
-            clients.erase(std::remove_if(clients.begin(), clients.end(),
-                [&socket](const auto& s) { return s == socket; }), clients.end());
+        std::size_t equals = line.find('=');
+        std::string source = NormalizeAddress(std::string_view(line).substr(0, equals));
+        std::string advertised = equals == std::string::npos ? source
+            : NormalizeAddress(std::string_view(line).substr(equals + 1));
+        if (!source.empty() && !advertised.empty()) {
+            edgeAllowList_[source] = advertised;
+        }
+    }
+}
+
+void TcpServer::HandleEdgeHello(const std::shared_ptr<ClientSession>& session, std::string_view cmdContent)
+{
+    // EDGE_HELLO|<IP>|<端口>|<名称>|<版本>|
+    std::string_view fields[4];
+    for (auto& field : fields) {
+        std::size_t end = cmdContent.find('|');
+        field = cmdContent.substr(0, end);
+        cmdContent.remove_prefix(end == std::string_view::npos ? cmdContent.size() : end + 1);
+    }
+    std::uint64_t version = 0;
+    unsigned int port = 0;
+    auto [versionEnd, versionError] = std::from_chars(fields[3].data(), fields[3].data() + fields[3].size(), version);
+    auto [portEnd, portError] = std::from_chars(fields[1].data(), fields[1].data() + fields[1].size(), port);
+    if (versionError != std::errc() || portError != std::errc() || portEnd != fields[1].data() + fields[1].size()
+        || port == 0 || port > 65535 || fields[2].size() > MAX_EDGE_NAME) {
+        SendResponse(session, "ERROR|Invalid edge hello<END_OF_MESSAGE>\n");
+        return;
+    }
+
+    // 只接受 Edges.txt 里列出的来源地址，推荐给玩家的地址也由它决定，报到里的地址只能留空或与之相同
+    asio::error_code error;
+    asio::ip::tcp::endpoint remote = session->Socket().remote_endpoint(error);
+    auto allowed = error ? edgeAllowList_.end() : edgeAllowList_.find(NormalizeAddress(remote.address().to_string()));
+    if (allowed == edgeAllowList_.end()) {
+        SendResponse(session, "ERROR|Edge not allowed<END_OF_MESSAGE>\n");
+        return;
+    }
+    const std::string& ip = allowed->second;
+    if (!fields[0].empty() && NormalizeAddress(fields[0]) != ip) {
+        SendResponse(session, "ERROR|Edge address mismatch<END_OF_MESSAGE>\n");
+        return;
+    }
+
+    std::string key = ip + "|" + std::to_string(port);
+    auto it = edges_.find(key);
+    if (it == edges_.end()) {
+        ExpireEdges();
+        if (edges_.size() >= MAX_EDGES) {
+            SendResponse(session, "ERROR|Too many edges<END_OF_MESSAGE>\n");
+            return;
+        }
+        it = edges_.emplace(key, EdgeServer{ ip, std::to_string(port), std::string(),
+                                             0, std::chrono::steady_clock::time_point() }).first;
+    }
+    it->second.name.assign(fields[2]);
+    it->second.version = version;
+    it->second.lastSeen = std::chrono::steady_clock::now();
+    ExpireEdges();
+
+    SendResponse(session, Command::EDGE_ACCEPTED + std::to_string(snapshot_->Generation()) + "|<END_OF_MESSAGE>");
+}
+
+void TcpServer::SendEdgeServers(const std::shared_ptr<ClientSession>& session)
+{
+    // 还没复制完的边缘服务器上文件是旧的，不推荐
+    std::uint64_t version = snapshot_->Generation();
+    std::size_t count = 0;
+    std::string list;
+    for (const auto& item : edges_) {
+        const EdgeServer& edge = item.second;
+        if (edge.version == version) {
+            list += edge.ip + "|" + edge.port + "|" + edge.name + "|";
+            ++count;
+        }
+    }
+    SendResponse(session, Command::EDGE_SERVERS + std::to_string(count) + "|" + list + "<END_OF_MESSAGE>");
+}
+
+void TcpServer::ExpireEdges()
+{
+    auto expireBefore = std::chrono::steady_clock::now() - EDGE_EXPIRY;
+    std::uint64_t version = snapshot_->Generation();
+    std::size_t current = 0;
+    for (auto it = edges_.begin(); it != edges_.end();) {
+        if (it->second.lastSeen < expireBefore) {
+            it = edges_.erase(it);
+            continue;
         }
+        current += it->second.version == version ? 1 : 0;
+        ++it;
     }
+    edgeCount_ = edges_.size();
+    currentEdgeCount_ = current;
 }
 
-void TcpServer::HandleCommand(std::shared_ptr<asio::ip::tcp::socket> socket,const std::string& command)
+void TcpServer::HandleCommand(const std::shared_ptr<ClientSession>& session, const std::string& command)
 { 
     // 检查命令是否包含分隔符 "|"
     size_t separatorPos = command.find("|");
     if (separatorPos == std::string::npos) {
-        SendResponse(socket, "\xEF\xBB\xBF" "ERROR|Invalid command format<END_OF_MESSAGE>\n");
+        SendResponse(session, "\xEF\xBB\xBF" "ERROR|Invalid command format<END_OF_MESSAGE>\n");
         return;
     }
 
-    // 提取命令头部
-    std::string cmdHeader = command.substr(0, separatorPos + 1);
-    std::string cmdContent = command.substr(separatorPos + 1);
+    // 提取命令头部（只取视图，不拷贝）
+    std::string_view cmdHeader(command.data(), separatorPos + 1);
+    std::string_view cmdContent(command.data() + separatorPos + 1, command.size() - separatorPos - 1);
 
     // 根据命令头部处理不同的业务
     if (cmdHeader == Command::INIT_SERVER_INFO) {
-        // 构造服务器信息和通知的组合响应
-        std::string processedContent = noticeContent;
-                
-        // 处理通知内容中的换行符，将其替换为特殊标记
-        std::string::size_type pos = 0;
-        while ((pos = processedContent.find('\n', pos)) != std::string::npos) {
-            processedContent.replace(pos, 1, "\\n");  // 使用 "\\n" 替换 "\n"
-            pos += 2;  // 的字符
-        }
-
-        // 构造组合响应：SERVER_INFO|IP|端口|服务器名称|通知内容
-        std::string combinedResponse = 
-                                     "SERVER_INFO|" + 
-                                     m_serverIP + "|" + 
-                                     std::to_string(m_serverPort) + "|" + 
-                                     m_serverName + "|" + 
-                                     processedContent +
-                                     "<END_OF_MESSAGE>";        
+        //ConvertAndShowMessage(serverInfoResponse);
 
-        //ConvertAndShowMessage(combinedResponse);
-
-        SendResponse(socket, combinedResponse);
+        SendResponse(session, serverInfoResponse);
+        // 认识边缘服务器的客户端才会要，老客户端只收到 SERVER_INFO
+        if (cmdContent.substr(0, 6) == "EDGES|") {
+            SendEdgeServers(session);
+        }
+    }
+    else if (cmdHeader == Command::EDGE_HELLO) {
+        HandleEdgeHello(session, cmdContent);
     }
     else if (cmdHeader == Command::CHECK_PATCHES) 
     {
-        std::vector<std::string> needUpdateFiles;    // 存储需要更新的文件（CRC不匹配）
-        std::vector<std::string> needDeleteFiles;    // 存储需要删除的文件（服务器不存在）
-        std::vector<std::string> tokens;
-        
-        // 分割字符串
-        std::string token;
-        std::istringstream tokenStream(cmdContent);
-        while (std::getline(tokenStream, token, '|')) {
-            if (!token.empty()) {
-                token.erase(0, token.find_first_not_of(" \t\n\r"));
-                token.erase(token.find_last_not_of(" \t\n\r") + 1);
-                tokens.push_back(token);
-            }
+        HandleCheckPatches(session, cmdContent);
+    }
+    else if (cmdHeader == Command::CHECK_PATCHES_BIN) {
+        HandleBinaryCheckPatches(session, cmdContent);
+    }
+    else if (cmdHeader == Command::GET_MANIFEST) {
+        HandleGetManifest(session);
+    }
+    else if (cmdHeader == Command::ENABLE_DIFFS) {
+        session->EnableDiffs();
+        SendResponse(session, Command::DIFFS_ENABLED + "<END_OF_MESSAGE>");
+    }
+    else if (cmdHeader == Command::SYNC) {
+        HandleSync(session, cmdContent);
+    }
+    else if (cmdHeader == Command::HAVE_CHUNKS) {
+        HandleHaveChunks(session, cmdContent);
+    }
+    else if (cmdHeader == Command::ENABLE_BUNDLES) {
+        session->EnableBundles();
+    }
+    else if (cmdHeader == Command::ENABLE_STREAMS) {
+        // 带初始窗口时同时开启流量控制
+        std::uint64_t window = 0;
+        auto [ptr, ec] = std::from_chars(cmdContent.data(), cmdContent.data() + cmdContent.size(), window);
+        if (ec == std::errc() && ptr != cmdContent.data()) {
+            session->EnableFlowControl(window);
+        }
+        session->EnableStreams();
+    }
+    else if (cmdHeader == Command::WINDOW_UPDATE) {
+        std::uint64_t bytes = 0;
+        auto [ptr, ec] = std::from_chars(cmdContent.data(), cmdContent.data() + cmdContent.size(), bytes);
+        if (ec == std::errc()) {
+            session->GrantCredit(bytes);
+        }
+    }
+    else {
+        SendResponse(session, "ERROR|Unknown command<END_OF_MESSAGE>\n");
+    }
+}
+
+void TcpServer::HandleCheckPatches(const std::shared_ptr<ClientSession>& session, std::string_view cmdContent)
+{
+    // 所有临时容器都来自会话，保留上一次的容量
+    ClientSession::PatchScratch& scratch = session->Scratch();
+    auto& needUpdateFiles = scratch.needUpdateFiles;    // 存储需要更新的文件（CRC不匹配）
+    auto& needDeleteFiles = scratch.needDeleteFiles;    // 存储需要删除的文件（服务器不存在）
+    auto& tokens = scratch.tokens;
+    auto& clientFiles = scratch.clientFiles;
+    auto& pendingChecks = scratch.pendingChecks;       // 需要对比哈希的服务器文件
+    needUpdateFiles.clear();
+    needDeleteFiles.clear();
+    tokens.clear();
+    clientFiles.clear();
+    // 上一个请求结束后才会处理这一条，这里只是清掉残留
+    pendingChecks.clear();
+
+    // 分割字符串
+    const char* whitespace = " \t\n\r";
+    while (!cmdContent.empty()) {
+        size_t end = cmdContent.find('|');
+        std::string_view token = cmdContent.substr(0, end);
+        cmdContent.remove_prefix(end == std::string_view::npos ? cmdContent.size() : end + 1);
+
+        size_t first = token.find_first_not_of(whitespace);
+        if (first == std::string_view::npos) {
+            continue;
         }
+        token = token.substr(first, token.find_last_not_of(whitespace) - first + 1);
+        tokens.push_back(token);
+    }
+
+    // 收集客户端的所有文件名，排序后用于二分查找
+    for (size_t i = 0; i + 1 < tokens.size(); i += 2) {
+        clientFiles.push_back(tokens[i]);
+    }
+    std::sort(clientFiles.begin(), clientFiles.end());
+
+    // 检查客户端发来的文件
+    for (size_t i = 0; i + 1 < tokens.size(); i += 2) {
+        std::string_view filename = tokens[i];
+        std::string_view crcText = tokens[i + 1];
 
-        // 创建一个集合存储客户端的所有文件名
-        std::set<std::string> clientFiles;
-        for (size_t i = 0; i < tokens.size() - 1; i += 2) {
-            clientFiles.insert(tokens[i]);
+        size_t clientCrc = 0;
+        auto [ptr, ec] = std::from_chars(crcText.data(), crcText.data() + crcText.size(), clientCrc);
+        if (ec != std::errc()) {
+            continue;
         }
 
-        // 检查客户端发来的文件
-        for (size_t i = 0; i < tokens.size() - 1; i += 2) {
-            std::string filename = tokens[i];
-            try {
-                size_t clientCrc = std::stoull(tokens[i + 1]);
-                auto it = fileHashes.find(filename);
+        std::size_t index = snapshot_->Find(filename);
+        if (index == ManifestSnapshot::npos) {
+            needDeleteFiles.push_back(filename);
+        }
+        else {
+            pendingChecks.push_back({ hashStates[index].get(), true, clientCrc });
+        }
+    }
 
-                if (it == fileHashes.end()) {
-                    needDeleteFiles.push_back(filename);
-                }
-                else if (it->second != clientCrc) {
-                    needUpdateFiles.push_back(filename);
-                }
+    // 检查服务器独有的文件
+    for (std::size_t i = 0; i < snapshot_->Count(); ++i) {
+        if (!std::binary_search(clientFiles.begin(), clientFiles.end(), snapshot_->At(i).name)) {
+            pendingChecks.push_back({ hashStates[i].get(), false, 0 });
+        }
+    }
+
+    // 1. 首先发送需要删除的文件列表
+    SendDeleteFiles(session, needDeleteFiles);
+
+    // 2. 然后发送需要更新的文件；哈希还没算完的文件等算完再对比
+    ResolvePendingChecks(session);
+}
+
+void TcpServer::HandleBinaryCheckPatches(const std::shared_ptr<ClientSession>& session, std::string_view cmdContent)
+{
+    ClientSession::PatchScratch& scratch = session->Scratch();
+    auto& manifest = scratch.binaryManifest;
+    auto& needDeleteFiles = scratch.needDeleteFiles;
+    auto& pendingChecks = scratch.pendingChecks;
+    needDeleteFiles.clear();
+    pendingChecks.clear();
+
+    // 内容是 <字节数>|<清单>，会话已经按字节数读齐
+    std::size_t separator = cmdContent.find('|');
+    if (separator == std::string_view::npos || !manifest.Parse(cmdContent.substr(separator + 1))) {
+        SendResponse(session, "ERROR|Invalid manifest<END_OF_MESSAGE>\n");
+        return;
+    }
+
+    // 客户端清单和快照都按名字排序，一次归并就分出删除、对比和服务器独有三类
+    std::size_t clientIndex = 0;
+    std::size_t serverIndex = 0;
+    std::size_t serverCount = snapshot_->Count();
+    while (clientIndex < manifest.Count() || serverIndex < serverCount) {
+        int order = 0;
+        if (clientIndex == manifest.Count()) {
+            order = 1;
+        }
+        else if (serverIndex == serverCount) {
+            order = -1;
+        }
+        else {
+            order = manifest.Name(clientIndex).compare(snapshot_->At(serverIndex).name);
+        }
+
+        if (order < 0) {
+            needDeleteFiles.push_back(manifest.Name(clientIndex++));
+        }
+        else if (order > 0) {
+            pendingChecks.push_back({ hashStates[serverIndex++].get(), false, 0 });
+        }
+        else {
+            // 服务器的哈希只有 64 位，16 字节哈希的高半部分不为 0 时一定不同，直接重发
+            const FileHashState* file = hashStates[serverIndex++].get();
+            if (manifest.HashHigh(clientIndex) == 0) {
+                pendingChecks.push_back({ file, true, static_cast<std::size_t>(manifest.Hash(clientIndex)) });
             }
-            catch (const std::exception&) {
-                continue;
+            else {
+                pendingChecks.push_back({ file, false, 0 });
             }
+            ++clientIndex;
         }
+    }
+
+    SendDeleteFiles(session, needDeleteFiles);
+    ResolvePendingChecks(session);
+}
+
+void TcpServer::HandleGetManifest(const std::shared_ptr<ClientSession>& session)
+{
+    // 快照里的哈希要等全部算完后才有，之前的请求先挂着
+    if (unhashedFiles_ > 0) {
+        session->Scratch().waitingForManifest = true;
+        manifestWaiters_.push_back(session);
+        return;
+    }
+    SendManifest(session);
+}
 
-        // 检查服务器独有的文件
-        for (const auto& [filename, hash] : fileHashes) {
-            if (clientFiles.find(filename) == clientFiles.end()) {
-                needUpdateFiles.push_back(filename);
+void TcpServer::SendManifest(const std::shared_ptr<ClientSession>& session)
+{
+    // 同一个快照只编码一次
+    if (encodedSnapshot_ != snapshot_) {
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < snapshot_->Count(); ++i) {
+            count += snapshot_->At(i).hashed ? 1 : 0;
+        }
+        std::string encoded;
+        BinaryManifestWriter writer(encoded, count);
+        for (std::size_t i = 0; i < snapshot_->Count(); ++i) {
+            ManifestSnapshot::Entry entry = snapshot_->At(i);
+            if (entry.hashed) {
+                writer.Add(entry.name, entry.hash);
             }
         }
+        writer.Finish();
+
+        manifestMessage_.assign(Command::MANIFEST);
+        manifestMessage_ += std::to_string(encoded.size());
+        manifestMessage_ += "|<START_CONTENT>|";
+        manifestMessage_ += encoded;
+        manifestMessage_ += "|<END_CONTENT>|<END_OF_MESSAGE>";
+        encodedSnapshot_ = snapshot_;
+    }
+    SendResponse(session, manifestMessage_);
+}
 
-        // 1. 首先发送需要删除的文件列表
-        if (!needDeleteFiles.empty()) {
-            std::string deleteCommand = "DELETE_FILES|";
-            for (const auto& file : needDeleteFiles) {
-                deleteCommand += file + "|";
+void TcpServer::SendDeleteFiles(const std::shared_ptr<ClientSession>& session,
+                                const std::vector<std::string_view>& files)
+{
+    if (files.empty()) {
+        return;
+    }
+    std::string& deleteCommand = session->Scratch().message;
+    deleteCommand.assign(Command::DELETE_FILES);
+    for (const auto& file : files) {
+        deleteCommand.append(file);
+        deleteCommand += '|';
+    }
+    deleteCommand += "<END_OF_MESSAGE>";
+    SendResponse(session, deleteCommand);
+}
+
+void TcpServer::HandleSync(const std::shared_ptr<ClientSession>& session, std::string_view cmdContent)
+{
+    ClientSession::PatchScratch& scratch = session->Scratch();
+    auto& pendingChecks = scratch.pendingChecks;
+    pendingChecks.clear();
+
+    std::uint64_t version = snapshot_->Generation();
+    std::uint64_t since = 0;
+    std::from_chars(cmdContent.data(), cmdContent.data() + cmdContent.size(), since);
+
+    // 只查看日志里这个版本之后的记录，不用遍历整个清单
+    std::string& response = scratch.message;
+    if (!changelog_.GetDelta(since, version, syncDelta_)) {
+        response.assign(Command::SYNC_FULL);
+        response += std::to_string(version);
+        response += "|<END_OF_MESSAGE>";
+        SendResponse(session, response);
+        session->CompleteRequestIfIdle();
+        return;
+    }
+
+    for (std::string_view name : syncDelta_.updated) {
+        std::size_t index = snapshot_->Find(name);
+        if (index != ManifestSnapshot::npos) {
+            pendingChecks.push_back({ hashStates[index].get(), false, 0 });
+        }
+    }
+    response.assign(Command::SYNC_VERSION);
+    response += std::to_string(version);
+    response += '|';
+    response += std::to_string(pendingChecks.size());
+    response += "|<END_OF_MESSAGE>";
+    SendResponse(session, response);
+
+    SendDeleteFiles(session, syncDelta_.deleted);
+
+    // 变化的文件按服务器独有处理，哈希算完就发送
+    ResolvePendingChecks(session);
+}
+
+void TcpServer::ResolvePendingChecks(const std::shared_ptr<ClientSession>& session) {
+    ClientSession::PatchScratch& scratch = session->Scratch();
+    auto& pendingChecks = scratch.pendingChecks;
+    auto& needUpdateFiles = scratch.needUpdateFiles;
+    auto& needDeleteFiles = scratch.needDeleteFiles;
+    needUpdateFiles.clear();
+    needDeleteFiles.clear();
+
+    std::size_t remaining = 0;
+    for (const auto& check : pendingChecks) {
+        if (!check.file->IsReady()) {
+            pendingChecks[remaining++] = check;
+            continue;
+        }
+        if (check.file->failed) {
+            // 读不出来的文件按服务器不存在处理，和原来启动时跳过它的效果一致
+            if (check.clientHas) {
+                needDeleteFiles.push_back(check.file->name);
             }
-            deleteCommand += "<END_OF_MESSAGE>";
-            //ConvertAndShowMessage(deleteCommand);
-            SendResponse(socket, deleteCommand);
-        }
-
-        // 2. 然后发送需要更新的文件
-        if (!needUpdateFiles.empty()) {
-            for (const auto& filename : needUpdateFiles) {
-                std::string filepath = "Data/" + filename;
-                std::ifstream file(filepath, std::ios::binary);
-                if (!file.is_open()) continue;
-
-                // 获取文件大小
-                file.seekg(0, std::ios::end);
-                std::streamsize fileSize = file.tellg();
-                file.seekg(0, std::ios::beg);
-
-                // 构造包头
-                std::string header = "UPDATE_FILES|" + filename + "|" + std::to_string(fileSize) + "|<START_CONTENT>|";
-
-                // 读取文件内容到临时缓冲区
-                std::vector<char> fileData(fileSize);
-                file.read(fileData.data(), fileSize);
-                file.close();
-
-                // 构造完整消息
-                std::string fullMessage = header;
-                fullMessage.append(fileData.data(), fileSize);
-                fullMessage += "|<END_CONTENT>|<END_OF_MESSAGE>";
-
-                // 检查最终消息大小
-                std::ostringstream finalCheck;
-                finalCheck << "最终消息大小检查:\n"
-                          << "文件大小: " << std::to_string(fileSize) << "\n"
-                          << "完整消息: " << std::to_string(fullMessage.size());
-                ConvertAndShowMessage(finalCheck.str());
-
-                // 发送完整消息
-                SendResponse(socket, fullMessage);
+            continue;
+        }
+        std::size_t hash = check.file->hash;
+        if (!check.clientHas || hash != check.clientCrc) {
+            // 客户端是保留的旧版本时只发补丁
+            const ReleaseStore::Patch* patch = nullptr;
+            if (check.clientHas && session->DiffsEnabled()) {
+                patch = catalog_->FindPatch(check.file->name, check.clientCrc, hash);
+            }
+            if (patch != nullptr) {
+                needUpdateFiles.push_back({ check.file->name, hash, patch->size, patch->path,
+                                            ClientSession::TransferKind::Patch });
+            }
+            else if (!session->ChunksEnabled() || !QueueChunkTransfer(session, *check.file)) {
+                needUpdateFiles.push_back({ check.file->name, hash, check.file->totalBytes });
             }
         }
+    }
+    pendingChecks.resize(remaining);
 
+    SendDeleteFiles(session, needDeleteFiles);
+
+    // 由会话按块从缓冲池读出发送
+    if (!needUpdateFiles.empty()) {
+        planner_.Order(needUpdateFiles);
+        session->QueueFileTransfers(needUpdateFiles);
     }
-    else {
-        SendResponse(socket, "ERROR|Unknown command<END_OF_MESSAGE>\n");
+
+    if (!pendingChecks.empty() && !scratch.waitingForHashes) {
+        scratch.waitingForHashes = true;
+        hashWaiters.push_back(session);
     }
+
+    // 没有要等的哈希也没有要发的文件时，请求在这里结束
+    session->CompleteRequestIfIdle();
 }
 
-void TcpServer::SendResponse(std::shared_ptr<asio::ip::tcp::socket> socket,
-                           const std::string& response) {
-    auto responseBuffer = std::make_shared<std::string>(response);
-    asio::async_write(*socket,
-        asio::buffer(*responseBuffer),
-        [responseBuffer](const asio::error_code& error, std::size_t /*bytes_transferred*/) {
-            if (error) {
-                // 处理错误
+bool TcpServer::QueueChunkTransfer(const std::shared_ptr<ClientSession>& session, const FileHashState& file) {
+    const std::vector<const ReleaseStore::Chunk*>* chunks = catalog_->FindChunks(file.name, file.hash);
+    if (chunks == nullptr) {
+        return false;
+    }
+    ClientSession::PatchScratch& scratch = session->Scratch();
+    std::string& message = scratch.message;
+    message.assign(Command::FILE_CHUNKS).append(file.name).append("|").append(std::to_string(file.totalBytes))
+           .append("|").append(std::to_string(chunks->size())).append("|");
+    for (const ReleaseStore::Chunk* chunk : *chunks) {
+        message.append(chunk->name).append("|").append(std::to_string(chunk->size)).append("|");
+        if (session->NeedsChunk(chunk->id)) {
+            scratch.needUpdateFiles.push_back({ chunk->name, static_cast<std::size_t>(chunk->id), chunk->size, chunk->path,
+                                                ClientSession::TransferKind::Chunk });
+        }
+    }
+    message += "<END_OF_MESSAGE>";
+    SendResponse(session, message);
+    return true;
+}
+
+void TcpServer::HandleHaveChunks(const std::shared_ptr<ClientSession>& session, std::string_view cmdContent) {
+    // 内容是 <字节数>|<块编号>，会话已经按字节数读齐
+    std::size_t separator = cmdContent.find('|');
+    std::string_view payload = separator == std::string_view::npos ? std::string_view() : cmdContent.substr(separator + 1);
+    if (separator == std::string_view::npos || payload.size() % 8 != 0) {
+        SendResponse(session, "ERROR|Invalid chunk list<END_OF_MESSAGE>\n");
+        return;
+    }
+    std::vector<std::uint64_t> chunks(payload.size() / 8);
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(payload.data());
+    for (std::size_t i = 0; i < chunks.size(); ++i, p += 8) {
+        std::uint64_t id = 0;
+        for (int b = 7; b >= 0; --b) {
+            id = (id << 8) | p[b];
+        }
+        chunks[i] = id;
+    }
+    std::size_t count = chunks.size();
+    session->SetClientChunks(std::move(chunks));
+    SendResponse(session, Command::CHUNKS_ACCEPTED + std::to_string(count) + "|<END_OF_MESSAGE>");
+}
+
+void TcpServer::OnFileHashed() {
+    if (unhashedFiles_ > 0 && --unhashedFiles_ == 0) {
+        PublishHashedSnapshot();
+
+        std::vector<std::weak_ptr<ClientSession>> manifestWaiters;
+        manifestWaiters.swap(manifestWaiters_);
+        for (auto& weak : manifestWaiters) {
+            if (auto session = weak.lock()) {
+                session->Scratch().waitingForManifest = false;
+                SendManifest(session);
+                session->CompleteRequestIfIdle();
             }
-        });
+        }
+    }
+    if (hashWaiters.empty()) {
+        return;
+    }
+    std::vector<std::weak_ptr<ClientSession>> waiters;
+    waiters.swap(hashWaiters);
+    for (auto& weak : waiters) {
+        if (auto session = weak.lock()) {
+            session->Scratch().waitingForHashes = false;
+            ResolvePendingChecks(session);
+        }
+    }
+}
+
+void TcpServer::SendResponse(const std::shared_ptr<ClientSession>& session,
+                           const std::string& response) {
+    session->Send(response);
 }
 
 void TcpServer::LoadNotice() {
@@ -345,7 +1011,9 @@ void TcpServer::LoadNotice() {
 
         // 存储 UTF-8 编码的内容
         noticeContent = fileContent;
+        BuildServerInfoResponse();
 
+#ifdef _WIN32
         // 转换为宽字符以供显示
         int wideSize = MultiByteToWideChar(CP_UTF8, 0, noticeContent.c_str(), -1, nullptr, 0);
         if (wideSize > 0) {
@@ -359,74 +1027,337 @@ void TcpServer::LoadNotice() {
                 //MessageBoxW(NULL, debugMsg.c_str(), L"通知文件加载", MB_OK);
             }
         }
+#endif
     }
     else {
-        MessageBoxW(NULL, L"无法打开通知文件 G.txt\n请确认文件存在且可访问", L"错误", MB_OK);
+        ShowErrorMessage("无法打开通知文件 G.txt\n请确认文件存在且可访问");
     }
 }
 
 void TcpServer::LoadDataFiles() {
     namespace fs = std::filesystem;
-    std::hash<std::string_view> hasher;
 
+    std::vector<ManifestEntry> entries;
     try {
         // 检查 Data 目录是否存在
         if (!fs::exists("Data")) {
-            MessageBoxW(NULL, L"Data 目录不存在", L"错误", MB_OK);
-            return;
+            ShowErrorMessage("Data 目录不存在");
+        }
+        else {
+            // 按规则并行扫描 Data 目录树，这里只登记文件，哈希交给后台线程
+            PathTree tree = ScanDataTree("Data", fileRules_, SCAN_THREADS);
+            entries.resize(tree.FileCount());
+            for (std::size_t i = 0; i < tree.FileCount(); ++i) {
+                tree.GetPath(i, entries[i].name);
+                entries[i].size = tree.FileAt(i).size;
+                entries[i].mtime = tree.FileAt(i).mtime;
+            }
         }
+    }
+    catch (const std::exception& e) {
+        ShowErrorMessage(e.what());
+    }
 
-        // 遍历当前目录下的 Data 文件夹
-        for (const auto& entry : fs::directory_iterator("Data")) {
+    // 上次的快照里大小和修改时间都没变的文件直接沿用哈希
+    std::shared_ptr<const ManifestSnapshot> previous = ManifestSnapshot::Map(WARM_SNAPSHOT_PATH);
+    if (previous) {
+        for (auto& file : entries) {
+            std::size_t index = previous->Find(file.name);
+            if (index == ManifestSnapshot::npos) {
+                continue;
+            }
+            ManifestSnapshot::Entry old = previous->At(index);
+            if (old.hashed && old.size == file.size && old.mtime == file.mtime) {
+                file.hash = old.hash;
+                file.hashed = true;
+            }
+        }
+    }
+    // 和上次的快照对比记下变化，新版本号就是这一代快照的代数
+    changelog_.Load(MANIFEST_CHANGELOG_PATH);
+    std::uint64_t version = changelog_.Record(previous.get(), entries);
+    previous.reset();   // Windows 上映射着的文件不能被替换，先放掉再写盘
+    snapshot_ = ManifestSnapshot::Build(std::move(entries), version);
+    // 先把文件列表写下来，快照的代数和日志的版本始终对得上；哈希算完后再覆盖一次
+    SaveWarmSnapshot(snapshot_);
+
+    hashStates.reserve(snapshot_->Count());
+    for (std::size_t i = 0; i < snapshot_->Count(); ++i) {
+        ManifestSnapshot::Entry entry = snapshot_->At(i);
+        auto state = std::make_shared<FileHashState>();
+        state->name.assign(entry.name.data(), entry.name.size());
+        state->totalBytes = entry.size;
+        if (entry.hashed) {
+            state->hashedBytes = entry.size;
+            state->SetHash(entry.hash);
+        }
+        else {
+            ++unhashedFiles_;
+        }
+        hashStates.push_back(std::move(state));
+    }
+    PublishDisplayStates();
 
-            if (entry.is_regular_file() && 
-                (entry.path().extension() == ".mpq" || entry.path().extension() == ".MPQ")) {
-                // 读取文件名和完整路径
-                std::string filename = entry.path().filename().string();
-                std::string fullPath = entry.path().string();
+    // 所有文件都沿用了旧哈希时不会再有 PublishHashedSnapshot，这里直接更新历史版本
+    if (unhashedFiles_ == 0) {
+        UpdateReleases();
+    }
 
-                // 打开文件
-                std::ifstream file(entry.path(), std::ios::binary);
-                if (!file.is_open()) {
-                    std::wstring errorMsg = L"无法打开文件: " + 
-                        std::wstring(fullPath.begin(), fullPath.end());
-                    MessageBoxW(NULL, errorMsg.c_str(), L"错误", MB_OK);
-                    continue;
-                }
+    for (const auto& state : hashStates) {
+        if (state->IsReady()) {
+            continue;
+        }
+        hashPool_.Post([this, state]() {
+            HashDataFile(*state);
+            // 回到网络线程处理等待这个文件的会话
+            asio::post(ioContext_, [this]() { OnFileHashed(); });
+        });
+    }
+}
 
-                // 获取文件大小
-                file.seekg(0, std::ios::end);
-                size_t filesize = file.tellg();
-                file.seekg(0, std::ios::beg);
-
-                // 使用缓冲区读取文件，提高性能
-                const size_t buffer_size = 8192;  // 8KB 缓冲区
-                std::vector<char> buffer(buffer_size);
-                size_t crc = 0;
-
-                while (file) {
-                    file.read(buffer.data(), buffer_size);
-                    std::streamsize count = file.gcount();
-                    if (count > 0) {
-                        // 只计算实际读取的数据
-                        crc ^= hasher(std::string_view(buffer.data(), count));
-                    }
-                }
-                file.close();
-                // 存储到器中
-                fileHashes[filename] = crc;
+void TcpServer::PublishHashedSnapshot() {
+    // 名字和顺序不变，hashStates 仍然和新快照一一对应
+    std::vector<ManifestEntry> entries;
+    entries.reserve(snapshot_->Count());
+    for (std::size_t i = 0; i < snapshot_->Count(); ++i) {
+        ManifestSnapshot::Entry entry = snapshot_->At(i);
+        const FileHashState& state = *hashStates[i];
+        bool hashed = !state.failed;
+        entries.push_back({ state.name, hashed ? state.hash : 0, entry.size, entry.mtime, hashed });
+    }
+    snapshot_ = ManifestSnapshot::Build(std::move(entries), snapshot_->Generation());
+
+    SaveWarmSnapshot(snapshot_);
+    UpdateReleases();
+}
+
+void TcpServer::SaveWarmSnapshot(std::shared_ptr<const ManifestSnapshot> snapshot) {
+    {
+        std::lock_guard<std::mutex> lock(pendingWarmSnapshotMutex_);
+        pendingWarmSnapshot_ = std::move(snapshot);
+    }
+    // 两个哈希线程可能同时执行这里：写盘的锁让它们依次写同一个临时文件，
+    // 排在后面的取到的是最新的快照，先写的列表快照不会盖掉算好哈希的快照
+    hashPool_.Post([this]() {
+        std::lock_guard<std::mutex> saveLock(warmSnapshotSaveMutex_);
+        std::shared_ptr<const ManifestSnapshot> latest;
+        {
+            std::lock_guard<std::mutex> lock(pendingWarmSnapshotMutex_);
+            latest = std::move(pendingWarmSnapshot_);
+        }
+        if (latest) {
+            latest->Save(WARM_SNAPSHOT_PATH);
+        }
+    });
+}
+
+void TcpServer::UpdateReleases() {
+    if (releaseStore_.History() == 0 && !chunkTransfers_) {
+        return;
+    }
+    // 每次启动只在全部哈希就绪后更新一次，不会有两个更新同时进行
+    std::shared_ptr<const ManifestSnapshot> snapshot = snapshot_;
+    hashPool_.Post([this, snapshot]() {
+        releaseStore_.Update("Data", *snapshot, &stopHashing);
+        asio::post(ioContext_, [this]() { ReloadCatalogIfChanged(); });
+    });
+}
+
+void TcpServer::ReloadCatalogIfChanged() {
+    // 正在读的时候又有更新，由下一次空闲清理补上
+    if (catalogReloading_) {
+        return;
+    }
+    catalogReloading_ = true;
+    hashPool_.Post([this, known = catalogIndexTime_]() {
+        std::filesystem::file_time_type time;
+        std::shared_ptr<const ReleaseStore::Catalog> catalog = ReadCatalogIfChanged(known, time);
+        asio::post(ioContext_, [this, catalog = std::move(catalog), time]() {
+            catalogReloading_ = false;
+            // 会话排队时已经拷下补丁和块的路径，旧表可以直接换掉
+            if (catalog) {
+                catalog_ = catalog;
+                catalogIndexTime_ = time;
+            }
+        });
+    });
+}
+
+void TcpServer::HashDataFile(FileHashState& state) {
+    std::size_t hash = 0;
+    if (!HashDataFileContent(std::filesystem::path("Data") / state.name, hash, &stopHashing, &state.hashedBytes)) {
+        state.failed = true;
+    }
+    state.SetHash(hash);
+}
+
+std::unique_ptr<TcpServer::LoadedManifest> TcpServer::ReadManifest(const std::filesystem::path& path,
+                                                                  const std::filesystem::path& changelogPath) {
+    // 直接使用映射的快照，和其他工作进程共享同一份
+    std::shared_ptr<const ManifestSnapshot> snapshot = ManifestSnapshot::Map(path);
+    if (!snapshot) {
+        return nullptr;
+    }
+
+    auto manifest = std::make_unique<LoadedManifest>();
+    manifest->path = path;
+    manifest->states.reserve(snapshot->Count());
+    for (std::size_t i = 0; i < snapshot->Count(); ++i) {
+        ManifestSnapshot::Entry entry = snapshot->At(i);
+        auto state = std::make_shared<FileHashState>();
+        state->name.assign(entry.name.data(), entry.name.size());
+        state->totalBytes = entry.size;
+        state->hashedBytes = entry.size;
+        state->failed = !entry.hashed;
+        state->SetHash(entry.hash);
+        manifest->states.push_back(std::move(state));
+    }
+    manifest->snapshot = std::move(snapshot);
+    // 监督进程先写日志再发布清单，这里读到的日志不会比清单旧
+    manifest->changelog.Load(changelogPath);
+    return manifest;
+}
+
+void TcpServer::InstallManifest(LoadedManifest& manifest) {
+    // 清单里的哈希都已就绪，不会有会话挂在旧列表上等待，可以直接替换
+    manifestPath_ = manifest.path;
+    snapshot_ = std::move(manifest.snapshot);
+    hashStates.swap(manifest.states);
+    PublishDisplayStates();
+    manifestGeneration_ = snapshot_->Generation();
+    // 边缘服务器的版本目录在清单发布之前就已完整，之后排队的文件都从新目录读取；
+    // 已经排队的传输拷下了完整路径，继续读旧目录，EdgeMirror 下次发布时才删除它
+    if (!mirrorRoot_.empty()) {
+        dataDirectory_ = EdgeMirror::VersionDirectory(mirrorRoot_, manifestGeneration_).generic_string() + "/";
+    }
+    changelog_ = std::move(manifest.changelog);
+}
+
+void TcpServer::PublishDisplayStates() {
+    auto states = std::make_shared<const std::vector<std::shared_ptr<FileHashState>>>(hashStates);
+    std::lock_guard<std::mutex> lock(displayStatesMutex_);
+    displayStates_ = std::move(states);
+}
+
+void TcpServer::ReloadManifestIfChanged() {
+    if ((manifestPath_.empty() && mirrorRoot_.empty()) || manifestReloading_) {
+        return;
+    }
+    manifestReloading_ = true;
+    // mirrorRoot_ 和 changelogPath_ 构造后不再改变，哈希线程上可以直接读
+    hashPool_.Post([this, path = manifestPath_, generation = manifestGeneration_]() {
+        // 边缘服务器的新一代清单写在新文件里
+        std::filesystem::path current = mirrorRoot_.empty() ? path : EdgeMirror::CurrentManifestPath(mirrorRoot_);
+        std::shared_ptr<LoadedManifest> manifest;
+        if (!current.empty()) {
+            std::uint64_t latest = ManifestSnapshot::PeekGeneration(current);
+            if (latest != 0 && latest != generation) {
+                manifest = ReadManifest(current, changelogPath_);
             }
         }
+        asio::post(ioContext_, [this, manifest = std::move(manifest)]() {
+            manifestReloading_ = false;
+            if (manifest) {
+                InstallManifest(*manifest);
+            }
+        });
+    });
+}
 
+#ifdef _WIN32
+// 以下是 ImGui 界面，不带界面的 POSIX 构建不编译
+// 显示磁盘队列和缓冲池的运行指标
+static void DrawServerMetrics(const TcpServer& server) {
+    DiskIoStats disk = server.GetDiskIoStats();
+    ImGui::Text("磁盘 I/O 线程: %zu  队列深度: %zu (峰值 %zu)  已完成: %llu",
+        disk.threadCount, disk.queueDepth, disk.peakQueueDepth,
+        static_cast<unsigned long long>(disk.completed));
+    ImGui::Text("磁盘任务等待: 平均 %.2f ms  最长 %.2f ms  排队上限: %zu  拒绝: %llu",
+        disk.averageWaitMs, disk.maxWaitMs, disk.maxQueueDepth, static_cast<unsigned long long>(disk.rejected));
+
+    // 后台哈希进度：全部完成后只显示汇总
+    auto states = server.HashStates();
+    static const std::vector<std::shared_ptr<FileHashState>> noStates;
+    const auto& hashStates = states ? *states : noStates;
+    std::size_t hashedFiles = 0;
+    for (const auto& state : hashStates) {
+        if (state->IsReady()) {
+            ++hashedFiles;
+        }
     }
-    catch (const std::exception& e) {
-        int wlen = MultiByteToWideChar(CP_UTF8, 0, e.what(), -1, NULL, 0);
-        std::wstring wstr(wlen, 0);
-        MultiByteToWideChar(CP_UTF8, 0, e.what(), -1, &wstr[0], wlen);
-        MessageBoxW(NULL, wstr.c_str(), L"错误", MB_OK);
+    ImGui::Text("文件哈希: %zu / %zu", hashedFiles, hashStates.size());
+    if (hashedFiles < hashStates.size()) {
+        char overlay[320];
+        for (const auto& state : hashStates) {
+            bool ready = state->IsReady();
+            std::uint64_t hashed = state->hashedBytes.load(std::memory_order_relaxed);
+            float fraction = ready ? 1.0f
+                : (state->totalBytes == 0 ? 0.0f : static_cast<float>(hashed) / state->totalBytes);
+            snprintf(overlay, sizeof(overlay), "%s%s", state->name.c_str(),
+                ready && state->failed ? "  (读取失败)" : "");
+            ImGui::ProgressBar(fraction, ImVec2(-1.0f, 0.0f), overlay);
+        }
+    }
+
+    FileCacheStats cache = server.GetFileCacheStats();
+    std::uint64_t lookups = cache.hits + cache.misses;
+    ImGui::Text("文件缓存: 命中率 %.1f%% (%llu/%llu)  常驻 %.1f MB / 预算 %.1f MB  块数 %zu",
+        lookups == 0 ? 0.0 : cache.hits * 100.0 / lookups,
+        static_cast<unsigned long long>(cache.hits), static_cast<unsigned long long>(lookups),
+        cache.residentBytes / 1048576.0, cache.budgetBytes / 1048576.0, cache.chunkCount);
+
+    BroadcastReaderStats broadcast = server.GetBroadcastStats();
+    ImGui::Text("读盘合并: 读盘 %llu 块  共享 %llu 块  进行中 %zu",
+        static_cast<unsigned long long>(broadcast.flights), static_cast<unsigned long long>(broadcast.fanOut),
+        broadcast.inFlight);
+
+    BundleCacheStats bundles = server.GetBundleStats();
+    ImGui::Text("小文件包: 打包 %llu 次  缓存命中 %llu  共享 %llu  常驻 %.1f MB (%zu 个包)",
+        static_cast<unsigned long long>(bundles.builds), static_cast<unsigned long long>(bundles.hits),
+        static_cast<unsigned long long>(bundles.shared), bundles.residentBytes / 1048576.0, bundles.bundleCount);
+
+    TransferCancelStats cancelStats = server.GetCancelStats();
+    ImGui::Text("断线取消: %llu 个会话  免去读盘发送 %.1f MB",
+        static_cast<unsigned long long>(cancelStats.cancelledSessions), cancelStats.avoidedBytes / 1048576.0);
+
+    AcceptStats accept = server.GetAcceptStats();
+    ImGui::Text("接受连接: %llu 个  失败 %llu  峰值 %llu 个/秒  (%zu 个监听套接字, %zu 个并发 accept)",
+        static_cast<unsigned long long>(accept.accepted), static_cast<unsigned long long>(accept.errors),
+        static_cast<unsigned long long>(accept.peakPerSecond), accept.acceptors, accept.pendingAccepts);
+
+    SessionMemoryStats sessionMemory = server.GetSessionMemoryStats();
+    ImGui::Text("会话内存: %zu 个连接  共 %.1f KB  平均 %zu 字节  空闲 %zu 个 (平均 %zu 字节)",
+        sessionMemory.sessions, sessionMemory.totalBytes / 1024.0,
+        sessionMemory.sessions == 0 ? 0 : sessionMemory.totalBytes / sessionMemory.sessions,
+        sessionMemory.idleSessions,
+        sessionMemory.idleSessions == 0 ? 0 : sessionMemory.idleBytes / sessionMemory.idleSessions);
+
+    PrefetchStats prefetch = PrefetchBudget::Instance().GetStats();
+    ImGui::Text("预读: 占用 %.1f MB / 预算 %.1f MB  接上 %llu 个文件  累计 %.1f MB",
+        prefetch.usedBytes / 1048576.0, prefetch.budgetBytes / 1048576.0,
+        static_cast<unsigned long long>(prefetch.handoffs), prefetch.prefetchedBytes / 1048576.0);
+
+    const BufferPool& pool = BufferPool::Instance();
+    ImGui::Text("传输缓冲池: 借出 %.1f MB / 上限 %.1f MB  已申请 %.1f MB%s",
+        pool.OutstandingBytes() / 1048576.0, pool.MaxOutstandingBytes() / 1048576.0,
+        pool.ReservedBytes() / 1048576.0, pool.UsingHugePages() ? "  (大页)" : "");
+
+    EdgeListStats edgeList = server.GetEdgeListStats();
+    if (edgeList.edges > 0) {
+        ImGui::Text("边缘服务器: %zu 个  已是最新 %zu 个", edgeList.edges, edgeList.current);
     }
 }
 
+// 边缘模式的复制进度
+static void DrawEdgeMetrics(const EdgeMirror& edge) {
+    EdgeMirrorStats stats = edge.GetStats();
+    ImGui::Text("边缘复制: 源版本 %llu  换上 %llu 个版本  整个文件 %llu  补丁 %llu  收到 %.1f MB  (%llu 轮, 失败 %llu)",
+        static_cast<unsigned long long>(stats.originVersion), static_cast<unsigned long long>(stats.releases),
+        static_cast<unsigned long long>(stats.fullFiles), static_cast<unsigned long long>(stats.patchedFiles),
+        stats.receivedBytes / 1048576.0, static_cast<unsigned long long>(stats.rounds),
+        static_cast<unsigned long long>(stats.failures));
+}
+
 void MainWindow() {
     static bool initialized = false;
     if (!initialized) {
@@ -480,6 +1411,102 @@ void MainWindow() {
             ImGui::PushItemWidth(200);
             ImGui::InputText("##ServerName", serverName, sizeof(serverName));
             ImGui::PopItemWidth();
+
+            // 热点文件缓存大小
+            ImGui::Text("文件缓存(MB):");
+            ImGui::SameLine();
+            ImGui::PushItemWidth(100);
+            if (ImGui::InputInt("##FileCacheMB", &fileCacheMB, 0, 0)) {
+                if (fileCacheMB < 0) fileCacheMB = 0;
+                if (g_server) {
+                    g_server->SetFileCacheBudget(static_cast<std::size_t>(fileCacheMB) * 1024 * 1024);
+                }
+            }
+            ImGui::PopItemWidth();
+
+            // 预读内存预算，0 表示关闭预读
+            ImGui::Text("预读预算(MB):");
+            ImGui::SameLine();
+            ImGui::PushItemWidth(100);
+            if (ImGui::InputInt("##PrefetchMB", &prefetchMB, 0, 0)) {
+                if (prefetchMB < 0) prefetchMB = 0;
+                PrefetchBudget::Instance().SetBudget(static_cast<std::size_t>(prefetchMB) * 1024 * 1024);
+            }
+            ImGui::PopItemWidth();
+
+            // 传输缓冲池：借出上限随时生效，达到上限的会话排队等待；大页方式只在第一次分配前生效
+            ImGui::Text("传输缓冲(MB):");
+            ImGui::SameLine();
+            ImGui::PushItemWidth(100);
+            if (ImGui::InputInt("##TransferBufferMB", &transferBufferMB, 0, 0)) {
+                if (transferBufferMB < 1) transferBufferMB = 1;
+                BufferPool::Instance().SetMaxOutstandingBytes(static_cast<std::size_t>(transferBufferMB) * 1024 * 1024);
+            }
+            ImGui::PopItemWidth();
+            ImGui::SameLine();
+            ImGui::PushItemWidth(120);
+            const char* hugePageNames[] = { "普通页", "透明大页", "显式大页" };
+            ImGui::Combo("##HugePages", &hugePageMode, hugePageNames, IM_ARRAYSIZE(hugePageNames));
+            ImGui::PopItemWidth();
+
+            // 监听配置，启动服务时生效
+            ImGui::Text("并发 accept:");
+            ImGui::SameLine();
+            ImGui::PushItemWidth(100);
+            ImGui::InputInt("##PendingAccepts", &pendingAccepts, 0, 0);
+            ImGui::PopItemWidth();
+            if (pendingAccepts < 1) pendingAccepts = 1;
+
+            ImGui::Text("监听队列:");
+            ImGui::SameLine();
+            ImGui::PushItemWidth(100);
+            ImGui::InputInt("##ListenBacklog", &listenBacklog, 0, 0);
+            ImGui::PopItemWidth();
+            if (listenBacklog < 0) listenBacklog = 0;
+
+            ImGui::Text("监听分片:");
+            ImGui::SameLine();
+            ImGui::PushItemWidth(100);
+            ImGui::InputInt("##ReusePortShards", &reusePortShards, 0, 0);
+            ImGui::PopItemWidth();
+            if (reusePortShards < 1) reusePortShards = 1;
+
+            // 历史版本、补丁和分块传输，启动服务时生效
+            ImGui::Text("历史版本数:");
+            ImGui::SameLine();
+            ImGui::PushItemWidth(100);
+            ImGui::InputInt("##ReleaseHistory", &releaseHistory, 0, 0);
+            ImGui::PopItemWidth();
+            if (releaseHistory < 0) releaseHistory = 0;
+            ImGui::SameLine();
+            ImGui::Checkbox("分块传输", &chunkTransfers);
+
+            // 边缘模式，启动服务时生效
+            ImGui::Checkbox("边缘模式", &edgeMode);
+            ImGui::SameLine();
+            ImGui::Text("源服务器:");
+            ImGui::SameLine();
+            ImGui::PushItemWidth(150);
+            ImGui::InputText("##OriginHost", originHost, sizeof(originHost));
+            ImGui::PopItemWidth();
+            ImGui::SameLine();
+            ImGui::PushItemWidth(80);
+            ImGui::InputInt("##OriginPort", &originPort, 0, 0);
+            ImGui::PopItemWidth();
+            if (originPort < 1) originPort = 1;
+            if (originPort > 65535) originPort = 65535;
+
+            // 文件发送顺序
+            ImGui::Text("发送顺序:");
+            ImGui::SameLine();
+            ImGui::PushItemWidth(200);
+            const char* policyNames[] = { "清单顺序", "小文件优先", "关键文件优先", "按优先级配置" };
+            if (ImGui::Combo("##TransferPolicy", &transferPolicy, policyNames, IM_ARRAYSIZE(policyNames))) {
+                if (g_server) {
+                    g_server->SetTransferPolicy(static_cast<TransferPolicy>(transferPolicy));
+                }
+            }
+            ImGui::PopItemWidth();
         }
         ImGui::EndGroup();
 
@@ -496,7 +1523,30 @@ void MainWindow() {
             if (ImGui::Button("启动服务", ImVec2(buttonWidth, buttonHeight))) {
                 try {
                     g_io_context = std::make_unique<asio::io_context>();
-                    g_server = std::make_unique<TcpServer>(*g_io_context, serverPort);
+                    // 缓冲池已经分配过时只更新借出上限
+                    BufferPool::Instance().Configure(BufferPool::DEFAULT_SLAB_SIZE,
+                                                     static_cast<std::size_t>(transferBufferMB) * 1024 * 1024,
+                                                     static_cast<HugePageMode>(hugePageMode));
+                    AcceptOptions acceptOptions;
+                    acceptOptions.pendingAccepts = static_cast<std::size_t>(pendingAccepts);
+                    acceptOptions.backlog = listenBacklog;
+                    acceptOptions.reusePortShards = static_cast<std::size_t>(reusePortShards);
+                    if (edgeMode) {
+                        // 从复制来的目录服务，复制线程在服务器启动后开始
+                        EdgeOptions edgeOptions;
+                        edgeOptions.originHost = originHost;
+                        edgeOptions.originPort = static_cast<short>(originPort);
+                        edgeOptions.advertiseIP = serverIP;
+                        edgeOptions.advertisePort = static_cast<short>(serverPort);
+                        edgeOptions.name = serverName;
+                        edgeOptions.root = EDGE_ROOT;
+                        g_edge = std::make_unique<EdgeMirror>(edgeOptions);
+                        g_server = std::make_unique<TcpServer>(*g_io_context, serverPort, acceptOptions,
+                                                               std::filesystem::path(), EDGE_ROOT);
+                    }
+                    else {
+                        g_server = std::make_unique<TcpServer>(*g_io_context, serverPort, acceptOptions);
+                    }
 
                     // 设置服务器配置
                     g_server->SetServerConfig(serverIP, serverPort, std::string(serverName));
@@ -507,6 +1557,9 @@ void MainWindow() {
                     g_io_thread = std::make_unique<std::thread>([&]() {
                         g_io_context->run();
                     });
+                    if (g_edge) {
+                        g_edge->Start();
+                    }
 
                     // 转换服务器名称为宽字符用于显示
                     int wideLen = MultiByteToWideChar(CP_UTF8, 0, serverName, -1, nullptr, 0);
@@ -529,12 +1582,14 @@ void MainWindow() {
         }
         else {
             if (ImGui::Button("停止服务", ImVec2(buttonWidth, buttonHeight))) {
+                g_edge.reset();   // 等复制线程退出，复制到一半的版本不会发布
                 if (g_server) {
-                    g_server->Stop();
+                    // 先停下 io 线程再关连接，Stop 不能和 io 线程同时操作会话的套接字
                     g_io_context->stop();
                     if (g_io_thread && g_io_thread->joinable()) {
                         g_io_thread->join();
                     }
+                    g_server->Stop();
                     g_server.reset();
                     g_io_context.reset();
                     g_io_thread.reset();
@@ -544,6 +1599,15 @@ void MainWindow() {
             }
         }
 
+        // 运行指标
+        if (g_serverRunning && g_server) {
+            ImGui::Separator();
+            DrawServerMetrics(*g_server);
+            if (g_edge) {
+                DrawEdgeMetrics(*g_edge);
+            }
+        }
+
         // 显示服务器状态
         ImGui::SetCursorPos(ImVec2(padding, windowSize.y - buttonHeight - padding));
         ImGui::Text("服务器状态: %s", g_serverRunning ? "运行中" : "已停止");
@@ -551,13 +1615,15 @@ void MainWindow() {
         ImGui::End();
     }
     else {
+        g_edge.reset();
         if (g_server) {
-            g_server->Stop();
             g_io_context->stop();
             if (g_io_thread && g_io_thread->joinable()) {
                 g_io_thread->join();
             }
+            g_server->Stop();
         }
         exit(0);
     }
 }
+#endif
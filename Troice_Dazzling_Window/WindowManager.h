@@ -5,8 +5,22 @@
 #define ASIO_NO_WIN32_LEAN_AND_MEAN
 #include <asio.hpp>
 #include "Protocol.h"
+#include "HandlerAllocator.h"
+#include "ClientSession.h"
+#include "DiskIoPool.h"
+#include "FileCache.h"
+#include "BroadcastReader.h"
+#include "BundleCache.h"
+#include "TransferPlanner.h"
+#include "ManifestFile.h"
+#include "DataScanner.h"
+#include "ManifestChangelog.h"
+#include "ReleaseStore.h"
+#include "EdgeMirror.h"
 
 // 标准库
+#include <atomic>
+#include <filesystem>
 #include <string>
 #include <memory>
 #include <thread>
@@ -15,41 +29,235 @@
 #include <vector>
 #include <unordered_map>
 #include <mutex>
-#include <set>
 #include <sstream>
+#include <string_view>
+
+// 单个数据文件的后台哈希状态。
+// 启动时只列目录，哈希交给后台线程；IsReady 之后 hash 可用，失败时 failed 为 true
+struct FileHashState {
+    std::string name;              // 相对 Data 的路径
+    std::uint64_t totalBytes = 0;
+    std::atomic<std::uint64_t> hashedBytes{ 0 };
+    std::atomic<bool> failed{ false };
+    std::atomic<bool> ready{ false };
+    std::size_t hash = 0;          // 只在 IsReady 之后读取
+
+    bool IsReady() const {
+        return ready.load(std::memory_order_acquire);
+    }
+    void SetHash(std::size_t value) {
+        hash = value;
+        ready.store(true, std::memory_order_release);
+    }
+};
+
+// 监听配置。大量启动器同时重连时，多挂几个 accept 并加大监听队列，
+// reusePortShards 大于 1 时用 SO_REUSEPORT 开多个监听套接字，由内核分摊新连接（仅 Linux）
+struct AcceptOptions {
+    std::size_t pendingAccepts = 16;   // 每个监听套接字同时挂着的 async_accept 数
+    int backlog = 0;                   // 监听队列长度，0 表示系统上限
+    std::size_t reusePortShards = 1;
+    bool reusePort = false;            // 只有一个监听套接字时也打开 SO_REUSEPORT，和其他进程共用端口
+};
+
+// 接受连接的统计
+struct AcceptStats {
+    std::size_t acceptors;
+    std::size_t pendingAccepts;
+    std::uint64_t accepted;
+    std::uint64_t errors;
+    std::uint64_t peakPerSecond;   // 一秒内接受的最多连接数
+};
+
+// 会话内存的统计，由空闲清理定时器定期更新
+struct SessionMemoryStats {
+    std::size_t sessions;
+    std::size_t idleSessions;      // 空闲超过清理时间、已经交还内存的会话
+    std::size_t totalBytes;        // 所有会话自身占用的用户态内存
+    std::size_t idleBytes;         // 其中空闲会话占用的部分
+};
+
+// 断线取消的统计
+struct TransferCancelStats {
+    std::uint64_t cancelledSessions;   // 传输途中断开的会话数
+    std::uint64_t avoidedBytes;        // 因此不再读盘发送的字节数
+};
+
+// 源服务器上报到过的边缘服务器
+struct EdgeListStats {
+    std::size_t edges;             // 最近报到过的
+    std::size_t current;           // 其中已复制到当前版本、会推荐给玩家的
+};
 
 class TcpServer {
 public:
-    TcpServer(asio::io_context& io_context, short port);
+    // manifestPath 不为空时不扫描和哈希 Data，改为映射监督进程写好的清单文件（见 Prefork.h），
+    // 并在空闲清理时检查清单有没有换代。
+    // mirrorRoot 不为空时是边缘服务器：清单和变化日志由 EdgeMirror 写在 mirrorRoot 下，每一代的清单各是一个文件，
+    // 不用填 manifestPath；数据文件从当前这一代的版本目录读取，清单换代时整体切到新目录
+    TcpServer(asio::io_context& io_context, short port, const AcceptOptions& acceptOptions = AcceptOptions(),
+              const std::filesystem::path& manifestPath = std::filesystem::path(),
+              const std::filesystem::path& mirrorRoot = std::filesystem::path());
+    ~TcpServer();
     void Start();
+    // 关闭监听和所有连接。只能在 io 线程里调用，或者等 io 线程停下之后调用
     void Stop();
     bool IsRunning() const { return isRunning; }
+    DiskIoPool& DiskPool() { return diskPool_; }
+    DiskIoStats GetDiskIoStats() const { return diskPool_.GetStats(); }
+    FileCache& Cache() { return fileCache_; }
+    FileCacheStats GetFileCacheStats() const { return fileCache_.GetStats(); }
+    void SetFileCacheBudget(std::size_t bytes) { fileCache_.SetBudget(bytes); }
+    BroadcastReader& Broadcast() { return broadcastReader_; }
+    BroadcastReaderStats GetBroadcastStats() const { return broadcastReader_.GetStats(); }
+    BundleCache& Bundles() { return bundleCache_; }
+    BundleCacheStats GetBundleStats() const { return bundleCache_.GetStats(); }
+    void RecordCancelledTransfer(std::uint64_t avoidedBytes) {
+        ++cancelledSessions_;
+        avoidedBytes_ += avoidedBytes;
+    }
+    TransferCancelStats GetCancelStats() const { return { cancelledSessions_.load(), avoidedBytes_.load() }; }
+    AcceptStats GetAcceptStats() const {
+        return { acceptors_.size(), acceptSlots_.size(), accepted_.load(), acceptErrors_.load(), peakAcceptsPerSecond_.load() };
+    }
+    SessionMemoryStats GetSessionMemoryStats() const {
+        return { sessionCount_.load(), idleSessionCount_.load(), sessionBytes_.load(), idleSessionBytes_.load() };
+    }
+    EdgeListStats GetEdgeListStats() const { return { edgeCount_.load(), currentEdgeCount_.load() }; }
+    void SetTransferPolicy(TransferPolicy policy) { planner_.SetPolicy(policy); }
+    // 数据文件所在的目录，以 / 结尾；边缘服务器上随清单换代，只在网络线程上读取
+    const std::string& DataDirectory() const { return dataDirectory_; }
     void LoadNotice();
     void LoadDataFiles();
+
+    // 各数据文件的哈希进度，按快照中的记录顺序排列，供界面线程显示。
+    // 使用清单文件时列表会在网络线程上随清单换代整体替换，所以这里给的是加锁取出的一份共享副本
+    std::shared_ptr<const std::vector<std::shared_ptr<FileHashState>>> HashStates() const {
+        std::lock_guard<std::mutex> lock(displayStatesMutex_);
+        return displayStates_;
+    }
     
     // 添加配置设置函数
     void SetServerConfig(const std::string& ip, int port, const std::string& name) {
         m_serverIP = ip;
         m_serverPort = port;
         m_serverName = name;
+        BuildServerInfoResponse();
     }
 
-private:
-    void StartAccept();
-    void HandleAccept(std::shared_ptr<asio::ip::tcp::socket> socket,
-                     const asio::error_code& error);
-    void HandleRead(std::shared_ptr<asio::ip::tcp::socket> socket,
-                   std::shared_ptr<asio::streambuf> buffer,
-                   const asio::error_code& error,
-                   std::size_t bytes_transferred);
-    
-    void HandleCommand(std::shared_ptr<asio::ip::tcp::socket> socket,
+    // 由 ClientSession 回调
+    void HandleCommand(const std::shared_ptr<ClientSession>& session,
                       const std::string& command);
-    
-    void SendResponse(std::shared_ptr<asio::ip::tcp::socket> socket,
+    void RemoveSession(const std::shared_ptr<ClientSession>& session);
+
+    // 接收缓冲区池，会话只在读消息期间借用
+    std::unique_ptr<asio::streambuf> AcquireReceiveBuffer();
+    void RecycleReceiveBuffer(std::unique_ptr<asio::streambuf> buffer);
+
+private:
+    // 一个挂着的 accept：所属监听套接字和它自己的处理器内存。
+    // 回调持有 shared_ptr，服务器先于 io_context 销毁时未执行的操作仍能安全释放内存
+    struct AcceptSlot {
+        asio::ip::tcp::acceptor* acceptor;
+        HandlerMemory memory;
+    };
+
+    void OpenAcceptors(short port, const AcceptOptions& options);
+    void StartAccept(const std::shared_ptr<AcceptSlot>& slot);
+    void HandleAccept(const std::shared_ptr<AcceptSlot>& slot, const asio::error_code& error,
+                      asio::ip::tcp::socket socket);
+    void CountAccept();
+    // accept 出错（如文件句柄用尽）的槽位稍后再挂，避免空转
+    void RetryAcceptLater(const std::shared_ptr<AcceptSlot>& slot);
+
+    void HandleCheckPatches(const std::shared_ptr<ClientSession>& session,
+                           std::string_view cmdContent);
+    // 二进制清单的 CHECK_PATCHES，结果和文本格式相同
+    void HandleBinaryCheckPatches(const std::shared_ptr<ClientSession>& session, std::string_view cmdContent);
+    // 把快照编码成二进制清单推给客户端，哈希没算完时等 OnFileHashed 再发
+    void HandleGetManifest(const std::shared_ptr<ClientSession>& session);
+    void SendManifest(const std::shared_ptr<ClientSession>& session);
+    void SendDeleteFiles(const std::shared_ptr<ClientSession>& session, const std::vector<std::string_view>& files);
+    // 按客户端上次同步的版本只发这之后的净变化，版本不在日志里时让客户端完整对比
+    void HandleSync(const std::shared_ptr<ClientSession>& session, std::string_view cmdContent);
+    void BuildServerInfoResponse();
+    // 读取允许报到的边缘服务器（Edges.txt），没有这个文件时不接受任何边缘服务器
+    void LoadEdgeAllowList();
+    // EDGE_HELLO：记下边缘服务器的地址和它复制到的版本
+    void HandleEdgeHello(const std::shared_ptr<ClientSession>& session, std::string_view cmdContent);
+    // INIT_SERVER_INFO|EDGES| 时追加的 EDGE_SERVERS
+    void SendEdgeServers(const std::shared_ptr<ClientSession>& session);
+    // 去掉太久没报到的边缘服务器并更新统计
+    void ExpireEdges();
+
+    // 后台哈希一个数据文件，在哈希线程上执行
+    void HashDataFile(FileHashState& state);
+    // 读好的清单：映射的快照、按快照顺序的文件状态（哈希直接可用）和版本日志
+    struct LoadedManifest {
+        std::filesystem::path path;
+        std::shared_ptr<const ManifestSnapshot> snapshot;
+        std::vector<std::shared_ptr<FileHashState>> states;
+        ManifestChangelog changelog;
+    };
+    // 映射清单文件并读取日志，失败时返回空。只读文件，不碰成员，在哈希线程上调用
+    static std::unique_ptr<LoadedManifest> ReadManifest(const std::filesystem::path& path,
+                                                        const std::filesystem::path& changelogPath);
+    // 在网络线程上换上读好的清单
+    void InstallManifest(LoadedManifest& manifest);
+    // 把当前的 hashStates 交给界面线程
+    void PublishDisplayStates();
+    // 在哈希线程上检查清单是否换了一代，读好后回到网络线程换上；网络线程不读盘
+    void ReloadManifestIfChanged();
+    // 有文件哈希完成时在网络线程上调用，继续处理等待中的 CHECK_PATCHES
+    void OnFileHashed();
+    // 全部哈希完成后发布带哈希的快照，并在后台写盘供下次启动使用
+    void PublishHashedSnapshot();
+    // 在哈希线程上把快照写到 Data.snapshot。写盘一次只有一个线程，
+    // 总是写最后交来的一份，还没写的旧快照被新的顶掉后不再写
+    void SaveWarmSnapshot(std::shared_ptr<const ManifestSnapshot> snapshot);
+    // 全部哈希就绪后在后台更新历史版本、块和补丁，完成后换上新的目录
+    void UpdateReleases();
+    // 版本索引有变化（本进程或监督进程更新过）时重新读取补丁表和块列表。
+    // 同样在哈希线程上读，网络线程只换指针
+    void ReloadCatalogIfChanged();
+    // HAVE_CHUNKS：记下客户端已有的块
+    void HandleHaveChunks(const std::shared_ptr<ClientSession>& session, std::string_view cmdContent);
+    // 按块发送一个文件：先发块列表，再发客户端没有的块。没有这个版本的块列表时返回 false
+    bool QueueChunkTransfer(const std::shared_ptr<ClientSession>& session, const FileHashState& file);
+    // 对比已经算好哈希的文件并发送结果，其余的留到之后再处理
+    void ResolvePendingChecks(const std::shared_ptr<ClientSession>& session);
+
+    void SendResponse(const std::shared_ptr<ClientSession>& session,
                      const std::string& response);
 
-    asio::ip::tcp::acceptor acceptor_;
+    // 定期回收长时间空闲会话的内存，并更新会话内存统计
+    void StartIdleSweep();
+    void SweepIdleSessions();
+
+    asio::io_context& ioContext_;
+    std::vector<asio::ip::tcp::acceptor> acceptors_;
+    std::vector<std::shared_ptr<AcceptSlot>> acceptSlots_;
+    std::atomic<std::uint64_t> accepted_;
+    std::atomic<std::uint64_t> acceptErrors_;
+    std::atomic<std::uint64_t> peakAcceptsPerSecond_;
+    std::chrono::steady_clock::time_point acceptWindowStart_;
+    std::uint64_t acceptsInWindow_;
+    asio::steady_timer acceptRetryTimer_;
+    std::vector<std::shared_ptr<AcceptSlot>> acceptRetrySlots_;
+    BundleCache bundleCache_;   // 小文件包；在 diskPool_ 之前声明，磁盘线程退出后才销毁
+    DiskIoPool diskPool_;   // 文件打开和读取专用线程池
+    FileCache fileCache_;   // 热点文件块缓存
+    BroadcastReader broadcastReader_;   // 同一块的并发读盘合并
+    TransferPlanner planner_;           // 会话内文件的发送顺序
+    FileRules fileRules_;               // Data 下哪些文件放进清单
+    std::atomic<std::uint64_t> cancelledSessions_;
+    std::atomic<std::uint64_t> avoidedBytes_;
+    asio::steady_timer idleSweepTimer_;
+    std::shared_ptr<HandlerMemory> idleSweepHandlerMemory_;   // 同 AcceptSlot，由回调共同持有
+    std::atomic<std::size_t> sessionCount_;
+    std::atomic<std::size_t> idleSessionCount_;
+    std::atomic<std::size_t> sessionBytes_;
+    std::atomic<std::size_t> idleSessionBytes_;
     bool isRunning;
     std::string noticeContent;
 
@@ -58,12 +266,58 @@ private:
     int m_serverPort;
     std::string m_serverName;
 
-    // 添加 fileHashes 容器
-    std::unordered_map<std::string, size_t> fileHashes;
+    // 数据文件清单，只在网络线程上读取和替换；hashStates 与其中的记录一一对应
+    std::shared_ptr<const ManifestSnapshot> snapshot_;
+    std::vector<std::shared_ptr<FileHashState>> hashStates;    // 按快照顺序
+    // hashStates 每次建好或替换后拷一份给界面线程
+    std::shared_ptr<const std::vector<std::shared_ptr<FileHashState>>> displayStates_;
+    mutable std::mutex displayStatesMutex_;
+    std::shared_ptr<const ManifestSnapshot> pendingWarmSnapshot_;   // 等着写盘的快照
+    std::mutex pendingWarmSnapshotMutex_;
+    std::mutex warmSnapshotSaveMutex_;                               // 同一时刻只有一个线程写 Data.snapshot
+    std::size_t unhashedFiles_;                                 // 还在后台哈希的文件数
+    std::vector<std::weak_ptr<ClientSession>> hashWaiters;    // 等待哈希完成的会话
+    std::atomic<bool> stopHashing;
+    std::filesystem::path manifestPath_;       // 为空时自己哈希 Data
+    std::filesystem::path mirrorRoot_;         // 边缘服务器的复制目录，为空时不是边缘服务器
+    std::filesystem::path changelogPath_;
+    std::string dataDirectory_;
+    std::uint64_t manifestGeneration_;         // 当前使用的清单代数
+    ManifestChangelog changelog_;              // 清单的版本历史，版本号就是快照的代数
+    ManifestChangelog::Delta syncDelta_;       // SYNC 用的临时结果，保留容量
+    std::shared_ptr<const ManifestSnapshot> encodedSnapshot_;  // manifestMessage_ 对应的快照
+    std::string manifestMessage_;              // 编码好的 MANIFEST 推送
+    std::vector<std::weak_ptr<ClientSession>> manifestWaiters_;   // 等全部哈希算完的 GET_MANIFEST
+    ReleaseStore releaseStore_;                // 历史版本、块和补丁，只在哈希线程上更新
+    bool chunkTransfers_;                      // 没有历史版本时也保存当前版本的块
+    std::shared_ptr<const ReleaseStore::Catalog> catalog_;    // 网络线程上使用的补丁表和块列表
+    std::filesystem::file_time_type catalogIndexTime_;        // 已读取的版本索引的修改时间
+    bool manifestReloading_;                   // 哈希线程上正在检查清单，只在网络线程上读写
+    bool catalogReloading_;                    // 哈希线程上正在读取版本索引，同上
+
+    // 报到过的边缘服务器，只在网络线程上使用
+    struct EdgeServer {
+        std::string ip;
+        std::string port;
+        std::string name;
+        std::uint64_t version;
+        std::chrono::steady_clock::time_point lastSeen;
+    };
+    std::unordered_map<std::string, std::string> edgeAllowList_;   // 连接来源地址 -> 推荐给玩家的地址
+    std::unordered_map<std::string, EdgeServer> edges_;            // 以 <IP>|<端口> 为键
+    std::atomic<std::size_t> edgeCount_;
+    std::atomic<std::size_t> currentEdgeCount_;
+
+    // 预先拼好的 SERVER_INFO 响应，配置或通知变化时重建
+    std::string serverInfoResponse;
 
     // 添加客户端连接容器
-    std::vector<std::shared_ptr<asio::ip::tcp::socket>> clients;
-    std::mutex clientsMutex; // 用于保护 clients 容器的互斥锁
+    std::vector<std::shared_ptr<ClientSession>> clients;
+    std::vector<std::unique_ptr<asio::streambuf>> spareReceiveBuffers;
+    std::mutex clientsMutex; // 用于保护 clients 和 spareReceiveBuffers 的互斥锁
+
+    // 放在最后，析构时最先等待哈希线程退出，之后才销毁它们用到的成员
+    DiskIoPool hashPool_;
 };
 
 void MainWindow();
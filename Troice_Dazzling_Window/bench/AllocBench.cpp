@@ -0,0 +1,119 @@
+// 稳态请求的堆分配计数。
+// 客户端反复发送 INIT_SERVER_INFO 和一个文件已是最新的 CHECK_PATCHES，预热之后统计网络线程上的 operator new 次数。
+// 空闲清理每 5 秒在网络线程上检查一次清单和补丁索引，会分配少量内存，不属于请求路径；
+// 统计的一段碰上清理时再测一段，最多测 3 段。
+// 用法: AllocBench [预热轮数] [统计轮数]，每段分配次数都不为 0 时返回 1
+#include "WindowManager.h"
+
+// 标准库
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+
+namespace {
+    std::atomic<bool> g_counting{ false };
+    std::atomic<long> g_allocations{ 0 };
+    thread_local bool t_networkThread = false;
+
+    const unsigned short PORT = 23480;
+    const int MAX_WINDOWS = 3;
+
+    std::string ReadMessage(asio::ip::tcp::socket& socket, asio::streambuf& buffer) {
+        std::size_t length = asio::read_until(socket, buffer, "<END_OF_MESSAGE>");
+        std::string message(asio::buffers_begin(buffer.data()), asio::buffers_begin(buffer.data()) + length);
+        buffer.consume(length);
+        return message;
+    }
+}
+
+void* operator new(std::size_t size) {
+    if (t_networkThread && g_counting.load(std::memory_order_relaxed)) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    void* pointer = std::malloc(size != 0 ? size : 1);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+int main(int argc, char** argv) {
+    int warmupRounds = argc > 1 ? std::atoi(argv[1]) : 50;
+    int countedRounds = argc > 2 ? std::atoi(argv[2]) : 150;
+
+    namespace fs = std::filesystem;
+    fs::create_directories("alloc_bench/Data");
+    fs::current_path("alloc_bench");
+    {
+        std::ofstream file("Data/patch-1.MPQ", std::ios::binary | std::ios::trunc);
+        file << std::string(64 * 1024, 'p');
+    }
+    { std::ofstream notice("G.txt"); }
+
+    asio::io_context io;
+    TcpServer server(io, PORT);
+    server.SetServerConfig("127.0.0.1", PORT, "bench");
+    server.Start();
+    std::thread thread([&]() {
+        t_networkThread = true;
+        io.run();
+    });
+
+    // 等后台哈希完成，客户端报上同样的哈希，服务器认为文件已是最新
+    auto states = server.HashStates();
+    while (!(*states)[0]->IsReady()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    std::size_t hash = (*states)[0]->hash;
+
+    asio::io_context clientIo;
+    asio::ip::tcp::socket socket(clientIo);
+    socket.connect({ asio::ip::make_address("127.0.0.1"), PORT });
+    socket.set_option(asio::ip::tcp::no_delay(true));
+    asio::streambuf buffer;
+    std::string init = "INIT_SERVER_INFO|<END_OF_MESSAGE>";
+    std::string check = "CHECK_PATCHES|patch-1.MPQ|" + std::to_string(hash) + "|<END_OF_MESSAGE>";
+
+    auto runRounds = [&](int rounds) {
+        for (int round = 0; round < rounds; ++round) {
+            asio::write(socket, asio::buffer(init));
+            ReadMessage(socket, buffer);
+            asio::write(socket, asio::buffer(check));
+            asio::write(socket, asio::buffer(init));
+            ReadMessage(socket, buffer);
+        }
+    };
+
+    runRounds(warmupRounds);
+    long allocations = 0;
+    for (int window = 0; window < MAX_WINDOWS; ++window) {
+        g_allocations = 0;
+        g_counting = true;
+        runRounds(countedRounds);
+        g_counting = false;
+        allocations = g_allocations.load();
+        std::cout << "网络线程在 " << countedRounds << " 轮稳态请求中的堆分配: " << allocations << std::endl;
+        if (allocations == 0) {
+            break;
+        }
+    }
+
+    socket.close();
+    io.stop();
+    thread.join();
+    server.Stop();
+    return allocations == 0 ? 0 : 1;
+}
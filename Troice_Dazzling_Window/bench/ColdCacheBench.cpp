@@ -0,0 +1,141 @@
+// 冷缓存下的并发大文件传输。
+// 写好一批数据文件后让内核丢掉它们的页缓存，再让多个客户端同时请求全部文件，
+// 统计所有客户端收完的用时和吞吐，并逐字节核对收到的内容。
+// 用法: ColdCacheBench [文件数] [每个文件 MB] [客户端数]，有客户端收到的内容不对时返回 1
+#include "FileReader.h"
+#include "WindowManager.h"
+
+// 标准库
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+    const unsigned short PORT = 23457;
+
+    // 刷盘后丢掉页缓存，之后第一次读取必须真的访问磁盘；文件系统不支持时只是变成热缓存
+    void DropPageCache(const std::filesystem::path& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+
+    // 请求全部文件，收齐 UPDATE_FILES 后核对每个文件
+    bool FetchAll(const std::vector<std::pair<std::string, std::string>>& files, std::uint64_t& bytes) {
+        asio::io_context io;
+        asio::ip::tcp::socket socket(io);
+        socket.connect({ asio::ip::make_address("127.0.0.1"), PORT });
+        asio::write(socket, asio::buffer(std::string("REQ|1|CHECK_PATCHES|<END_OF_MESSAGE>")));
+
+        std::string received;
+        std::vector<char> buffer(256 * 1024);
+        const std::string done = "REQ|1|REQUEST_DONE|<END_OF_MESSAGE>";
+        // REQUEST_DONE 在所有文件之后，只在新收到的部分里找
+        std::size_t searchFrom = 0;
+        while (received.find(done, searchFrom) == std::string::npos) {
+            searchFrom = received.size() < done.size() ? 0 : received.size() - done.size();
+            asio::error_code error;
+            std::size_t length = socket.read_some(asio::buffer(buffer), error);
+            if (error) {
+                return false;
+            }
+            received.append(buffer.data(), length);
+        }
+        bytes = received.size();
+
+        for (const auto& file : files) {
+            std::string message = "REQ|1|UPDATE_FILES|" + file.first + "|" + std::to_string(file.second.size())
+                + "|<START_CONTENT>|" + file.second + "|<END_CONTENT>|<END_OF_MESSAGE>";
+            if (received.find(message) == std::string::npos) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::size_t fileCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 8;
+    std::size_t fileMB = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 64;
+    std::size_t clientCount = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 16;
+
+    namespace fs = std::filesystem;
+    fs::remove_all("cold_cache_bench");
+    fs::create_directories("cold_cache_bench/Data");
+    fs::current_path("cold_cache_bench");
+    { std::ofstream notice("G.txt"); }
+
+    std::vector<std::pair<std::string, std::string>> files;
+    std::mt19937_64 random(28);
+    for (std::size_t i = 0; i < fileCount; ++i) {
+        std::string name = "patch-" + std::to_string(i) + ".MPQ";
+        std::string content(fileMB * 1024 * 1024, '\0');
+        for (auto& c : content) {
+            c = static_cast<char>(random());
+        }
+        std::ofstream(fs::path("Data") / name, std::ios::binary | std::ios::trunc).write(content.data(), content.size());
+        files.emplace_back(name, std::move(content));
+    }
+
+    asio::io_context io;
+    TcpServer server(io, PORT);
+    server.SetServerConfig("127.0.0.1", PORT, "bench");
+    server.Start();
+    std::thread thread([&]() { io.run(); });
+
+    auto states = server.HashStates();
+    for (const auto& state : *states) {
+        while (!state->IsReady()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+    // 哈希时读过一遍，这里再丢一次页缓存
+    for (const auto& file : files) {
+        DropPageCache(fs::path("Data") / file.first);
+    }
+
+    std::atomic<std::size_t> good{ 0 };
+    std::atomic<std::uint64_t> totalBytes{ 0 };
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (std::size_t i = 0; i < clientCount; ++i) {
+        clients.emplace_back([&]() {
+            std::uint64_t bytes = 0;
+            if (FetchAll(files, bytes)) {
+                ++good;
+            }
+            totalBytes += bytes;
+        });
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    DiskIoStats disk = server.GetDiskIoStats();
+    FileCacheStats cache = server.GetFileCacheStats();
+    std::cout << clientCount << " 个客户端 x " << fileCount << " 个 " << fileMB << " MB 文件: 正确 " << good << "/" << clientCount
+              << "  用时 " << seconds << " s  吞吐 " << totalBytes / seconds / (1024 * 1024) << " MB/s" << std::endl;
+    std::cout << "磁盘任务 " << disk.completed << "  平均等待 " << disk.averageWaitMs << " ms  最长 " << disk.maxWaitMs
+              << " ms  拒绝 " << disk.rejected << "  缓存命中 " << cache.hits << " 未命中 " << cache.misses << std::endl;
+    const char* backend = FileReader::AsyncFileBackendName();
+    std::cout << "文件读取: " << (backend && FileReader::AsyncFileAvailable() ? backend : "缓冲读取") << std::endl;
+
+    io.stop();
+    thread.join();
+    server.Stop();
+    return good == clientCount ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+// 连接风暴：多个线程同时发起大量连接，统计服务器接受完所有连接的用时和速率。
+// 依次比较只挂一个 accept、同时挂 16 个 accept，以及再分成 4 个 SO_REUSEPORT 监听套接字。
+// 用法: ConnectStormBench [连接数]，有配置没能接受完全部连接时返回 1
+#include "WindowManager.h"
+
+// 标准库
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+    const int CONNECT_THREADS = 8;
+
+    struct StormConfig {
+        std::size_t pendingAccepts;
+        std::size_t shards;
+        const char* name;
+    };
+}
+
+int main(int argc, char** argv) {
+    int connections = argc > 1 ? std::atoi(argv[1]) : 10000;
+
+    // 每个连接两端各占一个描述符
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    namespace fs = std::filesystem;
+    fs::create_directories("connect_storm_bench/Data");
+    fs::current_path("connect_storm_bench");
+    { std::ofstream notice("G.txt"); }
+
+    const StormConfig configs[] = {
+        { 1, 1, "1 个 accept" },
+        { 16, 1, "16 个 accept" },
+        { 16, 4, "16 个 accept x 4 个监听套接字" },
+    };
+    unsigned short port = 23490;
+    bool allAccepted = true;
+    for (const auto& config : configs) {
+        asio::io_context io;
+        AcceptOptions options;
+        options.pendingAccepts = config.pendingAccepts;
+        options.reusePortShards = config.shards;
+        TcpServer server(io, port, options);
+        server.SetServerConfig("127.0.0.1", port, "bench");
+        server.Start();
+        std::thread thread([&]() { io.run(); });
+
+        std::vector<int> sockets(connections, -1);
+        std::vector<std::thread> connectors;
+        auto start = std::chrono::steady_clock::now();
+        for (int k = 0; k < CONNECT_THREADS; ++k) {
+            connectors.emplace_back([&, k]() {
+                sockaddr_in address{};
+                address.sin_family = AF_INET;
+                address.sin_port = htons(port);
+                inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+                for (int i = k; i < connections; i += CONNECT_THREADS) {
+                    int fd = socket(AF_INET, SOCK_STREAM, 0);
+                    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+                        std::perror("connect");
+                    }
+                    sockets[i] = fd;
+                }
+            });
+        }
+        for (auto& connector : connectors) {
+            connector.join();
+        }
+        while (server.GetAcceptStats().accepted < static_cast<std::uint64_t>(connections)
+               && std::chrono::steady_clock::now() - start < std::chrono::seconds(60)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        AcceptStats stats = server.GetAcceptStats();
+        std::cout << config.name << ": 接受 " << stats.accepted << "  失败 " << stats.errors << "  用时 " << ms << " ms  "
+                  << stats.accepted * 1000.0 / ms << " 个/秒  监听套接字 " << stats.acceptors << std::endl;
+        allAccepted = allAccepted && stats.accepted >= static_cast<std::uint64_t>(connections);
+
+        for (int fd : sockets) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        io.stop();
+        thread.join();
+        server.Stop();
+        ++port;
+    }
+    return allAccepted ? 0 : 1;
+}